@@ -668,7 +668,7 @@ static void getContourCenter(const rcContour* cont, const float* orig, float cs,
 	center[2] += orig[2];
 }
 
-static const rcContour* findContourFromSet(const rcContourSet& cset, unsigned short reg)
+static const rcContour* findContourFromSet(const rcContourSet& cset, rcRegionId reg)
 {
 	for (int i = 0; i < cset.nconts; ++i)
 	{
@@ -700,8 +700,8 @@ void duDebugDrawRegionConnections(duDebugDraw* dd, const rcContourSet& cset, con
 		for (int j = 0; j < cont->nverts; ++j)
 		{
 			const int* v = &cont->verts[j*4];
-			if (v[3] == 0 || (unsigned short)v[3] < cont->reg) continue;
-			const rcContour* cont2 = findContourFromSet(cset, (unsigned short)v[3]);
+			if (v[3] == 0 || (rcRegionId)(v[3] & RC_CONTOUR_REG_MASK) < cont->reg) continue;
+			const rcContour* cont2 = findContourFromSet(cset, (rcRegionId)(v[3] & RC_CONTOUR_REG_MASK));
 			if (cont2)
 			{
 				getContourCenter(cont2, orig, cs, ch, pos2);
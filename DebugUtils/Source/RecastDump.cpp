@@ -134,8 +134,11 @@ bool duDumpPolyMeshDetailToObj(rcPolyMeshDetail& dmesh, duFileIO* io)
 	return true;
 }
 
+// Region ids are stored at their native width, see RC_WIDE_REGIONS.
+static const int REGION_ID_SIZE = sizeof(rcRegionId);
+
 static const int CSET_MAGIC = ('c' << 24) | ('s' << 16) | ('e' << 8) | 't';
-static const int CSET_VERSION = 2;
+static const int CSET_VERSION = 3;
 
 bool duDumpContourSet(struct rcContourSet& cset, duFileIO* io)
 {
@@ -152,6 +155,7 @@ bool duDumpContourSet(struct rcContourSet& cset, duFileIO* io)
 	
 	io->write(&CSET_MAGIC, sizeof(CSET_MAGIC));
 	io->write(&CSET_VERSION, sizeof(CSET_VERSION));
+	io->write(&REGION_ID_SIZE, sizeof(REGION_ID_SIZE));
 
 	io->write(&cset.nconts, sizeof(cset.nconts));
 	
@@ -209,6 +213,14 @@ bool duReadContourSet(struct rcContourSet& cset, duFileIO* io)
 		return false;
 	}
 	
+	int regionIdSize = 0;
+	io->read(&regionIdSize, sizeof(regionIdSize));
+	if (regionIdSize != REGION_ID_SIZE)
+	{
+		printf("duReadContourSet: Bad region id size %d (expected %d).\n", regionIdSize, REGION_ID_SIZE);
+		return false;
+	}
+	
 	io->read(&cset.nconts, sizeof(cset.nconts));
 
 	cset.conts = (rcContour*)rcAlloc(sizeof(rcContour)*cset.nconts, RC_ALLOC_PERM);
@@ -259,7 +271,7 @@ bool duReadContourSet(struct rcContourSet& cset, duFileIO* io)
 	
 
 static const int CHF_MAGIC = ('r' << 24) | ('c' << 16) | ('h' << 8) | 'f';
-static const int CHF_VERSION = 3;
+static const int CHF_VERSION = 4;
 
 bool duDumpCompactHeightfield(struct rcCompactHeightfield& chf, duFileIO* io)
 {
@@ -276,6 +288,7 @@ bool duDumpCompactHeightfield(struct rcCompactHeightfield& chf, duFileIO* io)
 	
 	io->write(&CHF_MAGIC, sizeof(CHF_MAGIC));
 	io->write(&CHF_VERSION, sizeof(CHF_VERSION));
+	io->write(&REGION_ID_SIZE, sizeof(REGION_ID_SIZE));
 	
 	io->write(&chf.width, sizeof(chf.width));
 	io->write(&chf.height, sizeof(chf.height));
@@ -344,6 +357,14 @@ bool duReadCompactHeightfield(struct rcCompactHeightfield& chf, duFileIO* io)
 		return false;
 	}
 	
+	int regionIdSize = 0;
+	io->read(&regionIdSize, sizeof(regionIdSize));
+	if (regionIdSize != REGION_ID_SIZE)
+	{
+		printf("duReadCompactHeightfield: Bad region id size %d (expected %d).\n", regionIdSize, REGION_ID_SIZE);
+		return false;
+	}
+	
 	io->read(&chf.width, sizeof(chf.width));
 	io->read(&chf.height, sizeof(chf.height));
 	io->read(&chf.spanCount, sizeof(chf.spanCount));
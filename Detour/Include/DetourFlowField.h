@@ -0,0 +1,126 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURFLOWFIELD_H
+#define DETOURFLOWFIELD_H
+
+#include "DetourNavMesh.h"
+#include "DetourStatus.h"
+
+/// Per polygon entry of a flow field.
+/// @ingroup detour
+struct dtFlowFieldCell
+{
+	dtPolyRef next;		///< The next polygon towards the nearest goal. (Goal polygons point to themselves, 0 if unreachable.)
+	float cost;			///< The cost to reach the nearest goal from the exit portal of the polygon. (FLT_MAX if unreachable.)
+};
+
+/// Stores the result of a reverse Dijkstra search from a set of goal polygons.
+/// The field is built using dtNavMeshQuery::buildFlowField() and can be shared
+/// by any number of agents moving towards the same goals.
+/// @ingroup detour
+class dtFlowField
+{
+public:
+	dtFlowField();
+	~dtFlowField();
+
+	/// Prepares the field for the current tiles of the navigation mesh and clears it.
+	/// Called by dtNavMeshQuery::buildFlowField(), the user does not need to call this.
+	///  @param[in]		nav			The navigation mesh the field is built for.
+	///  @param[in]		goalRefs	The reference ids of the goal polygons. [(polyRef) * @p goalCount]
+	///  @param[in]		goalPos		A position within each goal polygon. [(x, y, z) * @p goalCount]
+	///  @param[in]		goalCount	The number of goals.
+	/// @returns The status flags for the operation.
+	dtStatus reset(const dtNavMesh* nav, const dtPolyRef* goalRefs, const float* goalPos, const int goalCount);
+
+	/// Returns the cell of the specified polygon.
+	///  @param[in]		ref		The reference id of the polygon.
+	/// @return The cell, or null if the polygon was not part of the navigation mesh when the field was built.
+	dtFlowFieldCell* getCell(dtPolyRef ref);
+	const dtFlowFieldCell* getCell(dtPolyRef ref) const;
+
+	/// Returns true if the specified polygon can reach a goal.
+	bool isReachable(dtPolyRef ref) const;
+
+	/// Returns the next polygon towards the nearest goal, or 0 if the polygon is a goal or not reachable.
+	dtPolyRef getNextPoly(dtPolyRef ref) const;
+
+	/// Returns the cost to reach the nearest goal from the polygon, or FLT_MAX if not reachable.
+	float getCostToGoal(dtPolyRef ref) const;
+
+	/// Returns the goal polygon the specified polygon flows to.
+	///  @param[in]		ref		The reference id of the polygon.
+	///  @param[out]	goalPos	The position of the goal. [(x, y, z)] [opt]
+	/// @return The reference id of the goal polygon, or 0 if the polygon is not reachable.
+	dtPolyRef findGoal(dtPolyRef ref, float* goalPos) const;
+
+	/// Extracts the corridor from the specified polygon to the nearest goal.
+	///  @param[in]		startRef	The reference id of the start polygon.
+	///  @param[out]	path		An ordered list of polygon references representing the path. (Start to goal.)
+	///  							[(polyRef) * @p pathCount]
+	///  @param[out]	pathCount	The number of polygons returned in the @p path array.
+	///  @param[in]		maxPath		The maximum number of polygons the @p path array can hold. [Limit: >= 1]
+	/// @returns The status flags for the query.
+	dtStatus getPath(dtPolyRef startRef, dtPolyRef* path, int* pathCount, const int maxPath) const;
+
+	/// Returns the navigation mesh the field was built for.
+	inline const dtNavMesh* getNavMesh() const { return m_nav; }
+
+	/// Returns the number of goals.
+	inline int getGoalCount() const { return m_goalCount; }
+
+	/// Returns the reference id of the specified goal.
+	inline dtPolyRef getGoalRef(const int i) const { return m_goalRefs[i]; }
+
+	/// Returns the position of the specified goal. [(x, y, z)]
+	inline const float* getGoalPos(const int i) const { return &m_goalPos[i*3]; }
+
+	/// Returns the number of cells in the field.
+	inline int getCellCount() const { return m_cellCount; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtFlowField(const dtFlowField&);
+	dtFlowField& operator=(const dtFlowField&);
+
+	const dtNavMesh* m_nav;				///< The navigation mesh the field was built for.
+	int m_maxTiles;						///< Size of the per tile tables.
+	int* m_tileOffsets;					///< Index of the first cell of each tile, or -1 if the tile was empty.
+	unsigned int* m_tileSalts;			///< Salt of each tile at build time.
+	int* m_tilePolyCounts;				///< Number of polygons of each tile at build time.
+	dtFlowFieldCell* m_cells;			///< Contiguous cells of all tiles.
+	int m_cellCount;					///< Number of cells in use.
+	int m_maxCells;						///< Number of cells allocated.
+	dtPolyRef* m_goalRefs;				///< Goal polygons.
+	float* m_goalPos;					///< Goal positions.
+	int m_goalCount;					///< Number of goals.
+	int m_maxGoals;						///< Number of goals allocated.
+};
+
+/// Allocates a flow field object using the Detour allocator.
+/// @return An allocated flow field object, or null on failure.
+/// @ingroup detour
+dtFlowField* dtAllocFlowField();
+
+/// Frees the specified flow field object using the Detour allocator.
+///  @param[in]		field		A flow field object allocated using #dtAllocFlowField
+/// @ingroup detour
+void dtFreeFlowField(dtFlowField* field);
+
+#endif // DETOURFLOWFIELD_H
@@ -77,6 +77,14 @@ enum dtTileFlags
 {
 	/// The navigation mesh owns the tile memory and is responsible for freeing it.
 	DT_TILE_FREE_DATA = 0x01,
+
+	/// The navigation mesh keeps a cache of the neighbour portals of each polygon in the tile.
+	/// (See: #dtPolyPortal)
+	DT_TILE_PORTAL_CACHE = 0x02,
+
+	/// The links of each polygon in the tile are kept contiguous in the link array.
+	/// (The link lists are compacted each time neighbour tiles are connected or disconnected.)
+	DT_TILE_COMPACT_LINKS = 0x04,
 };
 
 /// Vertex flags returned by dtNavMeshQuery::findStraightPath.
@@ -163,6 +171,15 @@ struct dtLink
 	unsigned char bmax;				///< If a boundary link, defines the maximum sub-edge area.
 };
 
+/// Defines a cached portal between a polygon and one of its neighbours.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile, #DT_TILE_PORTAL_CACHE
+struct dtPolyPortal
+{
+	dtPolyRef ref;					///< Neighbour reference. (Same as the link the portal was built from.)
+	float mid[3];					///< The midpoint of the portal to the neighbour. [(x, y, z)]
+};
+
 /// Bounding volume node.
 /// @note This structure is rarely if ever used by the end user.
 /// @see dtMeshTile
@@ -254,6 +271,14 @@ struct dtMeshTile
 	dtBVNode* bvTree;
 
 	dtOffMeshConnection* offMeshCons;		///< The tile off-mesh connections. [Size: dtMeshHeader::offMeshConCount]
+	
+	/// The cached neighbour portals of the polygons, in link order. [Size: dtMeshHeader::maxLinkCount]
+	/// (Will be null unless the tile was added with #DT_TILE_PORTAL_CACHE.)
+	dtPolyPortal* portals;
+	
+	/// Index of the first cached portal of each polygon. [Size: dtMeshHeader::polyCount + 1]
+	/// The portals of polygon i are in the range [portalFirst[i], portalFirst[i+1]).
+	unsigned int* portalFirst;
 		
 	unsigned char* data;					///< The tile data. (Not directly accessed under normal situations.)
 	int dataSize;							///< Size of the tile data.
@@ -552,6 +577,12 @@ private:
 	/// Removes external links at specified side.
 	void unconnectExtLinks(dtMeshTile* tile, dtMeshTile* target);
 	
+	/// Reorders the links of a tile so that the links of each polygon are contiguous.
+	void compactLinks(dtMeshTile* tile);
+
+	/// Rebuilds the portal cache of a tile from its links.
+	void updatePortalCache(dtMeshTile* tile);
+	
 
 	// TODO: These methods are duplicates from dtNavMeshQuery, but are needed for off-mesh connection finding.
 	
@@ -30,6 +30,24 @@
 
 //#define DT_VIRTUAL_QUERYFILTER 1
 
+/// Options for dtNavMeshQuery::initSlicedFindPath.
+/// @ingroup detour
+enum dtFindPathOptions
+{
+	DT_FINDPATH_ANY_ANGLE = 0x01,		///< Use raycasts during pathfinding to "shortcut" (raycast still consider costs). (Sliced queries only.)
+};
+
+/// Options for dtNavMeshQuery::raycast.
+/// @ingroup detour
+enum dtRaycastOptions
+{
+	DT_RAYCAST_USE_COSTS = 0x01,		///< Raycast should calculate movement cost along the ray and fill dtRaycastHit::pathCost.
+};
+
+/// Limit raycasting during any-angle pathfinding.
+/// The limit is given as a multiple of the character radius.
+static const float DT_RAY_CAST_LIMIT_PROPORTIONS = 50.0f;
+
 /// Defines polygon filtering and traversal costs for navigation mesh query operations.
 /// @ingroup detour
 class dtQueryFilter
@@ -115,6 +133,30 @@ public:
 
 };
 
+/// Provides information about raycast hit.
+/// Filled by dtNavMeshQuery::raycast
+/// @ingroup detour
+struct dtRaycastHit
+{
+	/// The hit parameter. (FLT_MAX if no wall hit.)
+	float t; 
+	
+	/// The normal of the nearest wall hit. [(x, y, z)]
+	float hitNormal[3];
+	
+	/// Pointer to an array of reference ids of the visited polygons. [opt]
+	dtPolyRef* path;
+	
+	/// The number of visited polygons. [opt]
+	int pathCount;
+
+	/// The maximum number of polygons the @p path array can hold.
+	int maxPath;
+
+	/// The cost of the path until hit.
+	float pathCost;
+};
+
 /// Provides the ability to perform pathfinding related queries against
 /// a navigation mesh.
 /// @ingroup detour
@@ -179,10 +221,11 @@ public:
 	///  @param[in]		startPos	A position within the start polygon. [(x, y, z)]
 	///  @param[in]		endPos		A position within the end polygon. [(x, y, z)]
 	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[in]		options		Query options. (see: #dtFindPathOptions)
 	/// @returns The status flags for the query.
 	dtStatus initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef,
 								const float* startPos, const float* endPos,
-								const dtQueryFilter* filter);
+								const dtQueryFilter* filter, const unsigned int options = 0);
 
 	/// Updates an in-progress sliced path query.
 	///  @param[in]		maxIter		The maximum number of iterations to perform.
@@ -249,6 +292,17 @@ public:
 								  dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
 								  int* resultCount, const int maxResult) const;
 	
+	/// Builds a flow field containing the next polygon and the cost to the nearest goal
+	/// for every polygon which can reach one of the goals.
+	///  @param[in]		goalRefs		The reference ids of the goal polygons. [(polyRef) * @p goalCount]
+	///  @param[in]		goalPos			A position within each goal polygon. [(x, y, z) * @p goalCount]
+	///  @param[in]		goalCount		The number of goals. [Limit: > 0]
+	///  @param[in]		filter			The polygon filter to apply to the query.
+	///  @param[out]	field			The flow field to build.
+	/// @returns The status flags for the query.
+	dtStatus buildFlowField(const dtPolyRef* goalRefs, const float* goalPos, const int goalCount,
+							const dtQueryFilter* filter, class dtFlowField* field) const;
+	
 	/// @}
 	/// @name Local Query Functions
 	///@{
@@ -264,6 +318,18 @@ public:
 							 const dtQueryFilter* filter,
 							 dtPolyRef* nearestRef, float* nearestPt) const;
 	
+	/// Finds the polygons nearest to a batch of points.
+	///  @param[in]		centers		The centers of the search boxes. [(x, y, z) * @p count]
+	///  @param[in]		extents		The search distance along each axis, shared by all points. [(x, y, z)]
+	///  @param[in]		count		The number of points.
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	nearestRefs	The reference ids of the nearest polygons. [(polyRef) * @p count]
+	///  @param[out]	nearestPts	The nearest points on the polygons. [opt] [(x, y, z) * @p count]
+	/// @returns The status flags for the query.
+	dtStatus findNearestPolys(const float* centers, const float* extents, const int count,
+							  const dtQueryFilter* filter,
+							  dtPolyRef* nearestRefs, float* nearestPts) const;
+	
 	/// Finds polygons that overlap the search box.
 	///  @param[in]		center		The center of the search box. [(x, y, z)]
 	///  @param[in]		extents		The search distance along each axis. [(x, y, z)]
@@ -323,6 +389,21 @@ public:
 					 const dtQueryFilter* filter,
 					 float* t, float* hitNormal, dtPolyRef* path, int* pathCount, const int maxPath) const;
 	
+	/// Casts a 'walkability' ray along the surface of the navigation mesh from 
+	/// the start position toward the end position.
+	///  @param[in]		startRef	The reference id of the start polygon.
+	///  @param[in]		startPos	A position within the start polygon representing 
+	///  							the start of the ray. [(x, y, z)]
+	///  @param[in]		endPos		The position to cast the ray toward. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[in]		options		Govern how the raycast behaves. See dtRaycastOptions
+	///  @param[out]	hit			Pointer to a raycast hit structure which will be filled by the results.
+	///  @param[in]		prevRef		parent of start ref. Used during for cost calculation [opt]
+	/// @returns The status flags for the query.
+	dtStatus raycast(dtPolyRef startRef, const float* startPos, const float* endPos,
+					 const dtQueryFilter* filter, const unsigned int options,
+					 dtRaycastHit* hit, dtPolyRef prevRef = 0) const;
+	
 	/// Finds the distance from the specified position to the nearest polygon wall.
 	///  @param[in]		startRef		The reference id of the polygon containing @p centerPos.
 	///  @param[in]		centerPos		The center of the search circle. [(x, y, z)]
@@ -467,6 +548,8 @@ private:
 		dtPolyRef startRef, endRef;
 		float startPos[3], endPos[3];
 		const dtQueryFilter* filter;
+		unsigned int options;
+		float raycastLimitSqr;
 	};
 	dtQueryData m_query;				///< Sliced query state.
 
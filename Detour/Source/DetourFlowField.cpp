@@ -0,0 +1,291 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <float.h>
+#include <string.h>
+#include "DetourFlowField.h"
+#include "DetourCommon.h"
+#include "DetourAlloc.h"
+#include "DetourAssert.h"
+#include <new>
+
+dtFlowField* dtAllocFlowField()
+{
+	void* mem = dtAlloc(sizeof(dtFlowField), DT_ALLOC_PERM);
+	if (!mem) return 0;
+	return new(mem) dtFlowField;
+}
+
+void dtFreeFlowField(dtFlowField* field)
+{
+	if (!field) return;
+	field->~dtFlowField();
+	dtFree(field);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
+/// @class dtFlowField
+///
+/// The field stores one #dtFlowFieldCell per polygon. The cells of each tile are
+/// stored contiguously, so looking up a polygon is a table lookup using the
+/// tile and polygon index encoded in the polygon reference.
+///
+/// The field is a snapshot of the navigation mesh at build time. Polygons of
+/// tiles which were added or removed after the build are reported as
+/// unreachable, and the field should be rebuilt when the mesh changes.
+///
+/// @see dtNavMeshQuery::buildFlowField
+
+dtFlowField::dtFlowField() :
+	m_nav(0),
+	m_maxTiles(0),
+	m_tileOffsets(0),
+	m_tileSalts(0),
+	m_tilePolyCounts(0),
+	m_cells(0),
+	m_cellCount(0),
+	m_maxCells(0),
+	m_goalRefs(0),
+	m_goalPos(0),
+	m_goalCount(0),
+	m_maxGoals(0)
+{
+}
+
+dtFlowField::~dtFlowField()
+{
+	dtFree(m_tileOffsets);
+	dtFree(m_tileSalts);
+	dtFree(m_tilePolyCounts);
+	dtFree(m_cells);
+	dtFree(m_goalRefs);
+	dtFree(m_goalPos);
+}
+
+dtStatus dtFlowField::reset(const dtNavMesh* nav, const dtPolyRef* goalRefs, const float* goalPos, const int goalCount)
+{
+	dtAssert(nav);
+
+	m_nav = nav;
+	m_cellCount = 0;
+	m_goalCount = 0;
+
+	// Per tile tables.
+	if (nav->getMaxTiles() > m_maxTiles)
+	{
+		dtFree(m_tileOffsets);
+		dtFree(m_tileSalts);
+		dtFree(m_tilePolyCounts);
+		m_maxTiles = 0;
+
+		const int maxTiles = nav->getMaxTiles();
+		m_tileOffsets = (int*)dtAlloc(sizeof(int)*maxTiles, DT_ALLOC_PERM);
+		m_tileSalts = (unsigned int*)dtAlloc(sizeof(unsigned int)*maxTiles, DT_ALLOC_PERM);
+		m_tilePolyCounts = (int*)dtAlloc(sizeof(int)*maxTiles, DT_ALLOC_PERM);
+		if (!m_tileOffsets || !m_tileSalts || !m_tilePolyCounts)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		m_maxTiles = maxTiles;
+	}
+
+	// Lay out the cells of each tile contiguously.
+	int cellCount = 0;
+	for (int i = 0; i < m_maxTiles; ++i)
+	{
+		const dtMeshTile* tile = i < nav->getMaxTiles() ? nav->getTile(i) : 0;
+		if (!tile || !tile->header)
+		{
+			m_tileOffsets[i] = -1;
+			m_tileSalts[i] = 0;
+			m_tilePolyCounts[i] = 0;
+			continue;
+		}
+		m_tileOffsets[i] = cellCount;
+		m_tileSalts[i] = tile->salt;
+		m_tilePolyCounts[i] = tile->header->polyCount;
+		cellCount += tile->header->polyCount;
+	}
+
+	if (cellCount > m_maxCells)
+	{
+		dtFree(m_cells);
+		m_maxCells = 0;
+		m_cells = (dtFlowFieldCell*)dtAlloc(sizeof(dtFlowFieldCell)*cellCount, DT_ALLOC_PERM);
+		if (!m_cells)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		m_maxCells = cellCount;
+	}
+	m_cellCount = cellCount;
+
+	for (int i = 0; i < m_cellCount; ++i)
+	{
+		m_cells[i].next = 0;
+		m_cells[i].cost = FLT_MAX;
+	}
+
+	// Goals.
+	if (goalCount > m_maxGoals)
+	{
+		dtFree(m_goalRefs);
+		dtFree(m_goalPos);
+		m_maxGoals = 0;
+		m_goalRefs = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*goalCount, DT_ALLOC_PERM);
+		m_goalPos = (float*)dtAlloc(sizeof(float)*3*goalCount, DT_ALLOC_PERM);
+		if (!m_goalRefs || !m_goalPos)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		m_maxGoals = goalCount;
+	}
+	if (goalCount > 0)
+	{
+		memcpy(m_goalRefs, goalRefs, sizeof(dtPolyRef)*goalCount);
+		memcpy(m_goalPos, goalPos, sizeof(float)*3*goalCount);
+	}
+	m_goalCount = goalCount;
+
+	return DT_SUCCESS;
+}
+
+dtFlowFieldCell* dtFlowField::getCell(dtPolyRef ref)
+{
+	if (!m_nav || !ref)
+		return 0;
+	unsigned int salt, it, ip;
+	m_nav->decodePolyId(ref, salt, it, ip);
+	if ((int)it >= m_maxTiles) return 0;
+	if (m_tileOffsets[it] == -1 || m_tileSalts[it] != salt) return 0;
+	if ((int)ip >= m_tilePolyCounts[it]) return 0;
+	return &m_cells[m_tileOffsets[it] + ip];
+}
+
+const dtFlowFieldCell* dtFlowField::getCell(dtPolyRef ref) const
+{
+	if (!m_nav || !ref)
+		return 0;
+	unsigned int salt, it, ip;
+	m_nav->decodePolyId(ref, salt, it, ip);
+	if ((int)it >= m_maxTiles) return 0;
+	if (m_tileOffsets[it] == -1 || m_tileSalts[it] != salt) return 0;
+	if ((int)ip >= m_tilePolyCounts[it]) return 0;
+	return &m_cells[m_tileOffsets[it] + ip];
+}
+
+bool dtFlowField::isReachable(dtPolyRef ref) const
+{
+	const dtFlowFieldCell* cell = getCell(ref);
+	return cell && cell->next != 0;
+}
+
+dtPolyRef dtFlowField::getNextPoly(dtPolyRef ref) const
+{
+	const dtFlowFieldCell* cell = getCell(ref);
+	if (!cell || cell->next == ref)
+		return 0;
+	return cell->next;
+}
+
+float dtFlowField::getCostToGoal(dtPolyRef ref) const
+{
+	const dtFlowFieldCell* cell = getCell(ref);
+	if (!cell)
+		return FLT_MAX;
+	return cell->cost;
+}
+
+/// @par
+///
+/// The number of steps is bounded by the number of cells, so the method
+/// terminates even if the field is stale.
+dtPolyRef dtFlowField::findGoal(dtPolyRef ref, float* goalPos) const
+{
+	const dtFlowFieldCell* cell = getCell(ref);
+	for (int i = 0; cell && cell->next && i < m_cellCount; ++i)
+	{
+		if (cell->next == ref)
+		{
+			// Reached goal, find its position.
+			if (goalPos)
+			{
+				for (int j = 0; j < m_goalCount; ++j)
+				{
+					if (m_goalRefs[j] == ref)
+					{
+						dtVcopy(goalPos, &m_goalPos[j*3]);
+						break;
+					}
+				}
+			}
+			return ref;
+		}
+		ref = cell->next;
+		cell = getCell(ref);
+	}
+	return 0;
+}
+
+/// @par
+///
+/// Each polygon is looked up from the table, so the cost of the query is
+/// proportional to the length of the returned path.
+///
+/// If the path does not fit into the @p path array, the path is truncated and
+/// the result has the #DT_BUFFER_TOO_SMALL flag set. The path can be
+/// continued by calling the method again using the last polygon of the path.
+dtStatus dtFlowField::getPath(dtPolyRef startRef, dtPolyRef* path, int* pathCount, const int maxPath) const
+{
+	dtAssert(path);
+	dtAssert(pathCount);
+
+	*pathCount = 0;
+
+	if (!maxPath)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	const dtFlowFieldCell* cell = getCell(startRef);
+	if (!cell || !cell->next)
+		return DT_FAILURE;
+
+	dtStatus status = DT_SUCCESS;
+	dtPolyRef ref = startRef;
+	int n = 0;
+	for (;;)
+	{
+		if (n >= maxPath)
+		{
+			status |= DT_BUFFER_TOO_SMALL;
+			break;
+		}
+		path[n++] = ref;
+
+		// Reached goal.
+		if (cell->next == ref)
+			break;
+
+		ref = cell->next;
+		cell = getCell(ref);
+		if (!cell || !cell->next || n >= m_cellCount)
+		{
+			// The navigation mesh has changed since the field was built.
+			status |= DT_PARTIAL_RESULT;
+			break;
+		}
+	}
+
+	*pathCount = n;
+
+	return status;
+}
@@ -214,6 +214,8 @@ dtNavMesh::~dtNavMesh()
 			m_tiles[i].data = 0;
 			m_tiles[i].dataSize = 0;
 		}
+		dtFree(m_tiles[i].portals);
+		dtFree(m_tiles[i].portalFirst);
 	}
 	dtFree(m_posLookup);
 	dtFree(m_tiles);
@@ -380,6 +382,115 @@ void dtNavMesh::unconnectExtLinks(dtMeshTile* tile, dtMeshTile* target)
 	}
 }
 
+void dtNavMesh::compactLinks(dtMeshTile* tile)
+{
+	if (!tile || !(tile->flags & DT_TILE_COMPACT_LINKS)) return;
+	
+	const int maxLinks = tile->header->maxLinkCount;
+	if (!maxLinks) return;
+	
+	// Compaction is an optimization, keep the current layout if there is no memory.
+	dtLink* links = (dtLink*)dtAlloc(sizeof(dtLink)*maxLinks, DT_ALLOC_TEMP);
+	if (!links) return;
+	
+	// Copy the links of each polygon in order, chaining each link to the next slot.
+	unsigned int n = 0;
+	for (int i = 0; i < tile->header->polyCount; ++i)
+	{
+		dtPoly* poly = &tile->polys[i];
+		unsigned int j = poly->firstLink;
+		if (j == DT_NULL_LINK)
+			continue;
+		poly->firstLink = n;
+		while (j != DT_NULL_LINK)
+		{
+			links[n] = tile->links[j];
+			j = tile->links[j].next;
+			links[n].next = j != DT_NULL_LINK ? n+1 : DT_NULL_LINK;
+			n++;
+		}
+	}
+	memcpy(tile->links, links, sizeof(dtLink)*n);
+	dtFree(links);
+	
+	// Rebuild the free list from the remaining links.
+	for (int i = (int)n; i < maxLinks-1; ++i)
+		tile->links[i].next = i+1;
+	if ((int)n < maxLinks)
+	{
+		tile->links[maxLinks-1].next = DT_NULL_LINK;
+		tile->linksFreeList = n;
+	}
+	else
+	{
+		tile->linksFreeList = DT_NULL_LINK;
+	}
+}
+
+void dtNavMesh::updatePortalCache(dtMeshTile* tile)
+{
+	if (!tile || !tile->portals) return;
+	
+	const dtPolyRef base = getPolyRefBase(tile);
+	unsigned int n = 0;
+	
+	for (int i = 0; i < tile->header->polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		tile->portalFirst[i] = n;
+		
+		for (unsigned int j = poly->firstLink; j != DT_NULL_LINK; j = tile->links[j].next)
+		{
+			const dtLink* link = &tile->links[j];
+			dtPolyPortal* portal = &tile->portals[n++];
+			portal->ref = link->ref;
+			
+			const dtMeshTile* neiTile = 0;
+			const dtPoly* neiPoly = 0;
+			getTileAndPolyByRefUnsafe(link->ref, &neiTile, &neiPoly);
+			
+			// Same rules as dtNavMeshQuery::getPortalPoints().
+			if (poly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+			{
+				// Off-mesh connection, the portal is the connection end point.
+				dtVcopy(portal->mid, &tile->verts[poly->verts[link->edge]*3]);
+			}
+			else if (neiPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+			{
+				// Entering off-mesh connection, the portal is the end point linked back to this polygon.
+				dtVcopy(portal->mid, &tile->verts[poly->verts[link->edge]*3]);
+				for (unsigned int k = neiPoly->firstLink; k != DT_NULL_LINK; k = neiTile->links[k].next)
+				{
+					if (neiTile->links[k].ref == (base | (dtPolyRef)i))
+					{
+						dtVcopy(portal->mid, &neiTile->verts[neiPoly->verts[neiTile->links[k].edge]*3]);
+						break;
+					}
+				}
+			}
+			else
+			{
+				// Edge portal, clamped to the link width at tile boundary.
+				const float* va = &tile->verts[poly->verts[link->edge]*3];
+				const float* vb = &tile->verts[poly->verts[(link->edge+1) % (int)poly->vertCount]*3];
+				float left[3], right[3];
+				dtVcopy(left, va);
+				dtVcopy(right, vb);
+				if (link->side != 0xff && (link->bmin != 0 || link->bmax != 255))
+				{
+					const float s = 1.0f/255.0f;
+					dtVlerp(left, va, vb, link->bmin*s);
+					dtVlerp(right, va, vb, link->bmax*s);
+				}
+				portal->mid[0] = (left[0]+right[0])*0.5f;
+				portal->mid[1] = (left[1]+right[1])*0.5f;
+				portal->mid[2] = (left[2]+right[2])*0.5f;
+			}
+		}
+	}
+	tile->portalFirst[tile->header->polyCount] = n;
+}
+
 void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
 {
 	if (!tile) return;
@@ -805,6 +916,16 @@ int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, co
 /// tile will be restored to the same values they were before the tile was 
 /// removed.
 ///
+/// If the #DT_TILE_PORTAL_CACHE flag is set, the neighbour portals of the tile's
+/// polygons are cached in a contiguous array, which is kept up to date as the
+/// neighbour tiles are added and removed. The path searches of dtNavMeshQuery
+/// read the cache instead of walking the links. The cache costs 16 bytes per link.
+///
+/// If the #DT_TILE_COMPACT_LINKS flag is set, the links of each polygon are stored
+/// next to each other in the link array, in the same order as before. Repeatedly
+/// connecting and disconnecting neighbour tiles otherwise scatters the link lists
+/// across the array, which makes every neighbour iteration a cache miss.
+///
 /// @see dtCreateNavMeshData, #removeTile
 dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 							dtTileRef lastRef, dtTileRef* result)
@@ -904,6 +1025,22 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	tile->data = data;
 	tile->dataSize = dataSize;
 	tile->flags = flags;
+	
+	// Allocate portal cache. The cache is optional, if the allocation fails
+	// the tile is used without it.
+	if (flags & DT_TILE_PORTAL_CACHE)
+	{
+		tile->portals = (dtPolyPortal*)dtAlloc(sizeof(dtPolyPortal)*header->maxLinkCount, DT_ALLOC_PERM);
+		tile->portalFirst = (unsigned int*)dtAlloc(sizeof(unsigned int)*(header->polyCount+1), DT_ALLOC_PERM);
+		if (!tile->portals || !tile->portalFirst)
+		{
+			dtFree(tile->portals);
+			dtFree(tile->portalFirst);
+			tile->portals = 0;
+			tile->portalFirst = 0;
+			tile->flags &= ~DT_TILE_PORTAL_CACHE;
+		}
+	}
 
 	connectIntLinks(tile);
 	baseOffMeshLinks(tile);
@@ -924,6 +1061,11 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 		}
 		connectExtOffMeshLinks(tile, neis[j], -1);
 		connectExtOffMeshLinks(neis[j], tile, -1);
+		if (neis[j] != tile)
+		{
+			compactLinks(neis[j]);
+			updatePortalCache(neis[j]);
+		}
 	}
 	
 	// Connect with neighbour tiles.
@@ -936,9 +1078,14 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 			connectExtLinks(neis[j], tile, dtOppositeTile(i));
 			connectExtOffMeshLinks(tile, neis[j], i);
 			connectExtOffMeshLinks(neis[j], tile, dtOppositeTile(i));
+			compactLinks(neis[j]);
+			updatePortalCache(neis[j]);
 		}
 	}
 	
+	compactLinks(tile);
+	updatePortalCache(tile);
+	
 	if (result)
 		*result = getTileRef(tile);
 	
@@ -1170,6 +1317,8 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	{
 		if (neis[j] == tile) continue;
 		unconnectExtLinks(neis[j], tile);
+		compactLinks(neis[j]);
+		updatePortalCache(neis[j]);
 	}
 	
 	// Connect with neighbour tiles.
@@ -1177,7 +1326,11 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	{
 		nneis = getNeighbourTilesAt(tile->header->x, tile->header->y, i, neis, MAX_NEIS);
 		for (int j = 0; j < nneis; ++j)
+		{
 			unconnectExtLinks(neis[j], tile);
+			compactLinks(neis[j]);
+			updatePortalCache(neis[j]);
+		}
 	}
 		
 	// Reset tile.
@@ -1207,6 +1360,10 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	tile->detailTris = 0;
 	tile->bvTree = 0;
 	tile->offMeshCons = 0;
+	dtFree(tile->portals);
+	dtFree(tile->portalFirst);
+	tile->portals = 0;
+	tile->portalFirst = 0;
 
 	// Update salt, salt should never be zero.
 	tile->salt = (tile->salt+1) & ((1<<m_saltBits)-1);
@@ -19,8 +19,10 @@
 #include <math.h>
 #include <float.h>
 #include <string.h>
+#include <limits.h>
 #include "DetourNavMeshQuery.h"
 #include "DetourNavMesh.h"
+#include "DetourFlowField.h"
 #include "DetourNode.h"
 #include "DetourCommon.h"
 #include "DetourAlloc.h"
@@ -102,6 +104,53 @@ inline float dtQueryFilter::getCost(const float* pa, const float* pb,
 	
 static const float H_SCALE = 0.999f; // Search heuristic scale.
 
+// Iterates the neighbours of a polygon. Streams through the portal cache of
+// the tile when it has one, otherwise follows the link list.
+class dtNeighbourIterator
+{
+	const dtMeshTile* m_tile;
+	const dtPolyPortal* m_portal;
+	const dtPolyPortal* m_portalEnd;
+	unsigned int m_link;
+	
+public:
+	inline dtNeighbourIterator(const dtMeshTile* tile, const dtPoly* poly) : m_tile(tile), m_portal(0), m_portalEnd(0)
+	{
+		if (tile->portals)
+		{
+			const unsigned int ip = (unsigned int)(poly - tile->polys);
+			m_portal = &tile->portals[tile->portalFirst[ip]];
+			m_portalEnd = &tile->portals[tile->portalFirst[ip+1]];
+			m_link = DT_NULL_LINK;
+		}
+		else
+		{
+			m_link = poly->firstLink;
+		}
+	}
+	
+	/// Returns false when there are no more neighbours. Portal midpoint is
+	/// set to null if the tile does not have portal cache.
+	inline bool next(dtPolyRef& ref, const float*& mid)
+	{
+		if (m_portal != m_portalEnd)
+		{
+			ref = m_portal->ref;
+			mid = m_portal->mid;
+			m_portal++;
+			return true;
+		}
+		if (m_link != DT_NULL_LINK)
+		{
+			ref = m_tile->links[m_link].ref;
+			mid = 0;
+			m_link = m_tile->links[m_link].next;
+			return true;
+		}
+		return false;
+	}
+};
+
 
 dtNavMeshQuery* dtAllocNavMeshQuery()
 {
@@ -764,6 +813,327 @@ dtStatus dtNavMeshQuery::findNearestPoly(const float* center, const float* exten
 	return DT_SUCCESS;
 }
 
+struct dtNearestPolyItem
+{
+	int tx, ty;				// Tile location of the query box, or INT_MAX if the box spans several tiles.
+	unsigned int code;		// Morton code of the point within the tile.
+	int idx;				// Index of the point.
+};
+
+// Returns the key byte of the specified radix sort pass; the tile location sorts before the Morton code.
+inline unsigned int getNearestPolyItemDigit(const dtNearestPolyItem& item, const int pass)
+{
+	if (pass < 4)
+		return (item.code >> (pass*8)) & 0xff;
+	const unsigned int loc = ((unsigned int)(item.ty & 0xffff) << 16) | (unsigned int)(item.tx & 0xffff);
+	return (loc >> ((pass-4)*8)) & 0xff;
+}
+
+// Stable radix sort of the items by tile location and Morton code.
+// Returns the sorted array, which is either items or tmp.
+static dtNearestPolyItem* sortNearestPolyItems(dtNearestPolyItem* items, dtNearestPolyItem* tmp, const int count)
+{
+	dtNearestPolyItem* src = items;
+	dtNearestPolyItem* dst = tmp;
+	int offsets[256];
+	for (int pass = 0; pass < 8; ++pass)
+	{
+		memset(offsets, 0, sizeof(offsets));
+		for (int i = 0; i < count; ++i)
+			offsets[getNearestPolyItemDigit(src[i], pass)]++;
+		
+		// Skip the pass if all the items share the digit.
+		if (offsets[getNearestPolyItemDigit(src[0], pass)] == count)
+			continue;
+		
+		int sum = 0;
+		for (int i = 0; i < 256; ++i)
+		{
+			const int n = offsets[i];
+			offsets[i] = sum;
+			sum += n;
+		}
+		for (int i = 0; i < count; ++i)
+			dst[offsets[getNearestPolyItemDigit(src[i], pass)]++] = src[i];
+		dtSwap(src, dst);
+	}
+	return src;
+}
+
+inline unsigned int dtSpreadBits(unsigned int v)
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+/// @par
+///
+/// The result for each point is the same as calling #findNearestPoly for it.
+///
+/// The points are sorted by tile and by Morton order within the tile, and the
+/// bounding volume tree of each tile is traversed once for a group of nearby
+/// points instead of once per point. A group is limited to points whose centers
+/// are within a few search extents of each other, so sparse points are handled
+/// much like individual queries. Points whose search box overlaps more than one
+/// tile are queried individually.
+///
+/// @warning The same 128 polygon limit as #findNearestPoly applies to each point.
+///
+dtStatus dtNavMeshQuery::findNearestPolys(const float* centers, const float* extents, const int count,
+										  const dtQueryFilter* filter,
+										  dtPolyRef* nearestRefs, float* nearestPts) const
+{
+	dtAssert(m_nav);
+	
+	if (!centers || !extents || !filter || !nearestRefs || count < 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (!count)
+		return DT_SUCCESS;
+	
+	dtNearestPolyItem* buf = (dtNearestPolyItem*)dtAlloc(sizeof(dtNearestPolyItem)*count*2, DT_ALLOC_TEMP);
+	if (!buf)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	dtNearestPolyItem* items = buf;
+	
+	// Height range of the points, used to quantize the height for the Morton code.
+	float ymin = centers[1], ymax = centers[1];
+	for (int i = 1; i < count; ++i)
+	{
+		ymin = dtMin(ymin, centers[i*3+1]);
+		ymax = dtMax(ymax, centers[i*3+1]);
+	}
+	
+	const dtNavMeshParams* params = m_nav->getParams();
+	const float qx = 1023.0f / params->tileWidth;
+	const float qy = ymax > ymin ? 1023.0f / (ymax - ymin) : 0.0f;
+	const float qz = 1023.0f / params->tileHeight;
+	
+	for (int i = 0; i < count; ++i)
+	{
+		const float* center = &centers[i*3];
+		float bmin[3], bmax[3];
+		dtVsub(bmin, center, extents);
+		dtVadd(bmax, center, extents);
+		int minx, miny, maxx, maxy;
+		m_nav->calcTileLoc(bmin, &minx, &miny);
+		m_nav->calcTileLoc(bmax, &maxx, &maxy);
+		
+		dtNearestPolyItem& item = items[i];
+		item.idx = i;
+		if (minx != maxx || miny != maxy)
+		{
+			item.tx = item.ty = INT_MAX;
+			item.code = 0;
+			continue;
+		}
+		item.tx = minx;
+		item.ty = miny;
+		const float lx = center[0] - (params->orig[0] + minx*params->tileWidth);
+		const float lz = center[2] - (params->orig[2] + miny*params->tileHeight);
+		const unsigned int ux = (unsigned int)dtClamp((int)(lx*qx), 0, 1023);
+		const unsigned int uy = (unsigned int)dtClamp((int)((center[1] - ymin)*qy), 0, 1023);
+		const unsigned int uz = (unsigned int)dtClamp((int)(lz*qz), 0, 1023);
+		item.code = dtSpreadBits(ux) | (dtSpreadBits(uy) << 1) | (dtSpreadBits(uz) << 2);
+	}
+	
+	items = sortNearestPolyItems(items, buf + count, count);
+	
+	static const int MAX_GROUP = 32;
+	static const float MAX_GROUP_SPREAD = 4.0f; // Max spread of the group centers, in search extents.
+	static const int MAX_POLYS = 128;
+	static const int MAX_NEIS = 32;
+	const dtMeshTile* neis[MAX_NEIS];
+	float dist[MAX_GROUP];
+	int npolys[MAX_GROUP];
+	unsigned short qbmin[MAX_GROUP][3], qbmax[MAX_GROUP][3];
+	
+	int i = 0;
+	while (i < count)
+	{
+		// Boxes overlapping several tiles are queried one at a time.
+		if (items[i].tx == INT_MAX)
+		{
+			const int idx = items[i].idx;
+			findNearestPoly(&centers[idx*3], extents, filter, &nearestRefs[idx], nearestPts ? &nearestPts[idx*3] : 0);
+			i++;
+			continue;
+		}
+		
+		// Collect a group of nearby points in the same tile.
+		const dtNearestPolyItem* group = &items[i];
+		float gmin[3], gmax[3];
+		dtVcopy(gmin, &centers[group[0].idx*3]);
+		dtVcopy(gmax, &centers[group[0].idx*3]);
+		int ngroup = 1;
+		while (ngroup < MAX_GROUP && i+ngroup < count &&
+			   group[ngroup].tx == group[0].tx && group[ngroup].ty == group[0].ty)
+		{
+			const float* center = &centers[group[ngroup].idx*3];
+			bool compact = true;
+			for (int c = 0; c < 3; ++c)
+			{
+				const float mn = dtMin(gmin[c], center[c]);
+				const float mx = dtMax(gmax[c], center[c]);
+				if (mx - mn > extents[c]*MAX_GROUP_SPREAD)
+					compact = false;
+			}
+			if (!compact)
+				break;
+			dtVmin(gmin, center);
+			dtVmax(gmax, center);
+			ngroup++;
+		}
+		i += ngroup;
+		
+		for (int j = 0; j < ngroup; ++j)
+		{
+			nearestRefs[group[j].idx] = 0;
+			dist[j] = FLT_MAX;
+			npolys[j] = 0;
+		}
+		
+		const int nneis = m_nav->getTilesAt(group[0].tx, group[0].ty, neis, MAX_NEIS);
+		for (int k = 0; k < nneis; ++k)
+		{
+			const dtMeshTile* tile = neis[k];
+			const dtPolyRef base = m_nav->getPolyRefBase(tile);
+			
+			if (tile->bvTree)
+			{
+				const float* tbmin = tile->header->bmin;
+				const float* tbmax = tile->header->bmax;
+				const float qfac = tile->header->bvQuantFactor;
+				const float iqfac = 1.0f / qfac;
+				
+				// Quantize the query boxes the same way as queryPolygonsInTile(), and find the group bounds.
+				unsigned short ubmin[3] = { 0xffff, 0xffff, 0xffff };
+				unsigned short ubmax[3] = { 0, 0, 0 };
+				for (int j = 0; j < ngroup; ++j)
+				{
+					const float* center = &centers[group[j].idx*3];
+					for (int c = 0; c < 3; ++c)
+					{
+						const float mn = dtClamp(center[c] - extents[c], tbmin[c], tbmax[c]) - tbmin[c];
+						const float mx = dtClamp(center[c] + extents[c], tbmin[c], tbmax[c]) - tbmin[c];
+						qbmin[j][c] = (unsigned short)(qfac * mn) & 0xfffe;
+						qbmax[j][c] = (unsigned short)(qfac * mx + 1) | 1;
+						ubmin[c] = dtMin(ubmin[c], qbmin[j][c]);
+						ubmax[c] = dtMax(ubmax[c], qbmax[j][c]);
+					}
+				}
+				
+				// Traverse tree once for the whole group.
+				const dtBVNode* node = &tile->bvTree[0];
+				const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
+				while (node < end)
+				{
+					const bool overlap = dtOverlapQuantBounds(ubmin, ubmax, node->bmin, node->bmax);
+					const bool isLeafNode = node->i >= 0;
+					
+					if (isLeafNode && overlap)
+					{
+						const dtPolyRef ref = base | (dtPolyRef)node->i;
+						const dtPoly* poly = &tile->polys[node->i];
+						if (filter->passFilter(ref, tile, poly))
+						{
+							// The nearest point is inside the polygon on xz-plane, so the distance to
+							// the node bounds (padded by one quantization step) is a lower bound.
+							const float nminx = tbmin[0] + (float)(node->bmin[0]-1) * iqfac;
+							const float nmaxx = tbmin[0] + (float)(node->bmax[0]+1) * iqfac;
+							const float nminz = tbmin[2] + (float)(node->bmin[2]-1) * iqfac;
+							const float nmaxz = tbmin[2] + (float)(node->bmax[2]+1) * iqfac;
+							for (int j = 0; j < ngroup; ++j)
+							{
+								if (npolys[j] >= MAX_POLYS || !dtOverlapQuantBounds(qbmin[j], qbmax[j], node->bmin, node->bmax))
+									continue;
+								npolys[j]++;
+								const int idx = group[j].idx;
+								const float* center = &centers[idx*3];
+								const float dx = dtMax(dtMax(nminx - center[0], center[0] - nmaxx), 0.0f);
+								const float dz = dtMax(dtMax(nminz - center[2], center[2] - nmaxz), 0.0f);
+								if (dx*dx + dz*dz >= dist[j])
+									continue;
+								float closestPtPoly[3];
+								closestPointOnPolyInTile(tile, poly, &centers[idx*3], closestPtPoly);
+								const float d = dtVdistSqr(&centers[idx*3], closestPtPoly);
+								if (d < dist[j])
+								{
+									if (nearestPts)
+										dtVcopy(&nearestPts[idx*3], closestPtPoly);
+									dist[j] = d;
+									nearestRefs[idx] = ref;
+								}
+							}
+						}
+					}
+					
+					if (overlap || isLeafNode)
+						node++;
+					else
+					{
+						const int escapeIndex = -node->i;
+						node += escapeIndex;
+					}
+				}
+			}
+			else
+			{
+				for (int ip = 0; ip < tile->header->polyCount; ++ip)
+				{
+					const dtPoly* p = &tile->polys[ip];
+					// Do not return off-mesh connection polygons.
+					if (p->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+						continue;
+					// Must pass filter
+					const dtPolyRef ref = base | (dtPolyRef)ip;
+					if (!filter->passFilter(ref, tile, p))
+						continue;
+					// Calc polygon bounds.
+					float bmin[3], bmax[3];
+					const float* v = &tile->verts[p->verts[0]*3];
+					dtVcopy(bmin, v);
+					dtVcopy(bmax, v);
+					for (int j = 1; j < p->vertCount; ++j)
+					{
+						v = &tile->verts[p->verts[j]*3];
+						dtVmin(bmin, v);
+						dtVmax(bmax, v);
+					}
+					for (int j = 0; j < ngroup; ++j)
+					{
+						const int idx = group[j].idx;
+						const float* center = &centers[idx*3];
+						float qmin[3], qmax[3];
+						dtVsub(qmin, center, extents);
+						dtVadd(qmax, center, extents);
+						if (npolys[j] >= MAX_POLYS || !dtOverlapBounds(qmin, qmax, bmin, bmax))
+							continue;
+						npolys[j]++;
+						float closestPtPoly[3];
+						closestPointOnPolyInTile(tile, p, center, closestPtPoly);
+						const float d = dtVdistSqr(center, closestPtPoly);
+						if (d < dist[j])
+						{
+							if (nearestPts)
+								dtVcopy(&nearestPts[idx*3], closestPtPoly);
+							dist[j] = d;
+							nearestRefs[idx] = ref;
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	dtFree(buf);
+	
+	return DT_SUCCESS;
+}
+
 dtPolyRef dtNavMeshQuery::findNearestPolyInTile(const dtMeshTile* tile, const float* center, const float* extents,
 												const dtQueryFilter* filter, float* nearestPt) const
 {
@@ -1030,10 +1400,11 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 		if (parentRef)
 			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
 		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		dtNeighbourIterator it(bestTile, bestPoly);
+		dtPolyRef neighbourRef;
+		const float* portalMid;
+		while (it.next(neighbourRef, portalMid))
 		{
-			dtPolyRef neighbourRef = bestTile->links[i].ref;
-			
 			// Skip invalid ids and do not expand back to where we came from.
 			if (!neighbourRef || neighbourRef == parentRef)
 				continue;
@@ -1057,9 +1428,12 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 			// If the node is visited the first time, calculate node position.
 			if (neighbourNode->flags == 0)
 			{
-				getEdgeMidPoint(bestRef, bestPoly, bestTile,
-								neighbourRef, neighbourPoly, neighbourTile,
-								neighbourNode->pos);
+				if (portalMid)
+					dtVcopy(neighbourNode->pos, portalMid);
+				else
+					getEdgeMidPoint(bestRef, bestPoly, bestTile,
+									neighbourRef, neighbourPoly, neighbourTile,
+									neighbourNode->pos);
 			}
 
 			// Calculate cost and heuristic.
@@ -1173,9 +1547,17 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 /// The @p filter pointer is stored and used for the duration of the sliced
 /// path query.
 ///
+/// When #DT_FINDPATH_ANY_ANGLE is specified, each expanded neighbour is tested
+/// for line of sight from the parent of the current node. If the raycast reaches
+/// the neighbour, the neighbour is connected directly to that parent and the
+/// cost is measured along the ray. The resulting corridor follows the taut path
+/// more closely and needs less post-processing with
+/// #dtPathCorridor::optimizePathVisibility. The option is only available on the
+/// sliced query, #findPath always returns a path of adjacent polygons.
+///
 dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef,
 											const float* startPos, const float* endPos,
-											const dtQueryFilter* filter)
+											const dtQueryFilter* filter, const unsigned int options)
 {
 	dtAssert(m_nav);
 	dtAssert(m_nodePool);
@@ -1189,6 +1571,8 @@ dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef
 	dtVcopy(m_query.startPos, startPos);
 	dtVcopy(m_query.endPos, endPos);
 	m_query.filter = filter;
+	m_query.options = options;
+	m_query.raycastLimitSqr = FLT_MAX;
 	
 	if (!startRef || !endRef)
 		return DT_FAILURE | DT_INVALID_PARAM;
@@ -1197,6 +1581,18 @@ dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef
 	if (!m_nav->isValidPolyRef(startRef) || !m_nav->isValidPolyRef(endRef))
 		return DT_FAILURE | DT_INVALID_PARAM;
 
+	// Limit the length of the line of sight checks for any-angle search.
+	if (options & DT_FINDPATH_ANY_ANGLE)
+	{
+		// Limiting to several times the character radius yields nice results. It is not sensitive
+		// so it is enough to compute it from the first tile.
+		const dtMeshTile* tile = 0;
+		const dtPoly* poly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(startRef, &tile, &poly);
+		const float agentRadius = tile->header->walkableRadius;
+		m_query.raycastLimitSqr = dtSqr(agentRadius * DT_RAY_CAST_LIMIT_PROPORTIONS);
+	}
+
 	if (startRef == endRef)
 	{
 		m_query.status = DT_SUCCESS;
@@ -1269,15 +1665,22 @@ dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 			return m_query.status;
 		}
 		
-		// Get parent poly and tile.
-		dtPolyRef parentRef = 0;
+		// Get parent and grand parent poly and tile.
+		dtPolyRef parentRef = 0, grandpaRef = 0;
 		const dtMeshTile* parentTile = 0;
 		const dtPoly* parentPoly = 0;
+		dtNode* parentNode = 0;
 		if (bestNode->pidx)
-			parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
+		{
+			parentNode = m_nodePool->getNodeAtIdx(bestNode->pidx);
+			parentRef = parentNode->id;
+			if (parentNode->pidx)
+				grandpaRef = m_nodePool->getNodeAtIdx(parentNode->pidx)->id;
+		}
 		if (parentRef)
 		{
-			if (dtStatusFailed(m_nav->getTileAndPolyByRef(parentRef, &parentTile, &parentPoly)))
+			const bool invalidParent = dtStatusFailed(m_nav->getTileAndPolyByRef(parentRef, &parentTile, &parentPoly));
+			if (invalidParent || (grandpaRef && !m_nav->isValidPolyRef(grandpaRef)) )
 			{
 				// The polygon has disappeared during the sliced query, fail.
 				m_query.status = DT_FAILURE;
@@ -1286,11 +1689,20 @@ dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 				return m_query.status;
 			}
 		}
+
+		// Decide whether to test raycast to previous nodes.
+		bool tryLOS = false;
+		if (m_query.options & DT_FINDPATH_ANY_ANGLE)
+		{
+			if (parentRef != 0 && dtVdistSqr(parentNode->pos, bestNode->pos) < m_query.raycastLimitSqr)
+				tryLOS = true;
+		}
 		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		dtNeighbourIterator it(bestTile, bestPoly);
+		dtPolyRef neighbourRef;
+		const float* portalMid;
+		while (it.next(neighbourRef, portalMid))
 		{
-			dtPolyRef neighbourRef = bestTile->links[i].ref;
-			
 			// Skip invalid ids and do not expand back to where we came from.
 			if (!neighbourRef || neighbourRef == parentRef)
 				continue;
@@ -1314,39 +1726,59 @@ dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 			// If the node is visited the first time, calculate node position.
 			if (neighbourNode->flags == 0)
 			{
-				getEdgeMidPoint(bestRef, bestPoly, bestTile,
-								neighbourRef, neighbourPoly, neighbourTile,
-								neighbourNode->pos);
+				if (portalMid)
+					dtVcopy(neighbourNode->pos, portalMid);
+				else
+					getEdgeMidPoint(bestRef, bestPoly, bestTile,
+									neighbourRef, neighbourPoly, neighbourTile,
+									neighbourNode->pos);
 			}
 			
 			// Calculate cost and heuristic.
 			float cost = 0;
 			float heuristic = 0;
 			
-			// Special case for last node.
-			if (neighbourRef == m_query.endRef)
+			// Raycast from the parent, if it reaches the neighbour the search can
+			// skip the current node and connect the neighbour directly to the parent.
+			bool foundShortCut = false;
+			dtRaycastHit rayHit;
+			rayHit.maxPath = 0;
+			rayHit.path = 0;
+			rayHit.pathCount = 0;
+			rayHit.pathCost = rayHit.t = 0;
+			if (tryLOS)
+			{
+				raycast(parentRef, parentNode->pos, neighbourNode->pos, m_query.filter, DT_RAYCAST_USE_COSTS, &rayHit, grandpaRef);
+				foundShortCut = rayHit.t >= 1.0f;
+			}
+			
+			if (foundShortCut)
+			{
+				// Shortcut found, the cost is the cost along the ray from the parent.
+				cost = parentNode->cost + rayHit.pathCost;
+			}
+			else
 			{
-				// Cost
 				const float curCost = m_query.filter->getCost(bestNode->pos, neighbourNode->pos,
 															  parentRef, parentTile, parentPoly,
 															  bestRef, bestTile, bestPoly,
 															  neighbourRef, neighbourTile, neighbourPoly);
+				cost = bestNode->cost + curCost;
+			}
+			
+			// Special case for last node.
+			if (neighbourRef == m_query.endRef)
+			{
 				const float endCost = m_query.filter->getCost(neighbourNode->pos, m_query.endPos,
 															  bestRef, bestTile, bestPoly,
 															  neighbourRef, neighbourTile, neighbourPoly,
 															  0, 0, 0);
 				
-				cost = bestNode->cost + curCost + endCost;
+				cost = cost + endCost;
 				heuristic = 0;
 			}
 			else
 			{
-				// Cost
-				const float curCost = m_query.filter->getCost(bestNode->pos, neighbourNode->pos,
-															  parentRef, parentTile, parentPoly,
-															  bestRef, bestTile, bestPoly,
-															  neighbourRef, neighbourTile, neighbourPoly);
-				cost = bestNode->cost + curCost;
 				heuristic = dtVdist(neighbourNode->pos, m_query.endPos)*H_SCALE;
 			}
 			
@@ -1360,11 +1792,13 @@ dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 				continue;
 			
 			// Add or update the node.
-			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
+			neighbourNode->pidx = foundShortCut ? bestNode->pidx : m_nodePool->getNodeIdx(bestNode);
 			neighbourNode->id = neighbourRef;
-			neighbourNode->flags = (neighbourNode->flags & ~DT_NODE_CLOSED);
+			neighbourNode->flags = (neighbourNode->flags & ~(DT_NODE_CLOSED | DT_NODE_PARENT_DETACHED));
 			neighbourNode->cost = cost;
 			neighbourNode->total = total;
+			if (foundShortCut)
+				neighbourNode->flags = (neighbourNode->flags | DT_NODE_PARENT_DETACHED);
 			
 			if (neighbourNode->flags & DT_NODE_OPEN)
 			{
@@ -1428,11 +1862,15 @@ dtStatus dtNavMeshQuery::finalizeSlicedFindPath(dtPolyRef* path, int* pathCount,
 		
 		dtNode* prev = 0;
 		dtNode* node = m_query.lastBestNode;
+		int prevRay = 0;
 		do
 		{
 			dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
 			node->pidx = m_nodePool->getNodeIdx(prev);
 			prev = node;
+			int nextRay = node->flags & DT_NODE_PARENT_DETACHED; // keep track of whether parent is not adjacent (i.e. due to raycast shortcut)
+			node->flags = (node->flags & ~DT_NODE_PARENT_DETACHED) | prevRay; // and store it in the reversed path's node
+			prevRay = nextRay;
 			node = next;
 		}
 		while (node);
@@ -1441,13 +1879,36 @@ dtStatus dtNavMeshQuery::finalizeSlicedFindPath(dtPolyRef* path, int* pathCount,
 		node = prev;
 		do
 		{
-			path[n++] = node->id;
-			if (n >= maxPath)
+			dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
+			dtStatus status = 0;
+			if (node->flags & DT_NODE_PARENT_DETACHED)
+			{
+				// Fill the polygons skipped by the shortcut by casting the same ray again.
+				float t, normal[3];
+				int m;
+				status = raycast(node->id, node->pos, next->pos, m_query.filter, &t, normal, path+n, &m, maxPath-n);
+				n += m;
+				// Raycast ends on poly boundary and the path might include the next poly boundary.
+				if (n > 0 && path[n-1] == next->id)
+					n--; // remove to avoid duplicates
+				// The ray may stop short of the next node and fill the path.
+				if (n >= maxPath)
+					status |= DT_BUFFER_TOO_SMALL;
+			}
+			else
+			{
+				if (n < maxPath)
+					path[n++] = node->id;
+				if (n >= maxPath)
+					status = DT_BUFFER_TOO_SMALL;
+			}
+
+			if (status & DT_STATUS_DETAIL_MASK)
 			{
-				m_query.status |= DT_BUFFER_TOO_SMALL;
+				m_query.status |= status & DT_STATUS_DETAIL_MASK;
 				break;
 			}
-			node = m_nodePool->getNodeAtIdx(node->pidx);
+			node = next;
 		}
 		while (node);
 	}
@@ -1506,11 +1967,15 @@ dtStatus dtNavMeshQuery::finalizeSlicedFindPathPartial(const dtPolyRef* existing
 		}
 		
 		// Reverse the path.
+		int prevRay = 0;
 		do
 		{
 			dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
 			node->pidx = m_nodePool->getNodeIdx(prev);
 			prev = node;
+			int nextRay = node->flags & DT_NODE_PARENT_DETACHED; // keep track of whether parent is not adjacent (i.e. due to raycast shortcut)
+			node->flags = (node->flags & ~DT_NODE_PARENT_DETACHED) | prevRay; // and store it in the reversed path's node
+			prevRay = nextRay;
 			node = next;
 		}
 		while (node);
@@ -1519,13 +1984,36 @@ dtStatus dtNavMeshQuery::finalizeSlicedFindPathPartial(const dtPolyRef* existing
 		node = prev;
 		do
 		{
-			path[n++] = node->id;
-			if (n >= maxPath)
+			dtNode* next = m_nodePool->getNodeAtIdx(node->pidx);
+			dtStatus status = 0;
+			if (node->flags & DT_NODE_PARENT_DETACHED)
+			{
+				// Fill the polygons skipped by the shortcut by casting the same ray again.
+				float t, normal[3];
+				int m;
+				status = raycast(node->id, node->pos, next->pos, m_query.filter, &t, normal, path+n, &m, maxPath-n);
+				n += m;
+				// Raycast ends on poly boundary and the path might include the next poly boundary.
+				if (n > 0 && path[n-1] == next->id)
+					n--; // remove to avoid duplicates
+				// The ray may stop short of the next node and fill the path.
+				if (n >= maxPath)
+					status |= DT_BUFFER_TOO_SMALL;
+			}
+			else
 			{
-				m_query.status |= DT_BUFFER_TOO_SMALL;
+				if (n < maxPath)
+					path[n++] = node->id;
+				if (n >= maxPath)
+					status = DT_BUFFER_TOO_SMALL;
+			}
+
+			if (status & DT_STATUS_DETAIL_MASK)
+			{
+				m_query.status |= status & DT_STATUS_DETAIL_MASK;
 				break;
 			}
-			node = m_nodePool->getNodeAtIdx(node->pidx);
+			node = next;
 		}
 		while (node);
 	}
@@ -2239,35 +2727,80 @@ dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, cons
 								 const dtQueryFilter* filter,
 								 float* t, float* hitNormal, dtPolyRef* path, int* pathCount, const int maxPath) const
 {
-	dtAssert(m_nav);
+	dtRaycastHit hit;
+	hit.path = path;
+	hit.maxPath = maxPath;
+
+	dtStatus status = raycast(startRef, startPos, endPos, filter, 0, &hit);
 	
-	*t = 0;
+	*t = hit.t;
+	if (hitNormal)
+		dtVcopy(hitNormal, hit.hitNormal);
 	if (pathCount)
-		*pathCount = 0;
+		*pathCount = hit.pathCount;
+
+	return status;
+}
+
+/// @par
+///
+/// This method is meant to be used for quick, short distance checks.
+///
+/// If the path array is too small to hold the result, it will be filled as 
+/// far as possible from the start postion toward the end position.
+///
+/// When #DT_RAYCAST_USE_COSTS is specified, the cost of travelling along the
+/// ray is accumulated polygon by polygon using the filter and returned in
+/// dtRaycastHit::pathCost. The height of each polygon edge crossing is
+/// reconstructed from the edge, since the ray itself is tested in 2D.
+///
+/// See the other overload of #raycast for a description of the hit parameter
+/// and the use case restrictions, they apply to this method as well.
+///
+dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, const float* endPos,
+								 const dtQueryFilter* filter, const unsigned int options,
+								 dtRaycastHit* hit, dtPolyRef prevRef) const
+{
+	dtAssert(m_nav);
+	
+	hit->t = 0;
+	hit->pathCount = 0;
+	hit->pathCost = 0;
 	
 	// Validate input
 	if (!startRef || !m_nav->isValidPolyRef(startRef))
 		return DT_FAILURE | DT_INVALID_PARAM;
+	if (prevRef && !m_nav->isValidPolyRef(prevRef))
+		return DT_FAILURE | DT_INVALID_PARAM;
 	
-	dtPolyRef curRef = startRef;
+	float dir[3], curPos[3], lastPos[3];
 	float verts[DT_VERTS_PER_POLYGON*3];	
 	int n = 0;
 	
-	hitNormal[0] = 0;
-	hitNormal[1] = 0;
-	hitNormal[2] = 0;
+	dtVcopy(curPos, startPos);
+	dtVsub(dir, endPos, startPos);
+	dtVset(hit->hitNormal, 0, 0, 0);
 	
 	dtStatus status = DT_SUCCESS;
 	
+	const dtMeshTile* prevTile, *tile, *nextTile;
+	const dtPoly* prevPoly, *poly, *nextPoly;
+	dtPolyRef curRef;
+	
+	// The API input has been checked already, skip checking internal data.
+	curRef = startRef;
+	tile = 0;
+	poly = 0;
+	m_nav->getTileAndPolyByRefUnsafe(curRef, &tile, &poly);
+	nextTile = prevTile = tile;
+	nextPoly = prevPoly = poly;
+	if (prevRef)
+		m_nav->getTileAndPolyByRefUnsafe(prevRef, &prevTile, &prevPoly);
+	
 	while (curRef)
 	{
 		// Cast ray against current polygon.
 		
-		// The API input has been cheked already, skip checking internal data.
-		const dtMeshTile* tile = 0;
-		const dtPoly* poly = 0;
-		m_nav->getTileAndPolyByRefUnsafe(curRef, &tile, &poly);
-		
 		// Collect vertices.
 		int nv = 0;
 		for (int i = 0; i < (int)poly->vertCount; ++i)
@@ -2281,26 +2814,28 @@ dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, cons
 		if (!dtIntersectSegmentPoly2D(startPos, endPos, verts, nv, tmin, tmax, segMin, segMax))
 		{
 			// Could not hit the polygon, keep the old t and report hit.
-			if (pathCount)
-				*pathCount = n;
+			hit->pathCount = n;
 			return status;
 		}
 		// Keep track of furthest t so far.
-		if (tmax > *t)
-			*t = tmax;
+		if (tmax > hit->t)
+			hit->t = tmax;
 		
 		// Store visited polygons.
-		if (n < maxPath)
-			path[n++] = curRef;
+		if (n < hit->maxPath)
+			hit->path[n++] = curRef;
 		else
 			status |= DT_BUFFER_TOO_SMALL;
 		
 		// Ray end is completely inside the polygon.
 		if (segMax == -1)
 		{
-			*t = FLT_MAX;
-			if (pathCount)
-				*pathCount = n;
+			hit->t = FLT_MAX;
+			hit->pathCount = n;
+			
+			// Add the cost of the last segment.
+			if (options & DT_RAYCAST_USE_COSTS)
+				hit->pathCost += filter->getCost(curPos, endPos, prevRef, prevTile, prevPoly, curRef, tile, poly, curRef, tile, poly);
 			return status;
 		}
 		
@@ -2316,8 +2851,8 @@ dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, cons
 				continue;
 			
 			// Get pointer to the next polygon.
-			const dtMeshTile* nextTile = 0;
-			const dtPoly* nextPoly = 0;
+			nextTile = 0;
+			nextPoly = 0;
 			m_nav->getTileAndPolyByRefUnsafe(link->ref, &nextTile, &nextPoly);
 			
 			// Skip off-mesh connections.
@@ -2385,6 +2920,24 @@ dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, cons
 			}
 		}
 		
+		// Add the cost of crossing the current polygon.
+		if (options & DT_RAYCAST_USE_COSTS)
+		{
+			// Compute the intersection point at the furthest end of the polygon
+			// and correct the height (since the raycast moves in 2d).
+			dtVcopy(lastPos, curPos);
+			dtVmad(curPos, startPos, dir, hit->t);
+			const float* e1 = &verts[segMax*3];
+			const float* e2 = &verts[((segMax+1)%nv)*3];
+			float eDir[3], diff[3];
+			dtVsub(eDir, e2, e1);
+			dtVsub(diff, curPos, e1);
+			const float s = dtSqr(eDir[0]) > dtSqr(eDir[2]) ? diff[0] / eDir[0] : diff[2] / eDir[2];
+			curPos[1] = e1[1] + eDir[1] * s;
+			
+			hit->pathCost += filter->getCost(lastPos, curPos, prevRef, prevTile, prevPoly, curRef, tile, poly, nextRef, nextTile, nextPoly);
+		}
+		
 		if (!nextRef)
 		{
 			// No neighbour, we hit a wall.
@@ -2396,22 +2949,25 @@ dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, cons
 			const float* vb = &verts[b*3];
 			const float dx = vb[0] - va[0];
 			const float dz = vb[2] - va[2];
-			hitNormal[0] = dz;
-			hitNormal[1] = 0;
-			hitNormal[2] = -dx;
-			dtVnormalize(hitNormal);
+			hit->hitNormal[0] = dz;
+			hit->hitNormal[1] = 0;
+			hit->hitNormal[2] = -dx;
+			dtVnormalize(hit->hitNormal);
 			
-			if (pathCount)
-				*pathCount = n;
+			hit->pathCount = n;
 			return status;
 		}
 		
 		// No hit, advance to neighbour polygon.
+		prevRef = curRef;
 		curRef = nextRef;
+		prevTile = tile;
+		tile = nextTile;
+		prevPoly = poly;
+		poly = nextPoly;
 	}
 	
-	if (pathCount)
-		*pathCount = n;
+	hit->pathCount = n;
 	
 	return status;
 }
@@ -2778,6 +3334,169 @@ dtStatus dtNavMeshQuery::findPolysAroundShape(dtPolyRef startRef, const float* v
 	return status;
 }
 
+/// @par
+///
+/// The search runs backwards from all goal polygons at once, so each polygon
+/// of the field ends up pointing towards the cheapest goal to reach. A neighbour
+/// is only connected to a polygon if it has a link towards it, which keeps
+/// the direction of one-way off-mesh connections.
+///
+/// The cost stored for a polygon is the filter cost from the midpoint of the
+/// portal leading to its next polygon, to the goal position.
+///
+/// The size of the search is limited by the node pool of the query object.
+/// If the pool runs out of nodes, the status includes #DT_OUT_OF_NODES and the
+/// polygons that were not reached are reported as unreachable.
+///
+dtStatus dtNavMeshQuery::buildFlowField(const dtPolyRef* goalRefs, const float* goalPos, const int goalCount,
+										const dtQueryFilter* filter, dtFlowField* field) const
+{
+	dtAssert(m_nav);
+	dtAssert(m_nodePool);
+	dtAssert(m_openList);
+	dtAssert(field);
+	
+	// Validate input
+	if (!goalRefs || !goalPos || goalCount <= 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	for (int i = 0; i < goalCount; ++i)
+	{
+		if (!goalRefs[i] || !m_nav->isValidPolyRef(goalRefs[i]))
+			return DT_FAILURE | DT_INVALID_PARAM;
+	}
+	
+	dtStatus status = field->reset(m_nav, goalRefs, goalPos, goalCount);
+	if (dtStatusFailed(status))
+		return status;
+	
+	m_nodePool->clear();
+	m_openList->clear();
+	
+	for (int i = 0; i < goalCount; ++i)
+	{
+		dtNode* goalNode = m_nodePool->getNode(goalRefs[i]);
+		if (!goalNode)
+		{
+			status |= DT_OUT_OF_NODES;
+			continue;
+		}
+		// Same polygon given twice, the first one wins.
+		if (goalNode->flags)
+			continue;
+		dtVcopy(goalNode->pos, &goalPos[i*3]);
+		goalNode->pidx = 0;
+		goalNode->cost = 0;
+		goalNode->total = 0;
+		goalNode->id = goalRefs[i];
+		goalNode->flags = DT_NODE_OPEN;
+		m_openList->push(goalNode);
+	}
+	
+	while (!m_openList->empty())
+	{
+		dtNode* bestNode = m_openList->pop();
+		bestNode->flags &= ~DT_NODE_OPEN;
+		bestNode->flags |= DT_NODE_CLOSED;
+		
+		// Get poly and tile.
+		// The API input has been checked already, skip checking internal data.
+		const dtPolyRef bestRef = bestNode->id;
+		const dtMeshTile* bestTile = 0;
+		const dtPoly* bestPoly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
+		
+		// Get next poly and tile towards the goal.
+		dtPolyRef nextRef = 0;
+		const dtMeshTile* nextTile = 0;
+		const dtPoly* nextPoly = 0;
+		if (bestNode->pidx)
+			nextRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
+		if (nextRef)
+			m_nav->getTileAndPolyByRefUnsafe(nextRef, &nextTile, &nextPoly);
+		
+		// Store the final result of the polygon.
+		dtFlowFieldCell* cell = field->getCell(bestRef);
+		if (cell)
+		{
+			cell->next = nextRef ? nextRef : bestRef;
+			cell->cost = bestNode->total;
+		}
+		
+		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		{
+			const dtPolyRef neighbourRef = bestTile->links[i].ref;
+			// Skip invalid neighbours and do not follow back to next.
+			if (!neighbourRef || neighbourRef == nextRef)
+				continue;
+			
+			const dtMeshTile* neighbourTile = 0;
+			const dtPoly* neighbourPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
+			
+			// Do not advance if the polygon is excluded by the filter.
+			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+				continue;
+			
+			// The search runs backwards, make sure the neighbour can move to the current polygon.
+			bool connected = false;
+			for (unsigned int j = neighbourPoly->firstLink; j != DT_NULL_LINK; j = neighbourTile->links[j].next)
+			{
+				if (neighbourTile->links[j].ref == bestRef)
+				{
+					connected = true;
+					break;
+				}
+			}
+			if (!connected)
+				continue;
+			
+			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef);
+			if (!neighbourNode)
+			{
+				status |= DT_OUT_OF_NODES;
+				continue;
+			}
+			
+			if (neighbourNode->flags & DT_NODE_CLOSED)
+				continue;
+			
+			// The neighbour leaves through the portal to the current polygon.
+			float pos[3];
+			if (dtStatusFailed(getEdgeMidPoint(neighbourRef, neighbourPoly, neighbourTile,
+											   bestRef, bestPoly, bestTile, pos)))
+				continue;
+			
+			const float cost = filter->getCost(pos, bestNode->pos,
+											   neighbourRef, neighbourTile, neighbourPoly,
+											   bestRef, bestTile, bestPoly,
+											   nextRef, nextTile, nextPoly);
+			const float total = bestNode->total + cost;
+			
+			// The node is already in open list and the new result is worse, skip.
+			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
+				continue;
+			
+			dtVcopy(neighbourNode->pos, pos);
+			neighbourNode->id = neighbourRef;
+			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
+			neighbourNode->cost = cost;
+			neighbourNode->total = total;
+			
+			if (neighbourNode->flags & DT_NODE_OPEN)
+			{
+				m_openList->modify(neighbourNode);
+			}
+			else
+			{
+				neighbourNode->flags = DT_NODE_OPEN;
+				m_openList->push(neighbourNode);
+			}
+		}
+	}
+	
+	return status;
+}
+
 /// @par
 ///
 /// This method is optimized for a small search radius and small number of result 
@@ -20,6 +20,7 @@
 #define DETOURCROWD_H
 
 #include "DetourNavMeshQuery.h"
+#include "DetourFlowField.h"
 #include "DetourObstacleAvoidance.h"
 #include "DetourLocalBoundary.h"
 #include "DetourPathCorridor.h"
@@ -156,6 +157,7 @@ struct dtCrowdAgent
 	float targetPos[3];					///< Target position of the movement request (or velocity in case of DT_CROWDAGENT_TARGET_VELOCITY).
 	dtPathQueueRef targetPathqRef;		///< Path finder ref.
 	bool targetReplan;					///< Flag indicating that the current path is being replanned.
+	const dtFlowField* targetField;		///< Flow field used to plan the path, or null if the path is planned with the path queue.
 	float targetReplanTime;				/// <Time since the agent's target was replanned.
 };
 
@@ -177,6 +179,7 @@ enum UpdateFlags
 	DT_CROWD_SEPARATION = 4,
 	DT_CROWD_OPTIMIZE_VIS = 8,			///< Use #dtPathCorridor::optimizePathVisibility() to optimize the agent path.
 	DT_CROWD_OPTIMIZE_TOPO = 16,		///< Use dtPathCorridor::optimizePathTopology() to optimize the agent path.
+	DT_CROWD_ANY_ANGLE_PATH = 32,		///< Plan the agent path using #DT_FINDPATH_ANY_ANGLE.
 };
 
 struct dtCrowdAgentDebugInfo
@@ -277,6 +280,12 @@ public:
 	/// @return True if the request was successfully submitted.
 	bool requestMoveTarget(const int idx, dtPolyRef ref, const float* pos);
 
+	/// Submits a new move request for the specified agent, following a flow field.
+	///  @param[in]		idx		The agent index. [Limits: 0 <= value < #getAgentCount()]
+	///  @param[in]		field	The flow field to follow. The field must stay valid while the agent uses it.
+	/// @return True if the request was successfully submitted.
+	bool requestMoveFlowField(const int idx, const dtFlowField* field);
+
 	/// Submits a new move request for the specified agent.
 	///  @param[in]		idx		The agent index. [Limits: 0 <= value < #getAgentCount()]
 	///  @param[in]		vel		The movement velocity. [(x, y, z)]
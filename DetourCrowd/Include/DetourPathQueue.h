@@ -41,6 +41,7 @@ class dtPathQueue
 		dtStatus status;
 		int keepAlive;
 		const dtQueryFilter* filter; ///< TODO: This is potentially dangerous!
+		unsigned int options;
 	};
 	
 	static const int MAX_QUEUE = 8;
@@ -62,7 +63,7 @@ public:
 	
 	dtPathQueueRef request(dtPolyRef startRef, dtPolyRef endRef,
 						   const float* startPos, const float* endPos, 
-						   const dtQueryFilter* filter);
+						   const dtQueryFilter* filter, const unsigned int options = 0);
 	
 	dtStatus getRequestStatus(dtPathQueueRef ref) const;
 	
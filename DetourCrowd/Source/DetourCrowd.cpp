@@ -541,6 +541,7 @@ int dtCrowd::addAgent(const float* pos, const dtCrowdAgentParams* params)
 		ag->state = DT_CROWDAGENT_STATE_INVALID;
 	
 	ag->targetState = DT_CROWDAGENT_TARGET_NONE;
+	ag->targetField = 0;
 	
 	ag->active = 1;
 
@@ -600,6 +601,7 @@ bool dtCrowd::requestMoveTarget(const int idx, dtPolyRef ref, const float* pos)
 	dtVcopy(ag->targetPos, pos);
 	ag->targetPathqRef = DT_PATHQ_INVALID;
 	ag->targetReplan = false;
+	ag->targetField = 0;
 	if (ag->targetRef)
 		ag->targetState = DT_CROWDAGENT_TARGET_REQUESTING;
 	else
@@ -608,6 +610,38 @@ bool dtCrowd::requestMoveTarget(const int idx, dtPolyRef ref, const float* pos)
 	return true;
 }
 
+/// @par
+///
+/// The target of the agent is the goal the agent's current polygon flows to.
+/// The path is extracted from the field during the next #update() instead of
+/// using the path queue, and replans use the same field.
+///
+/// Fails if the agent's current polygon cannot reach any goal of the field.
+bool dtCrowd::requestMoveFlowField(const int idx, const dtFlowField* field)
+{
+	if (idx < 0 || idx > m_maxAgents)
+		return false;
+	if (!field)
+		return false;
+
+	dtCrowdAgent* ag = &m_agents[idx];
+
+	float goalPos[3];
+	const dtPolyRef goalRef = field->findGoal(ag->corridor.getFirstPoly(), goalPos);
+	if (!goalRef)
+		return false;
+
+	// Initialize request.
+	ag->targetRef = goalRef;
+	dtVcopy(ag->targetPos, goalPos);
+	ag->targetPathqRef = DT_PATHQ_INVALID;
+	ag->targetReplan = false;
+	ag->targetField = field;
+	ag->targetState = DT_CROWDAGENT_TARGET_REQUESTING;
+
+	return true;
+}
+
 bool dtCrowd::requestMoveVelocity(const int idx, const float* vel)
 {
 	if (idx < 0 || idx > m_maxAgents)
@@ -620,6 +654,7 @@ bool dtCrowd::requestMoveVelocity(const int idx, const float* vel)
 	dtVcopy(ag->targetPos, vel);
 	ag->targetPathqRef = DT_PATHQ_INVALID;
 	ag->targetReplan = false;
+	ag->targetField = 0;
 	ag->targetState = DT_CROWDAGENT_TARGET_VELOCITY;
 	
 	return true;
@@ -637,6 +672,7 @@ bool dtCrowd::resetMoveTarget(const int idx)
 	dtVset(ag->targetPos, 0,0,0);
 	ag->targetPathqRef = DT_PATHQ_INVALID;
 	ag->targetReplan = false;
+	ag->targetField = 0;
 	ag->targetState = DT_CROWDAGENT_TARGET_NONE;
 	
 	return true;
@@ -672,6 +708,52 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 		if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
 			continue;
 
+		if (ag->targetState == DT_CROWDAGENT_TARGET_REQUESTING && ag->targetField)
+		{
+			// Follow the flow field, no search needed.
+			const dtPolyRef startRef = ag->corridor.getFirstPoly();
+			float targetPos[3];
+			dtPolyRef* res = m_pathResult;
+			int nres = 0;
+			dtStatus status = ag->targetField->getPath(startRef, res, &nres, m_maxPathResult);
+			if (dtStatusFailed(status) || !nres)
+			{
+				ag->targetState = DT_CROWDAGENT_TARGET_FAILED;
+				continue;
+			}
+			
+			// The goal might have changed if the agent has moved closer to another goal.
+			const dtPolyRef lastRef = res[nres-1];
+			ag->targetRef = ag->targetField->findGoal(lastRef, ag->targetPos);
+			if (!ag->targetRef)
+			{
+				ag->targetState = DT_CROWDAGENT_TARGET_FAILED;
+				continue;
+			}
+			
+			if (ag->targetRef == lastRef)
+			{
+				dtVcopy(targetPos, ag->targetPos);
+			}
+			else
+			{
+				// Partial path, constrain target position inside the last polygon.
+				// The agent will replan from the end of the corridor as it gets close.
+				status = m_navquery->closestPointOnPoly(lastRef, ag->targetPos, targetPos);
+				if (dtStatusFailed(status))
+				{
+					ag->targetState = DT_CROWDAGENT_TARGET_FAILED;
+					continue;
+				}
+			}
+			
+			ag->corridor.setCorridor(targetPos, res, nres);
+			ag->boundary.reset();
+			ag->targetState = DT_CROWDAGENT_TARGET_VALID;
+			ag->targetReplanTime = 0.0;
+			continue;
+		}
+		
 		if (ag->targetState == DT_CROWDAGENT_TARGET_REQUESTING)
 		{
 			const dtPolyRef* path = ag->corridor.getPath();
@@ -685,7 +767,8 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 
 			// Quick seach towards the goal.
 			static const int MAX_ITER = 20;
-			m_navquery->initSlicedFindPath(path[0], ag->targetRef, ag->npos, ag->targetPos, &m_filter);
+			const unsigned int findOptions = (ag->params.updateFlags & DT_CROWD_ANY_ANGLE_PATH) ? DT_FINDPATH_ANY_ANGLE : 0;
+			m_navquery->initSlicedFindPath(path[0], ag->targetRef, ag->npos, ag->targetPos, &m_filter, findOptions);
 			m_navquery->updateSlicedFindPath(MAX_ITER, 0);
 			dtStatus status = 0;
 			if (ag->targetReplan) // && npath > 10)
@@ -751,8 +834,9 @@ void dtCrowd::updateMoveRequest(const float /*dt*/)
 	for (int i = 0; i < nqueue; ++i)
 	{
 		dtCrowdAgent* ag = queue[i];
+		const unsigned int findOptions = (ag->params.updateFlags & DT_CROWD_ANY_ANGLE_PATH) ? DT_FINDPATH_ANY_ANGLE : 0;
 		ag->targetPathqRef = m_pathq.request(ag->corridor.getLastPoly(), ag->targetRef,
-											 ag->corridor.getTarget(), ag->targetPos, &m_filter);
+											 ag->corridor.getTarget(), ag->targetPos, &m_filter, findOptions);
 		if (ag->targetPathqRef != DT_PATHQ_INVALID)
 			ag->targetState = DT_CROWDAGENT_TARGET_WAITING_FOR_PATH;
 	}
@@ -111,7 +111,7 @@ void dtPathQueue::update(const int maxIters)
 		// Handle query start.
 		if (q.status == 0)
 		{
-			q.status = m_navquery->initSlicedFindPath(q.startRef, q.endRef, q.startPos, q.endPos, q.filter);
+			q.status = m_navquery->initSlicedFindPath(q.startRef, q.endRef, q.startPos, q.endPos, q.filter, q.options);
 		}		
 		// Handle query in progress.
 		if (dtStatusInProgress(q.status))
@@ -134,7 +134,7 @@ void dtPathQueue::update(const int maxIters)
 
 dtPathQueueRef dtPathQueue::request(dtPolyRef startRef, dtPolyRef endRef,
 									const float* startPos, const float* endPos,
-									const dtQueryFilter* filter)
+									const dtQueryFilter* filter, const unsigned int options)
 {
 	// Find empty slot
 	int slot = -1;
@@ -163,6 +163,7 @@ dtPathQueueRef dtPathQueue::request(dtPolyRef startRef, dtPolyRef endRef,
 	q.status = 0;
 	q.npath = 0;
 	q.filter = filter;
+	q.options = options;
 	q.keepAlive = 0;
 	
 	return ref;
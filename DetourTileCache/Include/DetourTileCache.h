@@ -2,6 +2,7 @@
 #define DETOURTILECACHE_H
 
 #include "DetourStatus.h"
+#include "DetourNavMesh.h"
 
 
 
@@ -9,6 +10,9 @@ typedef unsigned int dtObstacleRef;
 
 typedef unsigned int dtCompressedTileRef;
 
+/// Identifies an obstacle add or remove request, tickets increase with each request.
+typedef unsigned int dtObstacleTicket;
+
 /// Flags for addTile
 enum dtCompressedTileFlags
 {
@@ -35,16 +39,49 @@ enum ObstacleState
 	DT_OBSTACLE_REMOVING,
 };
 
-static const int DT_MAX_TOUCHED_TILES = 8;
+enum ObstacleType
+{
+	DT_OBSTACLE_CYLINDER,
+	DT_OBSTACLE_BOX,				///< Axis aligned box.
+	DT_OBSTACLE_ORIENTED_BOX,		///< Box rotated around the y-axis.
+};
+
+struct dtObstacleCylinder
+{
+	float pos[3];
+	float radius;
+	float height;
+};
+
+struct dtObstacleBox
+{
+	float bmin[3];
+	float bmax[3];
+};
+
+struct dtObstacleOrientedBox
+{
+	float center[3];
+	float halfExtents[3];
+	float rotAux[2];				///< Cosine and sine of the rotation around the y-axis.
+};
+
 struct dtTileCacheObstacle
 {
-	float pos[3], radius, height;
-	dtCompressedTileRef touched[DT_MAX_TOUCHED_TILES];
-	dtCompressedTileRef pending[DT_MAX_TOUCHED_TILES];
+	union
+	{
+		dtObstacleCylinder cylinder;
+		dtObstacleBox box;
+		dtObstacleOrientedBox orientedBox;
+	};
+	dtCompressedTileRef* touched;			///< Tiles overlapping the obstacle, grown as needed.
+	dtCompressedTileRef* pending;			///< Touched tiles waiting to be rebuilt.
+	int ntouched;
+	int npending;
+	int maxTouched;
 	unsigned short salt;
+	unsigned char type;
 	unsigned char state;
-	unsigned char ntouched;
-	unsigned char npending;
 	dtTileCacheObstacle* next;
 };
 
@@ -59,6 +96,54 @@ struct dtTileCacheParams
 	float maxSimplificationError;
 	int maxTiles;
 	int maxObstacles;
+	int partitionType;						///< Region partitioning of the layers, see dtTileCachePartitionType.
+};
+
+static const int DT_TILECACHE_ARCHIVE_MAGIC = 'T'<<24 | 'C'<<16 | 'A'<<8 | 'R'; ///< 'TCAR'
+static const int DT_TILECACHE_ARCHIVE_VERSION = 2;
+
+/// Header of a tile cache archive written by dtTileCache::saveArchive().
+/// The archive uses the byte order of the platform which wrote it.
+struct dtTileCacheArchiveHeader
+{
+	int magic;
+	int version;
+	int dataSize;							///< Size of the archive in bytes.
+	int ntiles;
+	int nobstacles;
+	int tilesOffset;						///< Offset of the tile table, sorted by ty, tx and tlayer.
+	int obstaclesOffset;					///< Offset of the obstacles.
+	dtTileCacheParams params;
+};
+
+struct dtTileCacheArchiveTile
+{
+	int tx, ty, tlayer;
+	int dataOffset;							///< Offset of the tile data from the start of the archive.
+	int dataSize;
+};
+
+struct dtTileCacheArchiveObstacle
+{
+	dtObstacleRef ref;
+	unsigned char type;
+	unsigned char pad[3];
+	union
+	{
+		dtObstacleCylinder cylinder;
+		dtObstacleBox box;
+		dtObstacleOrientedBox orientedBox;
+	};
+};
+
+struct dtTileCacheLayerCacheStats
+{
+	int hits;								///< Rebuilds which used a cached layer.
+	int misses;								///< Rebuilds which decompressed the layer.
+	int evictions;							///< Layers dropped to make room for others.
+	int skipped;							///< Rebuilds skipped because the obstacles did not change the layer.
+	int layerCount;							///< Number of cached layers.
+	int memUsage;							///< Memory used by the cached layers in bytes.
 };
 
 struct dtTileCacheMeshProcess
@@ -67,6 +152,41 @@ struct dtTileCacheMeshProcess
 						 unsigned char* polyAreas, unsigned short* polyFlags) = 0;
 };
 
+/// A batch of independent jobs, see dtTileCacheWorkers.
+struct dtTileCacheJob
+{
+	virtual ~dtTileCacheJob() {}
+	
+	/// Runs the specified job using the allocator of the calling worker.
+	virtual void run(const int index, struct dtTileCacheAlloc* alloc) = 0;
+};
+
+/// Runs the tile builds of dtTileCache::update() concurrently.
+/// Each worker must use its own allocator. The compressor and the mesh process
+/// of the tile cache are called from the workers and must be thread safe.
+struct dtTileCacheWorkers
+{
+	virtual ~dtTileCacheWorkers() {}
+	
+	/// Runs the jobs [0, count) and returns when all of them are done.
+	virtual void run(dtTileCacheJob* job, const int count) = 0;
+};
+
+/// Receives the changes dtTileCache makes to the navmesh.
+struct dtTileCacheListener
+{
+	virtual ~dtTileCacheListener() {}
+	
+	/// Called when a navmesh tile has been replaced or rebuilt. The polygon refs from
+	/// @p oldBase to @p oldBase + @p oldPolyCount - 1 are no longer valid, so only the
+	/// paths through them need to be checked again.
+	virtual void navMeshTileReplaced(const dtPolyRef oldBase, const int oldPolyCount,
+									 const dtPolyRef newBase, const int newPolyCount) = 0;
+	
+	/// Called by update() when the obstacle requests up to and including @p ticket are
+	/// reflected in the navmesh.
+	virtual void obstacleRequestsCompleted(const dtObstacleTicket ticket) = 0;
+};
 
 class dtTileCache
 {
@@ -76,6 +196,13 @@ public:
 	
 	struct dtTileCacheAlloc* getAlloc() { return m_talloc; }
 	struct dtTileCacheCompressor* getCompressor() { return m_tcomp; }
+	
+	/// Returns the compressor used to decompress layers of the specified codec.
+	struct dtTileCacheCompressor* getCompressor(const unsigned char codec) const;
+	
+	/// Adds a compressor for decompressing layers compressed with a different codec
+	/// than the compressor passed to init().
+	dtStatus addCompressor(struct dtTileCacheCompressor* tcomp);
 	const dtTileCacheParams* getParams() const { return &m_params; }
 	
 	inline int getTileCount() const { return m_params.maxTiles; }
@@ -104,21 +231,85 @@ public:
 	dtStatus removeTile(dtCompressedTileRef ref, unsigned char** data, int* dataSize);
 	
 	dtStatus addObstacle(const float* pos, const float radius, const float height, dtObstacleRef* result);
+	
+	/// Adds an axis aligned box obstacle.
+	dtStatus addBoxObstacle(const float* bmin, const float* bmax, dtObstacleRef* result);
+	
+	/// Adds a box obstacle rotated around the y-axis by @p yRadians.
+	dtStatus addOrientedBoxObstacle(const float* center, const float* halfExtents, const float yRadians, dtObstacleRef* result);
+	
 	dtStatus removeObstacle(const dtObstacleRef ref);
 	
+	/// Returns the ticket of the latest obstacle add or remove request.
+	inline dtObstacleTicket getLastObstacleTicket() const { return m_lastTicket; }
+	
+	/// Returns the latest ticket whose request, and all requests before it, are reflected in the navmesh.
+	inline dtObstacleTicket getCompletedObstacleTicket() const { return m_completedTicket; }
+	
+	/// Returns true if the request of the ticket is reflected in the navmesh.
+	inline bool isObstacleTicketCompleted(const dtObstacleTicket ticket) const
+	{
+		return (int)(ticket - m_completedTicket) <= 0;
+	}
+	
+	/// Sets the listener notified of navmesh tile and obstacle request changes, or null.
+	inline void setListener(dtTileCacheListener* listener) { m_listener = listener; }
+	
+	/// Finds the tiles overlapping the bounds.
+	/// Returns #DT_BUFFER_TOO_SMALL when there were more tiles than fit in @p results.
 	dtStatus queryTiles(const float* bmin, const float* bmax,
 						dtCompressedTileRef* results, int* resultCount, const int maxResults) const;
 	
 	dtStatus update(const float /*dt*/, class dtNavMesh* navmesh);
 	
+	/// Sets how update() rebuilds the dirty tiles.
+	///  @param[in]		workers				The workers to build the tiles on, or null to build on the calling thread.
+	///  @param[in]		maxTilesPerUpdate	The max number of tiles built and added to the navmesh per update.
+	void setWorkers(dtTileCacheWorkers* workers, const int maxTilesPerUpdate);
+	
+	/// Keeps the decompressed layers of recently rebuilt tiles, so that tiles rebuilt
+	/// again by update() or buildNavMeshTile() skip decompression. update() also skips the
+	/// rebuild of a cached tile when the obstacles did not change any of its cells, which
+	/// assumes that update() is always called with the same navmesh. Must be called after init().
+	///  @param[in]		maxMemory	The max memory used by the cached layers in bytes, 0 disables the cache.
+	dtStatus setLayerCacheSize(const int maxMemory);
+	
+	inline const dtTileCacheLayerCacheStats& getLayerCacheStats() const { return m_layerCacheStats; }
+	
 	dtStatus buildNavMeshTilesAt(const int tx, const int ty, class dtNavMesh* navmesh);
 	
 	dtStatus buildNavMeshTile(const dtCompressedTileRef ref, class dtNavMesh* navmesh);
 	
+	/// Builds the navmesh tile data of a tile without touching the navmesh, can be called concurrently.
+	/// The data is null if the tile has no polygons.
+	dtStatus buildNavMeshTileData(const dtCompressedTileRef ref, struct dtTileCacheAlloc* talloc,
+								  unsigned char** navData, int* navDataSize) const;
+	
+	/// Replaces the navmesh tile at the location of the tile with data from buildNavMeshTileData().
+	dtStatus addNavMeshTileData(const dtCompressedTileRef ref, unsigned char* navData, const int navDataSize,
+								class dtNavMesh* navmesh);
+	
 	void calcTightTileBounds(const struct dtTileCacheLayerHeader* header, float* bmin, float* bmax) const;
 	
 	void getObstacleBounds(const struct dtTileCacheObstacle* ob, float* bmin, float* bmax) const;
 	
+	/// Writes the params, the tiles and the obstacles to an archive allocated with dtAlloc().
+	/// The tiles of the attached archive which are not loaded are written too.
+	dtStatus saveArchive(unsigned char** data, int* dataSize) const;
+	
+	/// Attaches an archive written by saveArchive() and restores its obstacles with their refs.
+	/// The tiles are added later with loadArchiveTiles(). The data is not copied and must stay
+	/// valid while the archive is attached, so it can be a memory mapped file.
+	/// Must be called after init() with the params of the archive.
+	dtStatus setArchive(const unsigned char* data, const int dataSize);
+	
+	/// Adds the tiles of the attached archive which overlap the bounds and are not loaded yet.
+	/// The tiles point to the archive data, they can be evicted again with removeTile().
+	/// Returns #DT_BUFFER_TOO_SMALL when there were more tiles than fit in @p results,
+	/// the rest of the tiles are added by calling the method again.
+	dtStatus loadArchiveTiles(const float* bmin, const float* bmax,
+							  dtCompressedTileRef* results, int* resultCount, const int maxResults);
+	
 
 	/// Encodes a tile id.
 	inline dtCompressedTileRef encodeTileId(unsigned int salt, unsigned int it) const
@@ -162,6 +353,7 @@ public:
 	
 	
 private:
+	friend struct TileBuildJob;
 	
 	enum ObstacleRequestAction
 	{
@@ -175,6 +367,20 @@ private:
 		dtObstacleRef ref;
 	};
 	
+	struct LayerCacheEntry
+	{
+		dtCompressedTileRef ref;
+		unsigned char* data;				///< Layer header followed by the uncompressed grids.
+		int dataSize;
+		unsigned char* stamped;				///< Areas of the last build, with obstacles marked.
+		int dirty[4];						///< Cells changed since the last build (minx, miny, maxx, maxy).
+		bool valid;
+		bool built;
+		bool pinned;
+		LayerCacheEntry* prev;
+		LayerCacheEntry* next;
+	};
+	
 	int m_tileLutSize;						///< Tile hash lookup size (must be pot).
 	int m_tileLutMask;						///< Tile hash lookup mask.
 	
@@ -189,19 +395,58 @@ private:
 	
 	dtTileCacheAlloc* m_talloc;
 	dtTileCacheCompressor* m_tcomp;
+	static const int MAX_COMPRESSORS = 8;
+	dtTileCacheCompressor* m_compressors[MAX_COMPRESSORS];
+	int m_ncompressors;
 	dtTileCacheMeshProcess* m_tmproc;
+	dtTileCacheWorkers* m_workers;
+	int m_maxTilesPerUpdate;
 	
 	dtTileCacheObstacle* m_obstacles;
 	dtTileCacheObstacle* m_nextFreeObstacle;
 	
-	static const int MAX_REQUESTS = 64;
-	ObstacleRequest m_reqs[MAX_REQUESTS];
+	ObstacleRequest* m_reqs;				///< Pending obstacle requests, at most one per obstacle.
+	int* m_obstacleReqs;					///< Index of the pending request of each obstacle, or -1.
 	int m_nreqs;
 	
-	static const int MAX_UPDATE = 64;
-	dtCompressedTileRef m_update[MAX_UPDATE];
+	dtObstacleTicket m_lastTicket;			///< Ticket of the latest request.
+	dtObstacleTicket m_processedTicket;		///< Latest ticket whose request has been processed.
+	dtObstacleTicket m_completedTicket;		///< Latest ticket whose tiles have been rebuilt.
+	dtTileCacheListener* m_listener;
+	
+	dtCompressedTileRef* m_update;			///< Ring buffer of tiles to rebuild, at most one entry per tile.
+	unsigned char* m_updateQueued;			///< Set for the tiles in the update queue, indexed by tile index.
+	int m_updateHead;
 	int m_nupdate;
 	
+	static const int MAX_TILES_PER_UPDATE = 64;
+	
+	LayerCacheEntry** m_layerCacheLookup;	///< Cached layer of each tile, indexed by tile index.
+	LayerCacheEntry* m_layerCacheHead;		///< Most recently used layer.
+	LayerCacheEntry* m_layerCacheTail;		///< Least recently used layer.
+	int m_layerCacheMaxMemory;
+	dtTileCacheLayerCacheStats m_layerCacheStats;
+	
+	const unsigned char* m_archive;			///< Archive the tiles are loaded from, not owned.
+	int m_archiveSize;
+	
+	void updateObstacleStates(const dtCompressedTileRef ref);
+	void queueTileUpdate(const dtCompressedTileRef ref);
+	void unqueueTileUpdate(const dtCompressedTileRef ref);
+	void freeObstacle(dtTileCacheObstacle* ob);
+	dtStatus queryObstacleTiles(dtTileCacheObstacle* ob);
+	LayerCacheEntry* acquireCachedLayer(const dtCompressedTileRef ref);
+	void releaseCachedLayer(LayerCacheEntry* entry, const bool built);
+	void markCachedLayerDirty(const dtCompressedTileRef ref, const dtTileCacheObstacle* ob);
+	void freeCachedLayer(LayerCacheEntry* entry);
+	void trimLayerCache(const int maxMemory);
+	/// Size of the entry, the layer data and the stamped areas, allocated together.
+	static int layerCacheEntrySize(const int dataSize);
+	dtStatus buildNavMeshTileData(const dtCompressedTileRef ref, struct dtTileCacheAlloc* talloc,
+								  LayerCacheEntry* entry, unsigned char** navData, int* navDataSize) const;
+	dtTileCacheObstacle* allocObstacle();
+	void resetObstacle(dtTileCacheObstacle* ob);
+	dtStatus requestAddObstacle(dtTileCacheObstacle* ob, dtObstacleRef* result);
 };
 
 dtTileCache* dtAllocTileCache();
@@ -23,12 +23,30 @@
 #include "DetourStatus.h"
 
 static const int DT_TILECACHE_MAGIC = 'D'<<24 | 'T'<<16 | 'L'<<8 | 'R'; ///< 'DTLR';
-static const int DT_TILECACHE_VERSION = 1;
+static const int DT_TILECACHE_VERSION = 2;
 
 static const unsigned char DT_TILECACHE_NULL_AREA = 0;
 static const unsigned char DT_TILECACHE_WALKABLE_AREA = 63;
 static const unsigned short DT_TILECACHE_NULL_IDX = 0xffff;
 
+/// Codec ids stored in the layer header, see dtTileCacheCompressor::getCodec().
+enum dtTileCacheCodec
+{
+	DT_TILECACHE_CODEC_UNKNOWN = 0,			///< Decompressed with the compressor of the tile cache.
+	DT_TILECACHE_CODEC_LAYER = 1,			///< dtTileCacheLayerCompressor.
+	DT_TILECACHE_CODEC_FASTLZ = 2,
+	DT_TILECACHE_CODEC_LZ4 = 3,
+	DT_TILECACHE_CODEC_ZSTD = 4,
+	DT_TILECACHE_CODEC_USER = 128,			///< First id free for application specific codecs.
+};
+
+/// Region partitioning of the tile cache layers, see dtTileCacheParams::partitionType.
+enum dtTileCachePartitionType
+{
+	DT_TILECACHE_PARTITION_MONOTONE = 0,	///< Fastest, regions follow the sweep, see dtBuildTileCacheRegions().
+	DT_TILECACHE_PARTITION_WATERSHED = 1,	///< Slower, regions follow the open areas, see dtBuildTileCacheWatershedRegions().
+};
+
 struct dtTileCacheLayerHeader
 {
 	int magic;								///< Data magic
@@ -38,6 +56,7 @@ struct dtTileCacheLayerHeader
 	unsigned short hmin, hmax;				///< Height min/max range
 	unsigned char width, height;			///< Dimension of the layer.
 	unsigned char minx, maxx, miny, maxy;	///< Usable sub-region.
+	unsigned char codec;					///< Codec of the compressed grids, see dtTileCacheCodec.
 };
 
 struct dtTileCacheLayer
@@ -78,6 +97,8 @@ struct dtTileCachePolyMesh
 
 struct dtTileCacheAlloc
 {
+	virtual ~dtTileCacheAlloc() {}
+	
 	virtual void reset()
 	{
 	}
@@ -95,11 +116,28 @@ struct dtTileCacheAlloc
 
 struct dtTileCacheCompressor
 {
+	virtual ~dtTileCacheCompressor() {}
+	
 	virtual int maxCompressedSize(const int bufferSize) = 0;
 	virtual dtStatus compress(const unsigned char* buffer, const int bufferSize,
 							  unsigned char* compressed, const int maxCompressedSize, int* compressedSize) = 0;
 	virtual dtStatus decompress(const unsigned char* compressed, const int compressedSize,
 								unsigned char* buffer, const int maxBufferSize, int* bufferSize) = 0;
+	/// Returns the codec id written to the layers compressed with this compressor.
+	virtual unsigned char getCodec() { return DT_TILECACHE_CODEC_UNKNOWN; }
+};
+
+/// Compressor specialized for layer data, see #DT_TILECACHE_CODEC_LAYER.
+/// The heights are delta coded and all grids are run length encoded, which is
+/// fast to decompress and compact for the large uniform areas of a layer.
+struct dtTileCacheLayerCompressor : public dtTileCacheCompressor
+{
+	virtual int maxCompressedSize(const int bufferSize);
+	virtual dtStatus compress(const unsigned char* buffer, const int bufferSize,
+							  unsigned char* compressed, const int maxCompressedSize, int* compressedSize);
+	virtual dtStatus decompress(const unsigned char* compressed, const int compressedSize,
+								unsigned char* buffer, const int maxBufferSize, int* bufferSize);
+	virtual unsigned char getCodec() { return DT_TILECACHE_CODEC_LAYER; }
 };
 
 
@@ -125,10 +163,24 @@ void dtFreeTileCachePolyMesh(dtTileCacheAlloc* alloc, dtTileCachePolyMesh* lmesh
 dtStatus dtMarkCylinderArea(dtTileCacheLayer& layer, const float* orig, const float cs, const float ch,
 							const float* pos, const float radius, const float height, const unsigned char areaId);
 
+dtStatus dtMarkBoxArea(dtTileCacheLayer& layer, const float* orig, const float cs, const float ch,
+					   const float* bmin, const float* bmax, const unsigned char areaId);
+
+/// Marks the area of a box rotated around the y-axis.
+///  @param[in]		rotAux		Cosine and sine of the rotation, see dtObstacleOrientedBox.
+dtStatus dtMarkOrientedBoxArea(dtTileCacheLayer& layer, const float* orig, const float cs, const float ch,
+							   const float* center, const float* halfExtents, const float* rotAux,
+							   const unsigned char areaId);
+
 dtStatus dtBuildTileCacheRegions(dtTileCacheAlloc* alloc,
 								 dtTileCacheLayer& layer,
 								 const int walkableClimb);
 
+/// Partitions the layer using a watershed, see #DT_TILECACHE_PARTITION_WATERSHED.
+dtStatus dtBuildTileCacheWatershedRegions(dtTileCacheAlloc* alloc,
+										  dtTileCacheLayer& layer,
+										  const int walkableClimb);
+
 dtStatus dtBuildTileCacheContours(dtTileCacheAlloc* alloc,
 								  dtTileCacheLayer& layer,
 								  const int walkableClimb, 	const float maxError,
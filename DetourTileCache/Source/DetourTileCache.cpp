@@ -5,7 +5,9 @@
 #include "DetourCommon.h"
 #include "DetourAlloc.h"
 #include "DetourAssert.h"
+#include <float.h>
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include <new>
 
@@ -31,6 +33,37 @@ static bool contains(const dtCompressedTileRef* a, const int n, const dtCompress
 	return false;
 }
 
+// Tests the obstacle against the xz-bounds of a tile, the bounds of the obstacle
+// are expected to overlap the tile. The obstacle is padded by half a cell like
+// when it is rasterized.
+static bool overlapObstacleTile(const dtTileCacheObstacle* ob, const float* bmin, const float* bmax, const float cs)
+{
+	const float pad = cs*0.5f;
+	if (ob->type == DT_OBSTACLE_CYLINDER)
+	{
+		const dtObstacleCylinder& cl = ob->cylinder;
+		const float dx = cl.pos[0] - dtClamp(cl.pos[0], bmin[0], bmax[0]);
+		const float dz = cl.pos[2] - dtClamp(cl.pos[2], bmin[2], bmax[2]);
+		return dx*dx + dz*dz <= dtSqr(cl.radius + pad);
+	}
+	else if (ob->type == DT_OBSTACLE_ORIENTED_BOX)
+	{
+		// Separating axis test along the axes of the box.
+		const dtObstacleOrientedBox& orientedBox = ob->orientedBox;
+		const float c = orientedBox.rotAux[0];
+		const float s = orientedBox.rotAux[1];
+		const float rx = (bmax[0] - bmin[0])*0.5f;
+		const float rz = (bmax[2] - bmin[2])*0.5f;
+		const float dx = (bmin[0] + rx) - orientedBox.center[0];
+		const float dz = (bmin[2] + rz) - orientedBox.center[2];
+		if (dtAbs(dx*c - dz*s) > orientedBox.halfExtents[0] + pad + dtAbs(c)*rx + dtAbs(s)*rz)
+			return false;
+		if (dtAbs(dx*s + dz*c) > orientedBox.halfExtents[2] + pad + dtAbs(s)*rx + dtAbs(c)*rz)
+			return false;
+	}
+	return true;
+}
+
 inline int computeTileHash(int x, int y, const int mask)
 {
 	const unsigned int h1 = 0x8da6b343; // Large multiplicative constants;
@@ -59,6 +92,47 @@ struct BuildContext
 	struct dtTileCacheAlloc* alloc;
 };
 
+// Decompresses layers kept by the layer cache, which stores the grids uncompressed.
+struct UncompressedLayer : public dtTileCacheCompressor
+{
+	virtual int maxCompressedSize(const int bufferSize) { return bufferSize; }
+	virtual dtStatus compress(const unsigned char* buffer, const int bufferSize,
+							  unsigned char* compressed, const int maxCompressedSize, int* compressedSize)
+	{
+		if (bufferSize > maxCompressedSize)
+			return DT_FAILURE | DT_BUFFER_TOO_SMALL;
+		memcpy(compressed, buffer, bufferSize);
+		*compressedSize = bufferSize;
+		return DT_SUCCESS;
+	}
+	virtual dtStatus decompress(const unsigned char* compressed, const int compressedSize,
+								unsigned char* buffer, const int maxBufferSize, int* bufferSize)
+	{
+		if (compressedSize > maxBufferSize)
+			return DT_FAILURE | DT_BUFFER_TOO_SMALL;
+		memcpy(buffer, compressed, compressedSize);
+		*bufferSize = compressedSize;
+		return DT_SUCCESS;
+	}
+};
+
+struct TileBuildJob : public dtTileCacheJob
+{
+	inline TileBuildJob(const dtTileCache* t, const dtCompressedTileRef* r, dtTileCache::LayerCacheEntry** e,
+						unsigned char** d, int* ds, dtStatus* s) :
+		tc(t), refs(r), entries(e), navData(d), navDataSize(ds), status(s) {}
+	virtual void run(const int index, struct dtTileCacheAlloc* alloc)
+	{
+		status[index] = tc->buildNavMeshTileData(refs[index], alloc, entries[index], &navData[index], &navDataSize[index]);
+	}
+	const dtTileCache* tc;
+	const dtCompressedTileRef* refs;
+	dtTileCache::LayerCacheEntry** entries;
+	unsigned char** navData;
+	int* navDataSize;
+	dtStatus* status;
+};
+
 
 dtTileCache::dtTileCache() :
 	m_tileLutSize(0),
@@ -70,17 +144,40 @@ dtTileCache::dtTileCache() :
 	m_tileBits(0),
 	m_talloc(0),
 	m_tcomp(0),
+	m_ncompressors(0),
 	m_tmproc(0),
+	m_workers(0),
+	m_maxTilesPerUpdate(1),
 	m_obstacles(0),
 	m_nextFreeObstacle(0),
+	m_reqs(0),
+	m_obstacleReqs(0),
 	m_nreqs(0),
-	m_nupdate(0)
+	m_lastTicket(0),
+	m_processedTicket(0),
+	m_completedTicket(0),
+	m_listener(0),
+	m_update(0),
+	m_updateQueued(0),
+	m_updateHead(0),
+	m_nupdate(0),
+	m_layerCacheLookup(0),
+	m_layerCacheHead(0),
+	m_layerCacheTail(0),
+	m_layerCacheMaxMemory(0),
+	m_archive(0),
+	m_archiveSize(0)
 {
 	memset(&m_params, 0, sizeof(m_params));
+	memset(m_compressors, 0, sizeof(m_compressors));
+	memset(&m_layerCacheStats, 0, sizeof(m_layerCacheStats));
 }
 	
 dtTileCache::~dtTileCache()
 {
+	trimLayerCache(0);
+	dtFree(m_layerCacheLookup);
+	m_layerCacheLookup = 0;
 	for (int i = 0; i < m_params.maxTiles; ++i)
 	{
 		if (m_tiles[i].flags & DT_COMPRESSEDTILE_FREE_DATA)
@@ -89,8 +186,21 @@ dtTileCache::~dtTileCache()
 			m_tiles[i].data = 0;
 		}
 	}
+	if (m_obstacles)
+	{
+		for (int i = 0; i < m_params.maxObstacles; ++i)
+			dtFree(m_obstacles[i].touched);
+	}
 	dtFree(m_obstacles);
 	m_obstacles = 0;
+	dtFree(m_reqs);
+	m_reqs = 0;
+	dtFree(m_obstacleReqs);
+	m_obstacleReqs = 0;
+	dtFree(m_update);
+	m_update = 0;
+	dtFree(m_updateQueued);
+	m_updateQueued = 0;
 	dtFree(m_posLookup);
 	m_posLookup = 0;
 	dtFree(m_tiles);
@@ -121,6 +231,7 @@ dtStatus dtTileCache::init(const dtTileCacheParams* params,
 {
 	m_talloc = talloc;
 	m_tcomp = tcomp;
+	m_ncompressors = 0;
 	m_tmproc = tmproc;
 	m_nreqs = 0;
 	memcpy(&m_params, params, sizeof(m_params));
@@ -138,6 +249,16 @@ dtStatus dtTileCache::init(const dtTileCacheParams* params,
 		m_nextFreeObstacle = &m_obstacles[i];
 	}
 	
+	// Alloc space for obstacle requests, there is at most one pending request per obstacle.
+	m_reqs = (ObstacleRequest*)dtAlloc(sizeof(ObstacleRequest)*m_params.maxObstacles, DT_ALLOC_PERM);
+	if (!m_reqs)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	m_obstacleReqs = (int*)dtAlloc(sizeof(int)*m_params.maxObstacles, DT_ALLOC_PERM);
+	if (!m_obstacleReqs)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	for (int i = 0; i < m_params.maxObstacles; ++i)
+		m_obstacleReqs[i] = -1;
+	
 	// Init tiles
 	m_tileLutSize = dtNextPow2(m_params.maxTiles/4);
 	if (!m_tileLutSize) m_tileLutSize = 1;
@@ -159,6 +280,17 @@ dtStatus dtTileCache::init(const dtTileCacheParams* params,
 		m_nextFreeTile = &m_tiles[i];
 	}
 	
+	// Init update queue, each tile is queued at most once.
+	m_update = (dtCompressedTileRef*)dtAlloc(sizeof(dtCompressedTileRef)*m_params.maxTiles, DT_ALLOC_PERM);
+	if (!m_update)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	m_updateQueued = (unsigned char*)dtAlloc(sizeof(unsigned char)*m_params.maxTiles, DT_ALLOC_PERM);
+	if (!m_updateQueued)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	memset(m_updateQueued, 0, sizeof(unsigned char)*m_params.maxTiles);
+	m_updateHead = 0;
+	m_nupdate = 0;
+	
 	// Init ID generator values.
 	m_tileBits = dtIlog2(dtNextPow2((unsigned int)m_params.maxTiles));
 	// Only allow 31 salt bits, since the salt mask is calculated using 32bit uint and it will overflow.
@@ -169,6 +301,28 @@ dtStatus dtTileCache::init(const dtTileCacheParams* params,
 	return DT_SUCCESS;
 }
 
+dtTileCacheCompressor* dtTileCache::getCompressor(const unsigned char codec) const
+{
+	if (codec == DT_TILECACHE_CODEC_UNKNOWN)
+		return m_tcomp;
+	for (int i = 0; i < m_ncompressors; ++i)
+	{
+		if (m_compressors[i]->getCodec() == codec)
+			return m_compressors[i];
+	}
+	return m_tcomp;
+}
+
+dtStatus dtTileCache::addCompressor(dtTileCacheCompressor* tcomp)
+{
+	if (!tcomp)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (m_ncompressors >= MAX_COMPRESSORS)
+		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
+	m_compressors[m_ncompressors++] = tcomp;
+	return DT_SUCCESS;
+}
+
 int dtTileCache::getTilesAt(const int tx, const int ty, dtCompressedTileRef* tiles, const int maxTiles) const 
 {
 	int n = 0;
@@ -296,6 +450,14 @@ dtStatus dtTileCache::removeTile(dtCompressedTileRef ref, unsigned char** data,
 	if (tile->salt != tileSalt)
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
+	// Remove tile from update queue, and stop obstacles from waiting for it.
+	unqueueTileUpdate(ref);
+	updateObstacleStates(ref);
+	
+	// Drop the cached layer of the tile.
+	if (m_layerCacheLookup && m_layerCacheLookup[tileIndex])
+		freeCachedLayer(m_layerCacheLookup[tileIndex]);
+	
 	// Remove tile from hash lookup.
 	const int h = computeTileHash(tile->header->tx,tile->header->ty,m_tileLutMask);
 	dtCompressedTile* prev = 0;
@@ -350,33 +512,50 @@ dtStatus dtTileCache::removeTile(dtCompressedTileRef ref, unsigned char** data,
 }
 
 
-dtObstacleRef dtTileCache::addObstacle(const float* pos, const float radius, const float height, dtObstacleRef* result)
+dtTileCacheObstacle* dtTileCache::allocObstacle()
 {
-	if (m_nreqs >= MAX_REQUESTS)
-		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
-	
-	dtTileCacheObstacle* ob = 0;
-	if (m_nextFreeObstacle)
-	{
-		ob = m_nextFreeObstacle;
-		m_nextFreeObstacle = ob->next;
-		ob->next = 0;
-	}
+	dtTileCacheObstacle* ob = m_nextFreeObstacle;
 	if (!ob)
-		return DT_FAILURE | DT_OUT_OF_MEMORY;
-	
+		return 0;
+	m_nextFreeObstacle = ob->next;
+	resetObstacle(ob);
+	return ob;
+}
+
+void dtTileCache::resetObstacle(dtTileCacheObstacle* ob)
+{
+	// Keep the touched tile buffers for reuse.
+	dtCompressedTileRef* touched = ob->touched;
+	const int maxTouched = ob->maxTouched;
 	unsigned short salt = ob->salt;
 	memset(ob, 0, sizeof(dtTileCacheObstacle));
+	ob->touched = touched;
+	ob->pending = touched ? touched + maxTouched : 0;
+	ob->maxTouched = maxTouched;
 	ob->salt = salt;
 	ob->state = DT_OBSTACLE_PROCESSING;
-	dtVcopy(ob->pos, pos);
-	ob->radius = radius;
-	ob->height = height;
-	
+}
+
+void dtTileCache::freeObstacle(dtTileCacheObstacle* ob)
+{
+	ob->state = DT_OBSTACLE_EMPTY;
+	// Update salt, salt should never be zero.
+	ob->salt = (ob->salt+1) & ((1<<16)-1);
+	if (ob->salt == 0)
+		ob->salt++;
+	// Return obstacle to free list.
+	ob->next = m_nextFreeObstacle;
+	m_nextFreeObstacle = ob;
+}
+
+dtStatus dtTileCache::requestAddObstacle(dtTileCacheObstacle* ob, dtObstacleRef* result)
+{
+	m_obstacleReqs[ob - m_obstacles] = m_nreqs;
 	ObstacleRequest* req = &m_reqs[m_nreqs++];
 	memset(req, 0, sizeof(ObstacleRequest));
 	req->action = REQUEST_ADD;
 	req->ref = getObstacleRef(ob);
+	m_lastTicket++;
 	
 	if (result)
 		*result = req->ref;
@@ -384,13 +563,86 @@ dtObstacleRef dtTileCache::addObstacle(const float* pos, const float radius, con
 	return DT_SUCCESS;
 }
 
+dtObstacleRef dtTileCache::addObstacle(const float* pos, const float radius, const float height, dtObstacleRef* result)
+{
+	dtTileCacheObstacle* ob = allocObstacle();
+	if (!ob)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
+	ob->type = DT_OBSTACLE_CYLINDER;
+	dtVcopy(ob->cylinder.pos, pos);
+	ob->cylinder.radius = radius;
+	ob->cylinder.height = height;
+	
+	return requestAddObstacle(ob, result);
+}
+
+dtStatus dtTileCache::addBoxObstacle(const float* bmin, const float* bmax, dtObstacleRef* result)
+{
+	dtTileCacheObstacle* ob = allocObstacle();
+	if (!ob)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
+	ob->type = DT_OBSTACLE_BOX;
+	dtVcopy(ob->box.bmin, bmin);
+	dtVcopy(ob->box.bmax, bmax);
+	
+	return requestAddObstacle(ob, result);
+}
+
+dtStatus dtTileCache::addOrientedBoxObstacle(const float* center, const float* halfExtents, const float yRadians, dtObstacleRef* result)
+{
+	dtTileCacheObstacle* ob = allocObstacle();
+	if (!ob)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
+	ob->type = DT_OBSTACLE_ORIENTED_BOX;
+	dtVcopy(ob->orientedBox.center, center);
+	dtVcopy(ob->orientedBox.halfExtents, halfExtents);
+	ob->orientedBox.rotAux[0] = cosf(yRadians);
+	ob->orientedBox.rotAux[1] = sinf(yRadians);
+	
+	return requestAddObstacle(ob, result);
+}
+
 dtObstacleRef dtTileCache::removeObstacle(const dtObstacleRef ref)
 {
 	if (!ref)
 		return DT_SUCCESS;
-	if (m_nreqs >= MAX_REQUESTS)
-		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
 	
+	unsigned int idx = decodeObstacleIdObstacle(ref);
+	if ((int)idx >= m_params.maxObstacles)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	dtTileCacheObstacle* ob = &m_obstacles[idx];
+	unsigned int salt = decodeObstacleIdSalt(ref);
+	if (ob->salt != salt || ob->state == DT_OBSTACLE_EMPTY)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	// Requests which do not change the navmesh complete with the next update.
+	m_lastTicket++;
+	
+	const int ireq = m_obstacleReqs[idx];
+	if (ireq != -1)
+	{
+		if (m_reqs[ireq].action == REQUEST_ADD)
+		{
+			// The obstacle has not touched any tiles yet, cancel the add.
+			m_nreqs--;
+			if (ireq != m_nreqs)
+			{
+				m_reqs[ireq] = m_reqs[m_nreqs];
+				m_obstacleReqs[decodeObstacleIdObstacle(m_reqs[ireq].ref)] = ireq;
+			}
+			m_obstacleReqs[idx] = -1;
+			freeObstacle(ob);
+		}
+		// Else the obstacle is already being removed.
+		return DT_SUCCESS;
+	}
+	if (ob->state == DT_OBSTACLE_REMOVING)
+		return DT_SUCCESS;
+	
+	m_obstacleReqs[idx] = m_nreqs;
 	ObstacleRequest* req = &m_reqs[m_nreqs++];
 	memset(req, 0, sizeof(ObstacleRequest));
 	req->action = REQUEST_REMOVE;
@@ -406,6 +658,7 @@ dtStatus dtTileCache::queryTiles(const float* bmin, const float* bmax,
 	dtCompressedTileRef tiles[MAX_TILES];
 	
 	int n = 0;
+	dtStatus status = DT_SUCCESS;
 	
 	const float tw = m_params.width * m_params.cs;
 	const float th = m_params.height * m_params.cs;
@@ -430,6 +683,8 @@ dtStatus dtTileCache::queryTiles(const float* bmin, const float* bmax,
 				{
 					if (n < maxResults)
 						results[n++] = tiles[i];
+					else
+						status |= DT_BUFFER_TOO_SMALL;
 				}
 			}
 		}
@@ -437,13 +692,17 @@ dtStatus dtTileCache::queryTiles(const float* bmin, const float* bmax,
 	
 	*resultCount = n;
 	
-	return DT_SUCCESS;
+	return status;
 }
 
 dtStatus dtTileCache::update(const float /*dt*/, dtNavMesh* navmesh)
 {
+	dtStatus status = DT_SUCCESS;
+	
 	if (m_nupdate == 0)
 	{
+		m_processedTicket = m_lastTicket;
+		
 		// Process requests.
 		for (int i = 0; i < m_nreqs; ++i)
 		{
@@ -452,6 +711,7 @@ dtStatus dtTileCache::update(const float /*dt*/, dtNavMesh* navmesh)
 			unsigned int idx = decodeObstacleIdObstacle(req->ref);
 			if ((int)idx >= m_params.maxObstacles)
 				continue;
+			m_obstacleReqs[idx] = -1;
 			dtTileCacheObstacle* ob = &m_obstacles[idx];
 			unsigned int salt = decodeObstacleIdSalt(req->ref);
 			if (ob->salt != salt)
@@ -460,39 +720,34 @@ dtStatus dtTileCache::update(const float /*dt*/, dtNavMesh* navmesh)
 			if (req->action == REQUEST_ADD)
 			{
 				// Find touched tiles.
-				float bmin[3], bmax[3];
-				getObstacleBounds(ob, bmin, bmax);
-
-				int ntouched = 0;
-				queryTiles(bmin, bmax, ob->touched, &ntouched, DT_MAX_TOUCHED_TILES);
-				ob->ntouched = (unsigned char)ntouched;
-				// Add tiles to update list.
-				ob->npending = 0;
-				for (int j = 0; j < ob->ntouched; ++j)
-				{
-					if (m_nupdate < MAX_UPDATE)
-					{
-						if (!contains(m_update, m_nupdate, ob->touched[j]))
-							m_update[m_nupdate++] = ob->touched[j];
-						ob->pending[ob->npending++] = ob->touched[j];
-					}
-				}
+				dtStatus queryStatus = queryObstacleTiles(ob);
+				if (dtStatusFailed(queryStatus))
+					status = queryStatus;
 			}
 			else if (req->action == REQUEST_REMOVE)
 			{
 				// Prepare to remove obstacle.
 				ob->state = DT_OBSTACLE_REMOVING;
-				// Add tiles to update list.
-				ob->npending = 0;
-				for (int j = 0; j < ob->ntouched; ++j)
-				{
-					if (m_nupdate < MAX_UPDATE)
-					{
-						if (!contains(m_update, m_nupdate, ob->touched[j]))
-							m_update[m_nupdate++] = ob->touched[j];
-						ob->pending[ob->npending++] = ob->touched[j];
-					}
-				}
+			}
+			
+			// Add tiles to update list.
+			ob->npending = 0;
+			for (int j = 0; j < ob->ntouched; ++j)
+			{
+				if (!getTileByRef(ob->touched[j]))
+					continue;
+				queueTileUpdate(ob->touched[j]);
+				markCachedLayerDirty(ob->touched[j], ob);
+				ob->pending[ob->npending++] = ob->touched[j];
+			}
+			
+			// Obstacles which do not touch any tiles are done right away.
+			if (ob->npending == 0)
+			{
+				if (ob->state == DT_OBSTACLE_PROCESSING)
+					ob->state = DT_OBSTACLE_PROCESSED;
+				else if (ob->state == DT_OBSTACLE_REMOVING)
+					freeObstacle(ob);
 			}
 		}
 		
@@ -502,57 +757,349 @@ dtStatus dtTileCache::update(const float /*dt*/, dtNavMesh* navmesh)
 	// Process updates
 	if (m_nupdate)
 	{
-		// Build mesh
-		const dtCompressedTileRef ref = m_update[0];
-		dtStatus status = buildNavMeshTile(ref, navmesh);
-		m_nupdate--;
-		if (m_nupdate > 0)
-			memmove(m_update, m_update+1, m_nupdate*sizeof(dtCompressedTileRef));
+		const int nbuild = dtMin(m_nupdate, m_maxTilesPerUpdate);
+		dtCompressedTileRef refs[MAX_TILES_PER_UPDATE];
+		LayerCacheEntry* entries[MAX_TILES_PER_UPDATE];
+		unsigned char* navData[MAX_TILES_PER_UPDATE];
+		int navDataSize[MAX_TILES_PER_UPDATE];
+		dtStatus buildStatus[MAX_TILES_PER_UPDATE];
+		
+		// Pop tiles from the queue.
+		for (int i = 0; i < nbuild; ++i)
+		{
+			refs[i] = m_update[m_updateHead];
+			m_updateQueued[decodeTileIdTile(refs[i])] = 0;
+			m_updateHead = (m_updateHead+1) % m_params.maxTiles;
+		}
+		m_nupdate -= nbuild;
+		
+		// Find cached layers, and reserve room for the missing ones.
+		for (int i = 0; i < nbuild; ++i)
+			entries[i] = acquireCachedLayer(refs[i]);
+		
+		// Build mesh data
+		if (m_workers && nbuild > 1)
+		{
+			TileBuildJob job(this, refs, entries, navData, navDataSize, buildStatus);
+			m_workers->run(&job, nbuild);
+		}
+		else
+		{
+			for (int i = 0; i < nbuild; ++i)
+				buildStatus[i] = buildNavMeshTileData(refs[i], m_talloc, entries[i], &navData[i], &navDataSize[i]);
+		}
+		
+		// Add tiles to the navmesh.
+		for (int i = 0; i < nbuild; ++i)
+		{
+			if (dtStatusSucceed(buildStatus[i]))
+				buildStatus[i] = addNavMeshTileData(refs[i], navData[i], navDataSize[i], navmesh);
+			releaseCachedLayer(entries[i], dtStatusSucceed(buildStatus[i]));
+			if (dtStatusFailed(buildStatus[i]) && dtStatusSucceed(status))
+				status = buildStatus[i];
+			updateObstacleStates(refs[i]);
+		}
+	}
+	
+	// All processed requests are done when the queue is empty.
+	if (m_nupdate == 0 && m_completedTicket != m_processedTicket)
+	{
+		m_completedTicket = m_processedTicket;
+		if (m_listener)
+			m_listener->obstacleRequestsCompleted(m_completedTicket);
+	}
+	
+	return status;
+}
 
-		// Update obstacle states.
-		for (int i = 0; i < m_params.maxObstacles; ++i)
+void dtTileCache::setWorkers(dtTileCacheWorkers* workers, const int maxTilesPerUpdate)
+{
+	m_workers = workers;
+	m_maxTilesPerUpdate = dtClamp(maxTilesPerUpdate, 1, (int)MAX_TILES_PER_UPDATE);
+}
+
+int dtTileCache::layerCacheEntrySize(const int dataSize)
+{
+	const int gridSize = (dataSize - dtAlign4(sizeof(dtTileCacheLayerHeader))) / 3;
+	return dtAlign4(sizeof(LayerCacheEntry)) + dtAlign4(dataSize) + gridSize;
+}
+
+dtStatus dtTileCache::setLayerCacheSize(const int maxMemory)
+{
+	if (!m_layerCacheLookup && maxMemory > 0)
+	{
+		m_layerCacheLookup = (LayerCacheEntry**)dtAlloc(sizeof(LayerCacheEntry*)*m_params.maxTiles, DT_ALLOC_PERM);
+		if (!m_layerCacheLookup)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		memset(m_layerCacheLookup, 0, sizeof(LayerCacheEntry*)*m_params.maxTiles);
+	}
+	m_layerCacheMaxMemory = dtMax(maxMemory, 0);
+	trimLayerCache(m_layerCacheMaxMemory);
+	return DT_SUCCESS;
+}
+
+dtTileCache::LayerCacheEntry* dtTileCache::acquireCachedLayer(const dtCompressedTileRef ref)
+{
+	if (!m_layerCacheMaxMemory)
+		return 0;
+	const dtCompressedTile* tile = getTileByRef(ref);
+	if (!tile)
+		return 0;
+	const unsigned int idx = decodeTileIdTile(ref);
+	
+	LayerCacheEntry* entry = m_layerCacheLookup[idx];
+	if (entry && entry->valid && entry->ref == ref)
+	{
+		// Move to the front of the list.
+		if (entry != m_layerCacheHead)
+		{
+			entry->prev->next = entry->next;
+			if (entry->next) entry->next->prev = entry->prev;
+			else m_layerCacheTail = entry->prev;
+			entry->prev = 0;
+			entry->next = m_layerCacheHead;
+			m_layerCacheHead->prev = entry;
+			m_layerCacheHead = entry;
+		}
+		entry->pinned = true;
+		m_layerCacheStats.hits++;
+		return entry;
+	}
+	if (entry)
+		freeCachedLayer(entry);
+	
+	m_layerCacheStats.misses++;
+	
+	// Make room for the layer.
+	const int gridSize = (int)tile->header->width * (int)tile->header->height;
+	const int dataSize = dtAlign4(sizeof(dtTileCacheLayerHeader)) + gridSize*3;
+	const int entrySize = layerCacheEntrySize(dataSize);
+	if (entrySize > m_layerCacheMaxMemory)
+		return 0;
+	trimLayerCache(m_layerCacheMaxMemory - entrySize);
+	if (m_layerCacheStats.memUsage + entrySize > m_layerCacheMaxMemory)
+		return 0;
+	
+	unsigned char* mem = (unsigned char*)dtAlloc(entrySize, DT_ALLOC_PERM);
+	if (!mem)
+		return 0;
+	entry = (LayerCacheEntry*)mem;
+	entry->ref = ref;
+	entry->data = mem + dtAlign4(sizeof(LayerCacheEntry));
+	entry->dataSize = dataSize;
+	entry->stamped = entry->data + dtAlign4(dataSize);
+	entry->dirty[0] = entry->dirty[1] = 0;
+	entry->dirty[2] = entry->dirty[3] = -1;
+	entry->valid = false;
+	entry->built = false;
+	entry->pinned = true;
+	entry->prev = 0;
+	entry->next = m_layerCacheHead;
+	if (m_layerCacheHead) m_layerCacheHead->prev = entry;
+	else m_layerCacheTail = entry;
+	m_layerCacheHead = entry;
+	m_layerCacheLookup[idx] = entry;
+	m_layerCacheStats.layerCount++;
+	m_layerCacheStats.memUsage += entrySize;
+	
+	return entry;
+}
+
+void dtTileCache::releaseCachedLayer(LayerCacheEntry* entry, const bool built)
+{
+	if (!entry)
+		return;
+	entry->pinned = false;
+	if (built)
+	{
+		// The build leaves the flag set when it was skipped.
+		if (entry->built)
+			m_layerCacheStats.skipped++;
+		entry->dirty[0] = entry->dirty[1] = 0;
+		entry->dirty[2] = entry->dirty[3] = -1;
+	}
+	entry->built = built;
+	// Failed builds leave the entry empty.
+	if (!entry->valid)
+		freeCachedLayer(entry);
+}
+
+void dtTileCache::freeCachedLayer(LayerCacheEntry* entry)
+{
+	if (entry->prev) entry->prev->next = entry->next;
+	else m_layerCacheHead = entry->next;
+	if (entry->next) entry->next->prev = entry->prev;
+	else m_layerCacheTail = entry->prev;
+	m_layerCacheLookup[decodeTileIdTile(entry->ref)] = 0;
+	m_layerCacheStats.layerCount--;
+	m_layerCacheStats.memUsage -= layerCacheEntrySize(entry->dataSize);
+	dtFree(entry);
+}
+
+void dtTileCache::markCachedLayerDirty(const dtCompressedTileRef ref, const dtTileCacheObstacle* ob)
+{
+	if (!m_layerCacheLookup)
+		return;
+	LayerCacheEntry* entry = m_layerCacheLookup[decodeTileIdTile(ref)];
+	if (!entry || entry->ref != ref || !entry->built)
+		return;
+	const dtTileCacheLayerHeader* header = getTileByRef(ref)->header;
+	
+	// Cells covered by the obstacle, padded by one cell for the rasterization.
+	float bmin[3], bmax[3];
+	getObstacleBounds(ob, bmin, bmax);
+	const float ics = 1.0f / m_params.cs;
+	const int w = (int)header->width;
+	const int h = (int)header->height;
+	const int minx = dtClamp((int)floorf((bmin[0] - header->bmin[0])*ics) - 1, 0, w-1);
+	const int miny = dtClamp((int)floorf((bmin[2] - header->bmin[2])*ics) - 1, 0, h-1);
+	const int maxx = dtClamp((int)floorf((bmax[0] - header->bmin[0])*ics) + 1, 0, w-1);
+	const int maxy = dtClamp((int)floorf((bmax[2] - header->bmin[2])*ics) + 1, 0, h-1);
+	
+	if (entry->dirty[0] > entry->dirty[2])
+	{
+		entry->dirty[0] = minx;
+		entry->dirty[1] = miny;
+		entry->dirty[2] = maxx;
+		entry->dirty[3] = maxy;
+	}
+	else
+	{
+		entry->dirty[0] = dtMin(entry->dirty[0], minx);
+		entry->dirty[1] = dtMin(entry->dirty[1], miny);
+		entry->dirty[2] = dtMax(entry->dirty[2], maxx);
+		entry->dirty[3] = dtMax(entry->dirty[3], maxy);
+	}
+}
+
+void dtTileCache::trimLayerCache(const int maxMemory)
+{
+	LayerCacheEntry* entry = m_layerCacheTail;
+	while (entry && m_layerCacheStats.memUsage > maxMemory)
+	{
+		LayerCacheEntry* prev = entry->prev;
+		if (!entry->pinned)
 		{
-			dtTileCacheObstacle* ob = &m_obstacles[i];
-			if (ob->state == DT_OBSTACLE_PROCESSING || ob->state == DT_OBSTACLE_REMOVING)
+			freeCachedLayer(entry);
+			m_layerCacheStats.evictions++;
+		}
+		entry = prev;
+	}
+}
+
+void dtTileCache::queueTileUpdate(const dtCompressedTileRef ref)
+{
+	const unsigned int idx = decodeTileIdTile(ref);
+	if (m_updateQueued[idx])
+		return;
+	m_updateQueued[idx] = 1;
+	m_update[(m_updateHead + m_nupdate) % m_params.maxTiles] = ref;
+	m_nupdate++;
+}
+
+void dtTileCache::unqueueTileUpdate(const dtCompressedTileRef ref)
+{
+	const unsigned int idx = decodeTileIdTile(ref);
+	if (!m_updateQueued[idx])
+		return;
+	m_updateQueued[idx] = 0;
+	
+	// Shift the rest of the queue over the removed tile.
+	int i = 0;
+	while (i < m_nupdate && m_update[(m_updateHead+i) % m_params.maxTiles] != ref)
+		i++;
+	for (; i < m_nupdate-1; ++i)
+		m_update[(m_updateHead+i) % m_params.maxTiles] = m_update[(m_updateHead+i+1) % m_params.maxTiles];
+	m_nupdate--;
+	
+	// The tile will not be rebuilt, do not wait for it.
+	updateObstacleStates(ref);
+}
+
+dtStatus dtTileCache::queryObstacleTiles(dtTileCacheObstacle* ob)
+{
+	float bmin[3], bmax[3];
+	getObstacleBounds(ob, bmin, bmax);
+	// The rasterization rounds the bottom of the obstacle down to the cell height,
+	// and the layer heights at portals can be up to walkable climb above the tile bounds.
+	bmin[1] -= m_params.walkableClimb + m_params.ch;
+	
+	ob->ntouched = 0;
+	for (;;)
+	{
+		if (ob->maxTouched)
+		{
+			int ntouched = 0;
+			dtStatus status = queryTiles(bmin, bmax, ob->touched, &ntouched, ob->maxTouched);
+			if (!dtStatusDetail(status, DT_BUFFER_TOO_SMALL))
 			{
-				// Remove handled tile from pending list.
-				for (int j = 0; j < (int)ob->npending; j++)
+				ob->ntouched = ntouched;
+				break;
+			}
+		}
+		
+		// Grow the touched and pending lists.
+		const int maxTouched = ob->maxTouched ? ob->maxTouched*2 : 8;
+		dtCompressedTileRef* touched = (dtCompressedTileRef*)dtAlloc(sizeof(dtCompressedTileRef)*maxTouched*2, DT_ALLOC_PERM);
+		if (!touched)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		if (ob->npending)
+			memcpy(touched + maxTouched, ob->pending, sizeof(dtCompressedTileRef)*ob->npending);
+		dtFree(ob->touched);
+		ob->touched = touched;
+		ob->pending = touched + maxTouched;
+		ob->maxTouched = maxTouched;
+	}
+	
+	// Skip the tiles which only overlap the bounds of the obstacle.
+	int n = 0;
+	for (int i = 0; i < ob->ntouched; ++i)
+	{
+		float tbmin[3], tbmax[3];
+		calcTightTileBounds(m_tiles[decodeTileIdTile(ob->touched[i])].header, tbmin, tbmax);
+		if (overlapObstacleTile(ob, tbmin, tbmax, m_params.cs))
+			ob->touched[n++] = ob->touched[i];
+	}
+	ob->ntouched = n;
+	
+	return DT_SUCCESS;
+}
+
+void dtTileCache::updateObstacleStates(const dtCompressedTileRef ref)
+{
+	for (int i = 0; i < m_params.maxObstacles; ++i)
+	{
+		dtTileCacheObstacle* ob = &m_obstacles[i];
+		// Obstacles waiting for their request have no pending tiles yet.
+		if (m_obstacleReqs[i] != -1)
+			continue;
+		if (ob->state == DT_OBSTACLE_PROCESSING || ob->state == DT_OBSTACLE_REMOVING)
+		{
+			// Remove handled tile from pending list.
+			for (int j = 0; j < ob->npending; j++)
+			{
+				if (ob->pending[j] == ref)
 				{
-					if (ob->pending[j] == ref)
-					{
-						ob->pending[j] = ob->pending[(int)ob->npending-1];
-						ob->npending--;
-						break;
-					}
+					ob->pending[j] = ob->pending[ob->npending-1];
+					ob->npending--;
+					break;
 				}
-				
-				// If all pending tiles processed, change state.
-				if (ob->npending == 0)
+			}
+			
+			// If all pending tiles processed, change state.
+			if (ob->npending == 0)
+			{
+				if (ob->state == DT_OBSTACLE_PROCESSING)
+				{
+					ob->state = DT_OBSTACLE_PROCESSED;
+				}
+				else if (ob->state == DT_OBSTACLE_REMOVING)
 				{
-					if (ob->state == DT_OBSTACLE_PROCESSING)
-					{
-						ob->state = DT_OBSTACLE_PROCESSED;
-					}
-					else if (ob->state == DT_OBSTACLE_REMOVING)
-					{
-						ob->state = DT_OBSTACLE_EMPTY;
-						// Update salt, salt should never be zero.
-						ob->salt = (ob->salt+1) & ((1<<16)-1);
-						if (ob->salt == 0)
-							ob->salt++;
-						// Return obstacle to free list.
-						ob->next = m_nextFreeObstacle;
-						m_nextFreeObstacle = ob;
-					}
+					freeObstacle(ob);
 				}
 			}
 		}
-			
-		if (dtStatusFailed(status))
-			return status;
 	}
-	
-	return DT_SUCCESS;
 }
 
 
@@ -573,10 +1120,35 @@ dtStatus dtTileCache::buildNavMeshTilesAt(const int tx, const int ty, dtNavMesh*
 }
 
 dtStatus dtTileCache::buildNavMeshTile(const dtCompressedTileRef ref, dtNavMesh* navmesh)
+{
+	unsigned char* navData = 0;
+	int navDataSize = 0;
+	LayerCacheEntry* entry = acquireCachedLayer(ref);
+	// The navmesh may not contain the last build of the tile, always rebuild.
+	if (entry)
+		entry->built = false;
+	dtStatus status = buildNavMeshTileData(ref, m_talloc, entry, &navData, &navDataSize);
+	if (dtStatusSucceed(status))
+		status = addNavMeshTileData(ref, navData, navDataSize, navmesh);
+	releaseCachedLayer(entry, dtStatusSucceed(status));
+	return status;
+}
+
+dtStatus dtTileCache::buildNavMeshTileData(const dtCompressedTileRef ref, dtTileCacheAlloc* talloc,
+										   unsigned char** navData, int* navDataSize) const
+{
+	return buildNavMeshTileData(ref, talloc, 0, navData, navDataSize);
+}
+
+dtStatus dtTileCache::buildNavMeshTileData(const dtCompressedTileRef ref, dtTileCacheAlloc* talloc,
+										   LayerCacheEntry* entry, unsigned char** navData, int* navDataSize) const
 {	
-	dtAssert(m_talloc);
+	dtAssert(talloc);
 	dtAssert(m_tcomp);
 	
+	*navData = 0;
+	*navDataSize = 0;
+	
 	unsigned int idx = decodeTileIdTile(ref);
 	if (idx > (unsigned int)m_params.maxTiles)
 		return DT_FAILURE | DT_INVALID_PARAM;
@@ -585,16 +1157,35 @@ dtStatus dtTileCache::buildNavMeshTile(const dtCompressedTileRef ref, dtNavMesh*
 	if (tile->salt != salt)
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
-	m_talloc->reset();
+	talloc->reset();
 	
-	BuildContext bc(m_talloc);
+	BuildContext bc(talloc);
 	const int walkableClimbVx = (int)(m_params.walkableClimb / m_params.ch);
 	dtStatus status;
 	
-	// Decompress tile layer data. 
-	status = dtDecompressTileCacheLayer(m_talloc, m_tcomp, tile->data, tile->dataSize, &bc.layer);
-	if (dtStatusFailed(status))
-		return status;
+	// Decompress tile layer data, or copy it from the layer cache.
+	if (entry && entry->valid)
+	{
+		UncompressedLayer uncompressed;
+		status = dtDecompressTileCacheLayer(talloc, &uncompressed, entry->data, entry->dataSize, &bc.layer);
+		if (dtStatusFailed(status))
+			return status;
+	}
+	else
+	{
+		status = dtDecompressTileCacheLayer(talloc, getCompressor(tile->header->codec),
+											tile->data, tile->dataSize, &bc.layer);
+		if (dtStatusFailed(status))
+			return status;
+		if (entry)
+		{
+			// Keep the layer before obstacles are rasterized into it.
+			const int headerSize = dtAlign4(sizeof(dtTileCacheLayerHeader));
+			memcpy(entry->data, bc.layer->header, sizeof(dtTileCacheLayerHeader));
+			memcpy(entry->data + headerSize, bc.layer->heights, entry->dataSize - headerSize);
+			entry->valid = true;
+		}
+	}
 	
 	// Rasterize obstacles.
 	for (int i = 0; i < m_params.maxObstacles; ++i)
@@ -604,28 +1195,66 @@ dtStatus dtTileCache::buildNavMeshTile(const dtCompressedTileRef ref, dtNavMesh*
 			continue;
 		if (contains(ob->touched, ob->ntouched, ref))
 		{
-			dtMarkCylinderArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
-							   ob->pos, ob->radius, ob->height, 0);
+			if (ob->type == DT_OBSTACLE_CYLINDER)
+			{
+				dtMarkCylinderArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
+								   ob->cylinder.pos, ob->cylinder.radius, ob->cylinder.height, 0);
+			}
+			else if (ob->type == DT_OBSTACLE_BOX)
+			{
+				dtMarkBoxArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
+							  ob->box.bmin, ob->box.bmax, 0);
+			}
+			else if (ob->type == DT_OBSTACLE_ORIENTED_BOX)
+			{
+				dtMarkOrientedBoxArea(*bc.layer, tile->header->bmin, m_params.cs, m_params.ch,
+									  ob->orientedBox.center, ob->orientedBox.halfExtents,
+									  ob->orientedBox.rotAux, 0);
+			}
+		}
+	}
+	
+	if (entry)
+	{
+		const int w = (int)bc.layer->header->width;
+		if (entry->built)
+		{
+			// Skip the rebuild if the obstacles did not change any cells.
+			bool changed = false;
+			for (int y = entry->dirty[1]; y <= entry->dirty[3] && !changed; ++y)
+			{
+				const int row = y*w;
+				if (memcmp(entry->stamped + row + entry->dirty[0], bc.layer->areas + row + entry->dirty[0],
+						   entry->dirty[2] - entry->dirty[0] + 1) != 0)
+					changed = true;
+			}
+			if (!changed)
+				return DT_SUCCESS;
 		}
+		memcpy(entry->stamped, bc.layer->areas, w*(int)bc.layer->header->height);
+		entry->built = false;
 	}
 	
 	// Build navmesh
-	status = dtBuildTileCacheRegions(m_talloc, *bc.layer, walkableClimbVx);
+	if (m_params.partitionType == DT_TILECACHE_PARTITION_WATERSHED)
+		status = dtBuildTileCacheWatershedRegions(talloc, *bc.layer, walkableClimbVx);
+	else
+		status = dtBuildTileCacheRegions(talloc, *bc.layer, walkableClimbVx);
 	if (dtStatusFailed(status))
 		return status;
 	
-	bc.lcset = dtAllocTileCacheContourSet(m_talloc);
+	bc.lcset = dtAllocTileCacheContourSet(talloc);
 	if (!bc.lcset)
 		return status;
-	status = dtBuildTileCacheContours(m_talloc, *bc.layer, walkableClimbVx,
+	status = dtBuildTileCacheContours(talloc, *bc.layer, walkableClimbVx,
 									  m_params.maxSimplificationError, *bc.lcset);
 	if (dtStatusFailed(status))
 		return status;
 	
-	bc.lmesh = dtAllocTileCachePolyMesh(m_talloc);
+	bc.lmesh = dtAllocTileCachePolyMesh(talloc);
 	if (!bc.lmesh)
 		return status;
-	status = dtBuildTileCachePolyMesh(m_talloc, *bc.lcset, *bc.lmesh);
+	status = dtBuildTileCachePolyMesh(talloc, *bc.lcset, *bc.lmesh);
 	if (dtStatusFailed(status))
 		return status;
 	
@@ -659,24 +1288,48 @@ dtStatus dtTileCache::buildNavMeshTile(const dtCompressedTileRef ref, dtNavMesh*
 		m_tmproc->process(&params, bc.lmesh->areas, bc.lmesh->flags);
 	}
 	
-	unsigned char* navData = 0;
-	int navDataSize = 0;
-	if (!dtCreateNavMeshData(&params, &navData, &navDataSize))
+	if (!dtCreateNavMeshData(&params, navData, navDataSize))
 		return DT_FAILURE;
+	
+	return DT_SUCCESS;
+}
 
+dtStatus dtTileCache::addNavMeshTileData(const dtCompressedTileRef ref, unsigned char* navData, const int navDataSize,
+										 dtNavMesh* navmesh)
+{
+	// Empty tiles leave the navmesh untouched.
+	if (!navData)
+		return DT_SUCCESS;
+	
+	const dtCompressedTile* tile = getTileByRef(ref);
+	if (!tile)
+	{
+		dtFree(navData);
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+	
 	// Remove existing tile.
+	const dtMeshTile* oldTile = navmesh->getTileAt(tile->header->tx,tile->header->ty,tile->header->tlayer);
+	const dtPolyRef oldBase = oldTile ? navmesh->getPolyRefBase(oldTile) : 0;
+	const int oldPolyCount = oldTile ? oldTile->header->polyCount : 0;
 	navmesh->removeTile(navmesh->getTileRefAt(tile->header->tx,tile->header->ty,tile->header->tlayer),0,0);
 
-	// Add new tile, or leave the location empty.
-	if (navData)
+	// Add new tile, let the navmesh own the data.
+	dtTileRef newTileRef = 0;
+	dtStatus status = navmesh->addTile(navData,navDataSize,DT_TILE_FREE_DATA,0,&newTileRef);
+	if (dtStatusFailed(status))
 	{
-		// Let the navmesh own the data.
-		status = navmesh->addTile(navData,navDataSize,DT_TILE_FREE_DATA,0,0);
-		if (dtStatusFailed(status))
-		{
-			dtFree(navData);
-			return status;
-		}
+		dtFree(navData);
+		if (m_listener && oldTile)
+			m_listener->navMeshTileReplaced(oldBase, oldPolyCount, 0, 0);
+		return status;
+	}
+	
+	if (m_listener)
+	{
+		const dtMeshTile* newTile = navmesh->getTileByRef(newTileRef);
+		m_listener->navMeshTileReplaced(oldBase, oldPolyCount,
+										navmesh->getPolyRefBase(newTile), newTile->header->polyCount);
 	}
 	
 	return DT_SUCCESS;
@@ -695,10 +1348,348 @@ void dtTileCache::calcTightTileBounds(const dtTileCacheLayerHeader* header, floa
 
 void dtTileCache::getObstacleBounds(const struct dtTileCacheObstacle* ob, float* bmin, float* bmax) const
 {
-	bmin[0] = ob->pos[0] - ob->radius;
-	bmin[1] = ob->pos[1];
-	bmin[2] = ob->pos[2] - ob->radius;
-	bmax[0] = ob->pos[0] + ob->radius;
-	bmax[1] = ob->pos[1] + ob->height;
-	bmax[2] = ob->pos[2] + ob->radius;	
+	if (ob->type == DT_OBSTACLE_CYLINDER)
+	{
+		const dtObstacleCylinder& cl = ob->cylinder;
+		bmin[0] = cl.pos[0] - cl.radius;
+		bmin[1] = cl.pos[1];
+		bmin[2] = cl.pos[2] - cl.radius;
+		bmax[0] = cl.pos[0] + cl.radius;
+		bmax[1] = cl.pos[1] + cl.height;
+		bmax[2] = cl.pos[2] + cl.radius;
+	}
+	else if (ob->type == DT_OBSTACLE_BOX)
+	{
+		dtVcopy(bmin, ob->box.bmin);
+		dtVcopy(bmax, ob->box.bmax);
+	}
+	else if (ob->type == DT_OBSTACLE_ORIENTED_BOX)
+	{
+		const dtObstacleOrientedBox& orientedBox = ob->orientedBox;
+		const float c = dtAbs(orientedBox.rotAux[0]);
+		const float s = dtAbs(orientedBox.rotAux[1]);
+		const float ex = c*orientedBox.halfExtents[0] + s*orientedBox.halfExtents[2];
+		const float ez = s*orientedBox.halfExtents[0] + c*orientedBox.halfExtents[2];
+		bmin[0] = orientedBox.center[0] - ex;
+		bmin[1] = orientedBox.center[1] - orientedBox.halfExtents[1];
+		bmin[2] = orientedBox.center[2] - ez;
+		bmax[0] = orientedBox.center[0] + ex;
+		bmax[1] = orientedBox.center[1] + orientedBox.halfExtents[1];
+		bmax[2] = orientedBox.center[2] + ez;
+	}
+}
+
+struct ArchiveTileItem
+{
+	dtTileCacheArchiveTile tile;
+	const unsigned char* data;
+	int loaded;
+};
+
+static int compareArchiveTiles(const void* va, const void* vb)
+{
+	const ArchiveTileItem* a = (const ArchiveTileItem*)va;
+	const ArchiveTileItem* b = (const ArchiveTileItem*)vb;
+	if (a->tile.ty != b->tile.ty)
+		return a->tile.ty < b->tile.ty ? -1 : 1;
+	if (a->tile.tx != b->tile.tx)
+		return a->tile.tx < b->tile.tx ? -1 : 1;
+	if (a->tile.tlayer != b->tile.tlayer)
+		return a->tile.tlayer < b->tile.tlayer ? -1 : 1;
+	// Loaded tiles first.
+	if (a->loaded != b->loaded)
+		return a->loaded > b->loaded ? -1 : 1;
+	return 0;
+}
+
+dtStatus dtTileCache::saveArchive(unsigned char** data, int* dataSize) const
+{
+	dtAssert(data);
+	dtAssert(dataSize);
+	
+	*data = 0;
+	*dataSize = 0;
+	
+	const dtTileCacheArchiveHeader* archiveHeader = (const dtTileCacheArchiveHeader*)m_archive;
+	const int narchiveTiles = m_archive ? archiveHeader->ntiles : 0;
+	const dtTileCacheArchiveTile* archiveTiles = m_archive ? (const dtTileCacheArchiveTile*)(m_archive + archiveHeader->tilesOffset) : 0;
+	
+	// Collect the loaded tiles and the tiles of the attached archive.
+	ArchiveTileItem* items = (ArchiveTileItem*)dtAlloc(sizeof(ArchiveTileItem)*dtMax(m_params.maxTiles + narchiveTiles, 1), DT_ALLOC_TEMP);
+	if (!items)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	int nitems = 0;
+	for (int i = 0; i < m_params.maxTiles; ++i)
+	{
+		const dtCompressedTile* tile = &m_tiles[i];
+		if (!tile->header)
+			continue;
+		ArchiveTileItem& item = items[nitems++];
+		item.tile.tx = tile->header->tx;
+		item.tile.ty = tile->header->ty;
+		item.tile.tlayer = tile->header->tlayer;
+		item.tile.dataOffset = 0;
+		item.tile.dataSize = tile->dataSize;
+		item.data = tile->data;
+		item.loaded = 1;
+	}
+	for (int i = 0; i < narchiveTiles; ++i)
+	{
+		ArchiveTileItem& item = items[nitems++];
+		item.tile = archiveTiles[i];
+		item.data = m_archive + archiveTiles[i].dataOffset;
+		item.loaded = 0;
+	}
+	
+	// Sort by location, and drop the archive tiles which are loaded.
+	qsort(items, nitems, sizeof(ArchiveTileItem), compareArchiveTiles);
+	int ntiles = 0;
+	for (int i = 0; i < nitems; ++i)
+	{
+		if (ntiles > 0 &&
+			items[ntiles-1].tile.tx == items[i].tile.tx &&
+			items[ntiles-1].tile.ty == items[i].tile.ty &&
+			items[ntiles-1].tile.tlayer == items[i].tile.tlayer)
+			continue;
+		items[ntiles++] = items[i];
+	}
+	
+	// Obstacles which are removed are not written.
+	int nobstacles = 0;
+	for (int i = 0; i < m_params.maxObstacles; ++i)
+	{
+		const dtTileCacheObstacle* ob = &m_obstacles[i];
+		if (ob->state == DT_OBSTACLE_EMPTY || ob->state == DT_OBSTACLE_REMOVING)
+			continue;
+		if (m_obstacleReqs[i] != -1 && m_reqs[m_obstacleReqs[i]].action == REQUEST_REMOVE)
+			continue;
+		nobstacles++;
+	}
+	
+	// Layout: header, tile table, obstacles and tile data.
+	const int headerSize = dtAlign4(sizeof(dtTileCacheArchiveHeader));
+	const int tilesSize = dtAlign4(sizeof(dtTileCacheArchiveTile)*ntiles);
+	const int obstaclesSize = dtAlign4(sizeof(dtTileCacheArchiveObstacle)*nobstacles);
+	int size = headerSize + tilesSize + obstaclesSize;
+	for (int i = 0; i < ntiles; ++i)
+	{
+		items[i].tile.dataOffset = size;
+		size += dtAlign4(items[i].tile.dataSize);
+	}
+	
+	unsigned char* archive = (unsigned char*)dtAlloc(size, DT_ALLOC_PERM);
+	if (!archive)
+	{
+		dtFree(items);
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+	memset(archive, 0, size);
+	
+	dtTileCacheArchiveHeader* header = (dtTileCacheArchiveHeader*)archive;
+	header->magic = DT_TILECACHE_ARCHIVE_MAGIC;
+	header->version = DT_TILECACHE_ARCHIVE_VERSION;
+	header->dataSize = size;
+	header->ntiles = ntiles;
+	header->nobstacles = nobstacles;
+	header->tilesOffset = headerSize;
+	header->obstaclesOffset = headerSize + tilesSize;
+	memcpy(&header->params, &m_params, sizeof(dtTileCacheParams));
+	
+	dtTileCacheArchiveTile* tiles = (dtTileCacheArchiveTile*)(archive + header->tilesOffset);
+	for (int i = 0; i < ntiles; ++i)
+	{
+		tiles[i] = items[i].tile;
+		memcpy(archive + items[i].tile.dataOffset, items[i].data, items[i].tile.dataSize);
+	}
+	dtFree(items);
+	
+	dtTileCacheArchiveObstacle* obstacles = (dtTileCacheArchiveObstacle*)(archive + header->obstaclesOffset);
+	int n = 0;
+	for (int i = 0; i < m_params.maxObstacles; ++i)
+	{
+		const dtTileCacheObstacle* ob = &m_obstacles[i];
+		if (ob->state == DT_OBSTACLE_EMPTY || ob->state == DT_OBSTACLE_REMOVING)
+			continue;
+		if (m_obstacleReqs[i] != -1 && m_reqs[m_obstacleReqs[i]].action == REQUEST_REMOVE)
+			continue;
+		dtTileCacheArchiveObstacle& aob = obstacles[n++];
+		aob.ref = getObstacleRef(ob);
+		aob.type = ob->type;
+		if (ob->type == DT_OBSTACLE_CYLINDER)
+			aob.cylinder = ob->cylinder;
+		else if (ob->type == DT_OBSTACLE_BOX)
+			aob.box = ob->box;
+		else if (ob->type == DT_OBSTACLE_ORIENTED_BOX)
+			aob.orientedBox = ob->orientedBox;
+	}
+	
+	*data = archive;
+	*dataSize = size;
+	
+	return DT_SUCCESS;
+}
+
+dtStatus dtTileCache::setArchive(const unsigned char* data, const int dataSize)
+{
+	if (!data || dataSize < (int)sizeof(dtTileCacheArchiveHeader))
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	const dtTileCacheArchiveHeader* header = (const dtTileCacheArchiveHeader*)data;
+	if (header->magic != DT_TILECACHE_ARCHIVE_MAGIC)
+		return DT_FAILURE | DT_WRONG_MAGIC;
+	if (header->version != DT_TILECACHE_ARCHIVE_VERSION)
+		return DT_FAILURE | DT_WRONG_VERSION;
+	if (header->dataSize > dataSize || header->ntiles < 0 || header->nobstacles < 0 ||
+		header->tilesOffset < 0 || header->obstaclesOffset < 0 ||
+		header->ntiles > (dataSize - header->tilesOffset) / (int)sizeof(dtTileCacheArchiveTile) ||
+		header->nobstacles > (dataSize - header->obstaclesOffset) / (int)sizeof(dtTileCacheArchiveObstacle))
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	// The tiles must line up with the tiles of the cache.
+	const dtTileCacheParams& params = header->params;
+	if (!dtVequal(params.orig, m_params.orig) || params.cs != m_params.cs || params.ch != m_params.ch ||
+		params.width != m_params.width || params.height != m_params.height)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	// Check that the obstacles can be restored before restoring any.
+	const dtTileCacheArchiveObstacle* obstacles = (const dtTileCacheArchiveObstacle*)(data + header->obstaclesOffset);
+	for (int i = 0; i < header->nobstacles; ++i)
+	{
+		const unsigned int idx = decodeObstacleIdObstacle(obstacles[i].ref);
+		if ((int)idx >= m_params.maxObstacles || decodeObstacleIdSalt(obstacles[i].ref) == 0)
+			return DT_FAILURE | DT_INVALID_PARAM;
+		if (m_obstacles[idx].state != DT_OBSTACLE_EMPTY || m_obstacleReqs[idx] != -1)
+			return DT_FAILURE | DT_INVALID_PARAM;
+		if (obstacles[i].type > DT_OBSTACLE_ORIENTED_BOX)
+			return DT_FAILURE | DT_INVALID_PARAM;
+	}
+	
+	m_archive = data;
+	m_archiveSize = dataSize;
+	
+	// Restore the obstacles, they are added to the tiles loaded by the next update.
+	for (int i = 0; i < header->nobstacles; ++i)
+	{
+		const dtTileCacheArchiveObstacle& aob = obstacles[i];
+		dtTileCacheObstacle* ob = &m_obstacles[decodeObstacleIdObstacle(aob.ref)];
+		if (ob->state != DT_OBSTACLE_EMPTY)
+			continue;
+		resetObstacle(ob);
+		ob->salt = (unsigned short)decodeObstacleIdSalt(aob.ref);
+		ob->type = aob.type;
+		if (aob.type == DT_OBSTACLE_CYLINDER)
+			ob->cylinder = aob.cylinder;
+		else if (aob.type == DT_OBSTACLE_BOX)
+			ob->box = aob.box;
+		else if (aob.type == DT_OBSTACLE_ORIENTED_BOX)
+			ob->orientedBox = aob.orientedBox;
+		requestAddObstacle(ob, 0);
+	}
+	
+	// Rebuild the free list without the restored obstacles.
+	m_nextFreeObstacle = 0;
+	for (int i = m_params.maxObstacles-1; i >= 0; --i)
+	{
+		if (m_obstacles[i].state != DT_OBSTACLE_EMPTY)
+			continue;
+		m_obstacles[i].next = m_nextFreeObstacle;
+		m_nextFreeObstacle = &m_obstacles[i];
+	}
+	
+	return DT_SUCCESS;
+}
+
+dtStatus dtTileCache::loadArchiveTiles(const float* bmin, const float* bmax,
+									   dtCompressedTileRef* results, int* resultCount, const int maxResults)
+{
+	*resultCount = 0;
+	if (!m_archive)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	const dtTileCacheArchiveHeader* header = (const dtTileCacheArchiveHeader*)m_archive;
+	const dtTileCacheArchiveTile* tiles = (const dtTileCacheArchiveTile*)(m_archive + header->tilesOffset);
+	const int ntiles = header->ntiles;
+	
+	const float tw = m_params.width * m_params.cs;
+	const float th = m_params.height * m_params.cs;
+	const int tx0 = (int)floorf((bmin[0]-m_params.orig[0]) / tw);
+	const int tx1 = (int)floorf((bmax[0]-m_params.orig[0]) / tw);
+	const int ty0 = (int)floorf((bmin[2]-m_params.orig[2]) / th);
+	const int ty1 = (int)floorf((bmax[2]-m_params.orig[2]) / th);
+	
+	dtStatus status = DT_SUCCESS;
+	float lbmin[3], lbmax[3];
+	dtVset(lbmin, FLT_MAX, FLT_MAX, FLT_MAX);
+	dtVset(lbmax, -FLT_MAX, -FLT_MAX, -FLT_MAX);
+	int n = 0;
+	
+	for (int ty = ty0; ty <= ty1 && status == DT_SUCCESS; ++ty)
+	{
+		// Find the first tile of the row in the sorted table.
+		int lo = 0, hi = ntiles;
+		while (lo < hi)
+		{
+			const int mid = (lo + hi) / 2;
+			if (tiles[mid].ty < ty || (tiles[mid].ty == ty && tiles[mid].tx < tx0))
+				lo = mid+1;
+			else
+				hi = mid;
+		}
+		
+		for (int i = lo; i < ntiles && tiles[i].ty == ty && tiles[i].tx <= tx1; ++i)
+		{
+			const dtTileCacheArchiveTile& at = tiles[i];
+			if (getTileAt(at.tx, at.ty, at.tlayer))
+				continue;
+			if (n >= maxResults)
+			{
+				status |= DT_BUFFER_TOO_SMALL;
+				break;
+			}
+			if (at.dataOffset < 0 || at.dataSize < (int)sizeof(dtTileCacheLayerHeader) ||
+				at.dataOffset > m_archiveSize - at.dataSize)
+			{
+				status = DT_FAILURE | DT_INVALID_PARAM;
+				break;
+			}
+			
+			// The archive owns the data.
+			dtCompressedTileRef ref = 0;
+			dtStatus addStatus = addTile((unsigned char*)m_archive + at.dataOffset, at.dataSize, 0, &ref);
+			if (dtStatusFailed(addStatus))
+			{
+				status = addStatus;
+				break;
+			}
+			results[n++] = ref;
+			
+			const dtTileCacheLayerHeader* lh = getTileByRef(ref)->header;
+			dtVmin(lbmin, lh->bmin);
+			dtVmax(lbmax, lh->bmax);
+		}
+	}
+	*resultCount = n;
+	
+	if (n == 0)
+		return status;
+	
+	// Find the new tiles touched by the obstacles which are already added.
+	lbmin[1] -= m_params.walkableClimb + m_params.ch;
+	for (int i = 0; i < m_params.maxObstacles; ++i)
+	{
+		dtTileCacheObstacle* ob = &m_obstacles[i];
+		if (ob->state != DT_OBSTACLE_PROCESSING && ob->state != DT_OBSTACLE_PROCESSED)
+			continue;
+		if (m_obstacleReqs[i] != -1)
+			continue;
+		float obmin[3], obmax[3];
+		getObstacleBounds(ob, obmin, obmax);
+		if (!dtOverlapBounds(obmin, obmax, lbmin, lbmax))
+			continue;
+		dtStatus queryStatus = queryObstacleTiles(ob);
+		if (dtStatusFailed(queryStatus))
+			status = queryStatus;
+	}
+	
+	return status;
 }
@@ -383,6 +383,720 @@ dtStatus dtBuildTileCacheRegions(dtTileCacheAlloc* alloc,
 }
 
 
+static const int DT_LAYER_EXPAND_ITERS = 8;
+static const int DT_LAYER_MAX_SPLIT_PASSES = 8;
+
+struct dtLayerWatershedRegion
+{
+	int area;
+	unsigned short neis[DT_LAYER_MAX_NEIS];
+	unsigned short nborder[DT_LAYER_MAX_NEIS];	// Length of the border shared with each neighbour.
+	unsigned char nneis;
+	unsigned short parent;
+};
+
+inline int getLayerNeighbour(const dtTileCacheLayer& layer, const int x, const int y, const int dir,
+							 const int walkableClimb)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	const int nx = x + getDirOffsetX(dir);
+	const int ny = y + getDirOffsetY(dir);
+	if (nx < 0 || ny < 0 || nx >= w || ny >= h)
+		return -1;
+	const int ib = nx + ny*w;
+	if (!isConnected(layer, x + y*w, ib, walkableClimb))
+		return -1;
+	return ib;
+}
+
+static void calcLayerDistanceField(const dtTileCacheLayer& layer, const int walkableClimb,
+								   unsigned short* dist, unsigned short& maxDist)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	
+	// Mark boundary cells.
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			const int idx = x + y*w;
+			int nc = 0;
+			if (layer.areas[idx] != DT_TILECACHE_NULL_AREA)
+			{
+				for (int dir = 0; dir < 4; ++dir)
+					if (getLayerNeighbour(layer, x, y, dir, walkableClimb) != -1)
+						nc++;
+			}
+			dist[idx] = nc == 4 ? 0xffff : 0;
+		}
+	}
+	
+	// Pass 1, the diagonal is reached through the straight neighbour.
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			const int idx = x + y*w;
+			if (!dist[idx])
+				continue;
+			for (int i = 0; i < 2; ++i)
+			{
+				const int dir = i == 0 ? 0 : 3;
+				const int ai = getLayerNeighbour(layer, x, y, dir, walkableClimb);
+				if (ai == -1)
+					continue;
+				if (dist[ai]+2 < dist[idx])
+					dist[idx] = (unsigned short)(dist[ai]+2);
+				const int aai = getLayerNeighbour(layer, x + getDirOffsetX(dir), y + getDirOffsetY(dir),
+												  (dir+3)&3, walkableClimb);
+				if (aai != -1 && dist[aai]+3 < dist[idx])
+					dist[idx] = (unsigned short)(dist[aai]+3);
+			}
+		}
+	}
+	
+	// Pass 2
+	maxDist = 0;
+	for (int y = h-1; y >= 0; --y)
+	{
+		for (int x = w-1; x >= 0; --x)
+		{
+			const int idx = x + y*w;
+			if (!dist[idx])
+				continue;
+			for (int i = 0; i < 2; ++i)
+			{
+				const int dir = i == 0 ? 2 : 1;
+				const int ai = getLayerNeighbour(layer, x, y, dir, walkableClimb);
+				if (ai == -1)
+					continue;
+				if (dist[ai]+2 < dist[idx])
+					dist[idx] = (unsigned short)(dist[ai]+2);
+				const int aai = getLayerNeighbour(layer, x + getDirOffsetX(dir), y + getDirOffsetY(dir),
+												  (dir+3)&3, walkableClimb);
+				if (aai != -1 && dist[aai]+3 < dist[idx])
+					dist[idx] = (unsigned short)(dist[aai]+3);
+			}
+			maxDist = dtMax(maxDist, dist[idx]);
+		}
+	}
+}
+
+static void blurLayerDistanceField(const dtTileCacheLayer& layer, const int walkableClimb,
+								   const unsigned short* src, unsigned short* dst)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	const int thr = 2;
+	
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			const int idx = x + y*w;
+			const int cd = (int)src[idx];
+			if (cd <= thr)
+			{
+				dst[idx] = (unsigned short)cd;
+				continue;
+			}
+			
+			int d = cd;
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				const int ai = getLayerNeighbour(layer, x, y, dir, walkableClimb);
+				if (ai == -1)
+				{
+					d += cd*2;
+					continue;
+				}
+				d += (int)src[ai];
+				const int ai2 = getLayerNeighbour(layer, x + getDirOffsetX(dir), y + getDirOffsetY(dir),
+												  (dir+1)&3, walkableClimb);
+				d += ai2 != -1 ? (int)src[ai2] : cd;
+			}
+			dst[idx] = (unsigned short)((d+5)/9);
+		}
+	}
+}
+
+static bool floodLayerRegion(const dtTileCacheLayer& layer, const int walkableClimb, const int start,
+							 const unsigned short level, const unsigned short r, const unsigned short* dist,
+							 unsigned short* srcReg, unsigned short* srcDist, unsigned short* stack)
+{
+	const int w = (int)layer.header->width;
+	
+	int nstack = 0;
+	stack[nstack++] = (unsigned short)start;
+	srcReg[start] = r;
+	srcDist[start] = 0;
+	
+	const unsigned short lev = level >= 2 ? level-2 : 0;
+	int count = 0;
+	
+	while (nstack > 0)
+	{
+		const int ci = stack[--nstack];
+		const int cx = ci % w;
+		const int cy = ci / w;
+		
+		// Do not grow into cells which already touch another region, including diagonals.
+		unsigned short ar = 0;
+		for (int dir = 0; dir < 4; ++dir)
+		{
+			const int ai = getLayerNeighbour(layer, cx, cy, dir, walkableClimb);
+			if (ai == -1)
+				continue;
+			if (srcReg[ai] != 0 && srcReg[ai] != r)
+				ar = srcReg[ai];
+			const int ai2 = getLayerNeighbour(layer, cx + getDirOffsetX(dir), cy + getDirOffsetY(dir),
+											  (dir+1)&3, walkableClimb);
+			if (ai2 != -1 && srcReg[ai2] != 0 && srcReg[ai2] != r)
+				ar = srcReg[ai2];
+		}
+		if (ar != 0)
+		{
+			srcReg[ci] = 0;
+			continue;
+		}
+		count++;
+		
+		for (int dir = 0; dir < 4; ++dir)
+		{
+			const int ai = getLayerNeighbour(layer, cx, cy, dir, walkableClimb);
+			if (ai == -1)
+				continue;
+			if (dist[ai] >= lev && srcReg[ai] == 0)
+			{
+				srcReg[ai] = r;
+				srcDist[ai] = 0;
+				stack[nstack++] = (unsigned short)ai;
+			}
+		}
+	}
+	
+	return count > 0;
+}
+
+static void expandLayerRegions(const dtTileCacheLayer& layer, const int walkableClimb, const int maxIter,
+							   const unsigned short level, const unsigned short* dist,
+							   unsigned short*& srcReg, unsigned short*& srcDist,
+							   unsigned short*& dstReg, unsigned short*& dstDist, unsigned short* stack)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	const unsigned short used = 0xffff;
+	
+	// Find cells revealed by the raised level.
+	int nstack = 0;
+	for (int i = 0; i < w*h; ++i)
+	{
+		if (dist[i] >= level && srcReg[i] == 0 && layer.areas[i] != DT_TILECACHE_NULL_AREA)
+			stack[nstack++] = (unsigned short)i;
+	}
+	
+	int iter = 0;
+	while (nstack > 0)
+	{
+		int failed = 0;
+		
+		memcpy(dstReg, srcReg, sizeof(unsigned short)*w*h);
+		memcpy(dstDist, srcDist, sizeof(unsigned short)*w*h);
+		
+		for (int j = 0; j < nstack; ++j)
+		{
+			const int i = stack[j];
+			if (i == used)
+			{
+				failed++;
+				continue;
+			}
+			
+			const int x = i % w;
+			const int y = i / w;
+			unsigned short r = srcReg[i];
+			unsigned short d2 = 0xffff;
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				const int ai = getLayerNeighbour(layer, x, y, dir, walkableClimb);
+				if (ai == -1 || srcReg[ai] == 0)
+					continue;
+				if ((int)srcDist[ai]+2 < (int)d2)
+				{
+					r = srcReg[ai];
+					d2 = (unsigned short)(srcDist[ai]+2);
+				}
+			}
+			if (r)
+			{
+				stack[j] = used;
+				dstReg[i] = r;
+				dstDist[i] = d2;
+			}
+			else
+			{
+				failed++;
+			}
+		}
+		
+		dtSwap(srcReg, dstReg);
+		dtSwap(srcDist, dstDist);
+		
+		if (failed == nstack)
+			break;
+		
+		if (level > 0)
+		{
+			++iter;
+			if (iter >= maxIter)
+				break;
+		}
+	}
+}
+
+static void addLayerRegionBorder(dtLayerWatershedRegion& reg, const unsigned short nei)
+{
+	for (int i = 0; i < (int)reg.nneis; ++i)
+	{
+		if (reg.neis[i] == nei)
+		{
+			reg.nborder[i]++;
+			return;
+		}
+	}
+	if (reg.nneis < DT_LAYER_MAX_NEIS)
+	{
+		reg.neis[reg.nneis] = nei;
+		reg.nborder[reg.nneis] = 1;
+		reg.nneis++;
+	}
+}
+
+inline unsigned short findLayerRegion(dtLayerWatershedRegion* regs, unsigned short r)
+{
+	while (regs[r].parent != r)
+		r = regs[r].parent;
+	return r;
+}
+
+static bool mergeLayerRegions(dtTileCacheAlloc* alloc, const dtTileCacheLayer& layer, const int walkableClimb,
+							  unsigned short* srcReg, const int nregs, const int mergeRegionArea)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	
+	dtFixedArray<dtLayerWatershedRegion> regs(alloc, nregs);
+	if (!regs)
+		return false;
+	memset(regs, 0, sizeof(dtLayerWatershedRegion)*nregs);
+	for (int i = 0; i < nregs; ++i)
+		regs[i].parent = (unsigned short)i;
+	
+	// Find region sizes and shared borders.
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			const int idx = x + y*w;
+			const unsigned short ri = srcReg[idx];
+			if (ri == 0)
+				continue;
+			regs[ri].area++;
+			for (int dir = 0; dir < 4; dir += 3)
+			{
+				const int ai = getLayerNeighbour(layer, x, y, dir, walkableClimb);
+				if (ai == -1 || srcReg[ai] == 0 || srcReg[ai] == ri)
+					continue;
+				addLayerRegionBorder(regs[ri], srcReg[ai]);
+				addLayerRegionBorder(regs[srcReg[ai]], ri);
+			}
+		}
+	}
+	
+	// Merge small regions to the neighbour they share the longest border with.
+	for (int i = 1; i < nregs; ++i)
+	{
+		dtLayerWatershedRegion& reg = regs[i];
+		if (reg.parent != i || reg.area >= mergeRegionArea)
+			continue;
+		int merge = -1;
+		int mergeBorder = 0;
+		for (int j = 0; j < (int)reg.nneis; ++j)
+		{
+			const unsigned short nei = findLayerRegion(regs, reg.neis[j]);
+			if (nei == i)
+				continue;
+			if ((int)reg.nborder[j] > mergeBorder)
+			{
+				mergeBorder = (int)reg.nborder[j];
+				merge = (int)nei;
+			}
+		}
+		if (merge != -1)
+		{
+			reg.parent = (unsigned short)merge;
+			regs[merge].area += reg.area;
+		}
+	}
+	
+	for (int i = 0; i < w*h; ++i)
+	{
+		if (srcReg[i] != 0)
+			srcReg[i] = findLayerRegion(regs, srcReg[i]);
+	}
+	
+	return true;
+}
+
+static unsigned short getLayerRegionNeighbour(const dtTileCacheLayer& layer, const unsigned short* srcReg,
+											  const int x, const int y, const int dir)
+{
+	const int w = (int)layer.header->width;
+	if ((layer.cons[x + y*w] & (1<<dir)) == 0)
+		return 0;
+	return srcReg[(x + getDirOffsetX(dir)) + (y + getDirOffsetY(dir))*w];
+}
+
+// Returns the number of region edges visited by tracing the contour the same way
+// dtBuildTileCacheContours does, or -1 if the walk does not return to the start.
+static int countLayerContourEdges(const dtTileCacheLayer& layer, const unsigned short* srcReg, int x, int y)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	const unsigned short r = srcReg[x + y*w];
+	
+	int startDir = -1;
+	for (int i = 0; i < 4; ++i)
+	{
+		const int dir = (i+3)&3;
+		if (getLayerRegionNeighbour(layer, srcReg, x, y, dir) != r)
+		{
+			startDir = dir;
+			break;
+		}
+	}
+	if (startDir == -1)
+		return 0;
+	
+	const int startX = x;
+	const int startY = y;
+	int dir = startDir;
+	int n = 0;
+	for (int iter = 0; iter < w*h*4; ++iter)
+	{
+		if (getLayerRegionNeighbour(layer, srcReg, x, y, dir) != r)
+		{
+			n++;
+			dir = (dir+1) & 0x3;
+		}
+		else
+		{
+			x += getDirOffsetX(dir);
+			y += getDirOffsetY(dir);
+			dir = (dir+3) & 0x3;
+		}
+		if (x == startX && y == startY && dir == startDir)
+			return n;
+	}
+	return -1;
+}
+
+// Gives each part of the region which is connected the way the contour is traced a new id.
+static bool relabelLayerRegionParts(const dtTileCacheLayer& layer, unsigned short* srcReg,
+									const unsigned short r, unsigned short& nextId, unsigned short* stack)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	
+	for (int i = 0; i < w*h; ++i)
+	{
+		if (srcReg[i] != r)
+			continue;
+		if (nextId > 255)
+			return false;
+		const unsigned short id = nextId++;
+		int nstack = 0;
+		stack[nstack++] = (unsigned short)i;
+		srcReg[i] = id;
+		while (nstack > 0)
+		{
+			const int ci = stack[--nstack];
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				if (getLayerRegionNeighbour(layer, srcReg, ci % w, ci / w, dir) != r)
+					continue;
+				const int ai = (ci % w + getDirOffsetX(dir)) + (ci / w + getDirOffsetY(dir))*w;
+				srcReg[ai] = id;
+				stack[nstack++] = (unsigned short)ai;
+			}
+		}
+	}
+	return true;
+}
+
+// Splits a region which cannot be traced as a single contour. The region is cut
+// along the top row of its topmost hole, which opens the hole, and the parts
+// are given new ids. Returns false if the region could not be split.
+static bool splitLayerRegion(const dtTileCacheLayer& layer, unsigned short* srcReg, const unsigned short r,
+							 unsigned short& nextId, unsigned short* mark, unsigned short* stack)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	
+	// Region bounds.
+	int minx = w, miny = h, maxx = -1, maxy = -1;
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			if (srcReg[x + y*w] != r)
+				continue;
+			minx = dtMin(minx, x);
+			miny = dtMin(miny, y);
+			maxx = dtMax(maxx, x);
+			maxy = dtMax(maxy, y);
+		}
+	}
+	if (maxx == -1)
+		return true;
+	const int bw = maxx - minx + 1;
+	const int bh = maxy - miny + 1;
+	
+	// Flood the outside of the region, starting from the cells at the bounds.
+	memset(mark, 0, sizeof(unsigned short)*bw*bh);
+	int nstack = 0;
+	for (int y = 0; y < bh; ++y)
+	{
+		for (int x = 0; x < bw; ++x)
+		{
+			if (x != 0 && y != 0 && x != bw-1 && y != bh-1)
+				continue;
+			if (srcReg[(minx+x) + (miny+y)*w] == r)
+				continue;
+			mark[x + y*bw] = 1;
+			stack[nstack++] = (unsigned short)(x + y*bw);
+		}
+	}
+	while (nstack > 0)
+	{
+		const int ci = stack[--nstack];
+		const int cx = ci % bw;
+		const int cy = ci / bw;
+		for (int dir = 0; dir < 4; ++dir)
+		{
+			const int ax = cx + getDirOffsetX(dir);
+			const int ay = cy + getDirOffsetY(dir);
+			if (ax < 0 || ay < 0 || ax >= bw || ay >= bh)
+				continue;
+			const int ai = ax + ay*bw;
+			if (mark[ai] || srcReg[(minx+ax) + (miny+ay)*w] == r)
+				continue;
+			mark[ai] = 1;
+			stack[nstack++] = (unsigned short)ai;
+		}
+	}
+	
+	// Find the top row of the topmost hole.
+	int holeY = -1;
+	for (int y = 0; y < bh && holeY == -1; ++y)
+	{
+		for (int x = 0; x < bw; ++x)
+		{
+			if (!mark[x + y*bw] && srcReg[(minx+x) + (miny+y)*w] != r)
+			{
+				holeY = miny + y;
+				break;
+			}
+		}
+	}
+	
+	if (holeY != -1)
+	{
+		if (nextId > 255)
+			return false;
+		const unsigned short below = nextId++;
+		for (int y = holeY; y <= maxy; ++y)
+		{
+			for (int x = minx; x <= maxx; ++x)
+			{
+				if (srcReg[x + y*w] == r)
+					srcReg[x + y*w] = below;
+			}
+		}
+		return relabelLayerRegionParts(layer, srcReg, r, nextId, stack) &&
+			   relabelLayerRegionParts(layer, srcReg, below, nextId, stack);
+	}
+	
+	// No holes, the region is split by missing connections.
+	const unsigned short firstId = nextId;
+	if (!relabelLayerRegionParts(layer, srcReg, r, nextId, stack))
+		return false;
+	return nextId - firstId > 1;
+}
+
+// Remaps region ids to 1..n, returns n. The remap table is indexed by the old region id.
+static int compactLayerRegions(unsigned short* srcReg, const int ncells, unsigned short* remap, const int nregs)
+{
+	memset(remap, 0, sizeof(unsigned short)*nregs);
+	for (int i = 0; i < ncells; ++i)
+		remap[srcReg[i]] = 1;
+	remap[0] = 0;
+	int n = 0;
+	for (int i = 1; i < nregs; ++i)
+	{
+		if (remap[i])
+			remap[i] = (unsigned short)(++n);
+	}
+	for (int i = 0; i < ncells; ++i)
+		srcReg[i] = remap[srcReg[i]];
+	return n;
+}
+
+/// @par
+///
+/// The walkable area is partitioned using a watershed of the distance to the
+/// layer boundary, so the regions follow the open areas of the layer instead of
+/// the sweep direction of #dtBuildTileCacheRegions. The contours are traced
+/// once per region, so regions with holes are cut until they have none.
+/// If the layer would need more than 255 regions, the monotone partition is used.
+dtStatus dtBuildTileCacheWatershedRegions(dtTileCacheAlloc* alloc,
+										  dtTileCacheLayer& layer,
+										  const int walkableClimb)
+{
+	dtAssert(alloc);
+	
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	const int ncells = w*h;
+	
+	dtFixedArray<unsigned short> buf(alloc, ncells*6);
+	if (!buf)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
+	unsigned short* dist = buf;
+	unsigned short* srcReg = buf + ncells;
+	unsigned short* srcDist = buf + ncells*2;
+	unsigned short* dstReg = buf + ncells*3;
+	unsigned short* dstDist = buf + ncells*4;
+	unsigned short* stack = buf + ncells*5;
+	
+	unsigned short maxDist = 0;
+	calcLayerDistanceField(layer, walkableClimb, dstReg, maxDist);
+	blurLayerDistanceField(layer, walkableClimb, dstReg, dist);
+	
+	memset(srcReg, 0, sizeof(unsigned short)*ncells);
+	memset(srcDist, 0, sizeof(unsigned short)*ncells);
+	
+	unsigned short regId = 1;
+	unsigned short level = (unsigned short)((maxDist+1) & ~1);
+	
+	while (level > 0)
+	{
+		level = level >= 2 ? level-2 : 0;
+		
+		// Expand current regions until no empty connected cells found.
+		expandLayerRegions(layer, walkableClimb, DT_LAYER_EXPAND_ITERS, level, dist,
+						   srcReg, srcDist, dstReg, dstDist, stack);
+		
+		// Mark new regions with IDs.
+		for (int i = 0; i < ncells; ++i)
+		{
+			if (dist[i] < level || srcReg[i] != 0 || layer.areas[i] == DT_TILECACHE_NULL_AREA)
+				continue;
+			if (floodLayerRegion(layer, walkableClimb, i, level, regId, dist, srcReg, srcDist, stack))
+				regId++;
+		}
+	}
+	
+	expandLayerRegions(layer, walkableClimb, DT_LAYER_EXPAND_ITERS*8, 0, dist,
+					   srcReg, srcDist, dstReg, dstDist, stack);
+	
+	// Cells which were rejected by the flood fill and not reached by the expansion.
+	for (int i = 0; i < ncells; ++i)
+	{
+		if (srcReg[i] != 0 || layer.areas[i] == DT_TILECACHE_NULL_AREA)
+			continue;
+		int nstack = 0;
+		stack[nstack++] = (unsigned short)i;
+		srcReg[i] = regId;
+		while (nstack > 0)
+		{
+			const int ci = stack[--nstack];
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				const int ai = getLayerNeighbour(layer, ci % w, ci / w, dir, walkableClimb);
+				if (ai != -1 && srcReg[ai] == 0)
+				{
+					srcReg[ai] = regId;
+					stack[nstack++] = (unsigned short)ai;
+				}
+			}
+		}
+		regId++;
+	}
+	
+	// Small regions add vertices to the contours, merge regions smaller than a quarter of the layer.
+	if (!mergeLayerRegions(alloc, layer, walkableClimb, srcReg, (int)regId, ncells/4))
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
+	// The distance buffers are free now, the remap table may span dstReg and dstDist.
+	int nregs = compactLayerRegions(srcReg, ncells, dstReg, (int)regId);
+	
+	// Split regions which cannot be traced as a single contour.
+	bool valid = nregs <= 255;
+	for (int pass = 0; pass < DT_LAYER_MAX_SPLIT_PASSES && valid; ++pass)
+	{
+		int edges[256];
+		int first[256];
+		memset(edges, 0, sizeof(int)*(nregs+1));
+		for (int i = 0; i <= nregs; ++i)
+			first[i] = -1;
+		for (int y = 0; y < h; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				const int idx = x + y*w;
+				const unsigned short ri = srcReg[idx];
+				if (ri == 0)
+					continue;
+				if (first[ri] == -1)
+					first[ri] = idx;
+				for (int dir = 0; dir < 4; ++dir)
+					if (getLayerRegionNeighbour(layer, srcReg, x, y, dir) != ri)
+						edges[ri]++;
+			}
+		}
+		
+		bool split = false;
+		unsigned short nextId = (unsigned short)(nregs+1);
+		for (int r = 1; r <= nregs && valid; ++r)
+		{
+			if (first[r] == -1)
+				continue;
+			if (countLayerContourEdges(layer, srcReg, first[r] % w, first[r] / w) == edges[r])
+				continue;
+			if (pass == DT_LAYER_MAX_SPLIT_PASSES-1 ||
+				!splitLayerRegion(layer, srcReg, (unsigned short)r, nextId, dstDist, stack))
+				valid = false;
+			split = true;
+		}
+		if (!split || !valid)
+			break;
+		nregs = compactLayerRegions(srcReg, ncells, dstReg, (int)nextId);
+	}
+	
+	if (!valid)
+		return dtBuildTileCacheRegions(alloc, layer, walkableClimb);
+	
+	for (int i = 0; i < ncells; ++i)
+		layer.regs[i] = srcReg[i] ? (unsigned char)(srcReg[i]-1) : 0xff;
+	layer.regCount = (unsigned char)nregs;
+	
+	return DT_SUCCESS;
+}
+
 
 static bool appendVertex(dtTempContour& cont, const int x, const int y, const int z, const int r)
 {
@@ -1948,6 +2662,46 @@ dtStatus dtBuildTileCachePolyMesh(dtTileCacheAlloc* alloc,
 	return DT_SUCCESS;
 }
 
+// Marks the cells of a row span which are within the height range.
+inline void markSpan(dtTileCacheLayer& layer, const int row, const int x0, const int x1,
+					 const int miny, const int maxy, const unsigned char areaId)
+{
+	const unsigned char* heights = layer.heights + row;
+	unsigned char* areas = layer.areas + row;
+	for (int x = x0; x <= x1; ++x)
+	{
+		const int y = heights[x];
+		areas[x] = (y >= miny && y <= maxy) ? areaId : areas[x];
+	}
+}
+
+// Rotates the cell offset into the box space and tests it against the half extents.
+inline bool insideOrientedBox(const float dx, const float dz, const float c, const float s,
+							  const float hx, const float hz)
+{
+	const float lx = dx*c - dz*s;
+	const float lz = dx*s + dz*c;
+	return lx >= -hx && lx <= hx && lz >= -hz && lz <= hz;
+}
+
+// Clips the range [dx0,dx1] to where -h <= dx*k - m <= h, padded by a cell.
+static bool clipBoxSpan(const float k, const float m, const float h, float& dx0, float& dx1)
+{
+	const float ak = dtAbs(k);
+	if (ak < 1e-3f)
+	{
+		// Nearly parallel to the row, test the whole range.
+		return dtAbs(m) <= h + ak*dtMax(dtAbs(dx0), dtAbs(dx1)) + 1.0f;
+	}
+	float a = (m - h) / k;
+	float b = (m + h) / k;
+	if (a > b)
+		dtSwap(a, b);
+	dx0 = dtMax(dx0, a - 1.0f);
+	dx1 = dtMin(dx1, b + 1.0f);
+	return dx0 <= dx1;
+}
+
 dtStatus dtMarkCylinderArea(dtTileCacheLayer& layer, const float* orig, const float cs, const float ch,
 							const float* pos, const float radius, const float height, const unsigned char areaId)
 {
@@ -1987,17 +2741,111 @@ dtStatus dtMarkCylinderArea(dtTileCacheLayer& layer, const float* orig, const fl
 	
 	for (int z = minz; z <= maxz; ++z)
 	{
-		for (int x = minx; x <= maxx; ++x)
-		{
-			const float dx = (float)(x+0.5f) - px;
-			const float dz = (float)(z+0.5f) - pz;
-			if (dx*dx + dz*dz > r2)
-				continue;
-			const int y = layer.heights[x+z*w];
-			if (y < miny || y > maxy)
-				continue;
-			layer.areas[x+z*w] = areaId;
-		}
+		const float dz = (float)(z+0.5f) - pz;
+		const float dz2 = dz*dz;
+		if (dz2 > r2)
+			continue;
+		// Find the cells inside the circle, the estimate is padded by a cell
+		// and trimmed using the exact test.
+		const float half = sqrtf(r2 - dz2);
+		int x0 = dtMax(minx, (int)floorf(px - half - 0.5f) - 1);
+		int x1 = dtMin(maxx, (int)floorf(px + half - 0.5f) + 1);
+		while (x0 <= x1 && dtSqr((float)(x0+0.5f) - px) + dz2 > r2)
+			x0++;
+		while (x1 >= x0 && dtSqr((float)(x1+0.5f) - px) + dz2 > r2)
+			x1--;
+		markSpan(layer, z*w, x0, x1, miny, maxy, areaId);
+	}
+
+	return DT_SUCCESS;
+}
+
+
+dtStatus dtMarkBoxArea(dtTileCacheLayer& layer, const float* orig, const float cs, const float ch,
+					   const float* bmin, const float* bmax, const unsigned char areaId)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	const float ics = 1.0f/cs;
+	const float ich = 1.0f/ch;
+
+	int minx = (int)floorf((bmin[0]-orig[0])*ics);
+	int miny = (int)floorf((bmin[1]-orig[1])*ich);
+	int minz = (int)floorf((bmin[2]-orig[2])*ics);
+	int maxx = (int)floorf((bmax[0]-orig[0])*ics);
+	int maxy = (int)floorf((bmax[1]-orig[1])*ich);
+	int maxz = (int)floorf((bmax[2]-orig[2])*ics);
+	
+	if (maxx < 0) return DT_SUCCESS;
+	if (minx >= w) return DT_SUCCESS;
+	if (maxz < 0) return DT_SUCCESS;
+	if (minz >= h) return DT_SUCCESS;
+
+	if (minx < 0) minx = 0;
+	if (maxx >= w) maxx = w-1;
+	if (minz < 0) minz = 0;
+	if (maxz >= h) maxz = h-1;
+	
+	for (int z = minz; z <= maxz; ++z)
+		markSpan(layer, z*w, minx, maxx, miny, maxy, areaId);
+
+	return DT_SUCCESS;
+}
+
+dtStatus dtMarkOrientedBoxArea(dtTileCacheLayer& layer, const float* orig, const float cs, const float ch,
+							   const float* center, const float* halfExtents, const float* rotAux,
+							   const unsigned char areaId)
+{
+	const int w = (int)layer.header->width;
+	const int h = (int)layer.header->height;
+	const float ics = 1.0f/cs;
+	const float ich = 1.0f/ch;
+
+	const float cx = (center[0] - orig[0])*ics;
+	const float cz = (center[2] - orig[2])*ics;
+	
+	// Extents of the box in cells, padded by half a cell like the cylinder.
+	const float hx = halfExtents[0]*ics + 0.5f;
+	const float hz = halfExtents[2]*ics + 0.5f;
+	const float c = rotAux[0];
+	const float s = rotAux[1];
+	const float ex = dtAbs(c)*halfExtents[0] + dtAbs(s)*halfExtents[2];
+	const float ez = dtAbs(s)*halfExtents[0] + dtAbs(c)*halfExtents[2];
+	
+	int minx = (int)floorf((center[0]-ex-orig[0])*ics);
+	int miny = (int)floorf((center[1]-halfExtents[1]-orig[1])*ich);
+	int minz = (int)floorf((center[2]-ez-orig[2])*ics);
+	int maxx = (int)floorf((center[0]+ex-orig[0])*ics);
+	int maxy = (int)floorf((center[1]+halfExtents[1]-orig[1])*ich);
+	int maxz = (int)floorf((center[2]+ez-orig[2])*ics);
+
+	if (maxx < 0) return DT_SUCCESS;
+	if (minx >= w) return DT_SUCCESS;
+	if (maxz < 0) return DT_SUCCESS;
+	if (minz >= h) return DT_SUCCESS;
+	
+	if (minx < 0) minx = 0;
+	if (maxx >= w) maxx = w-1;
+	if (minz < 0) minz = 0;
+	if (maxz >= h) maxz = h-1;
+	
+	for (int z = minz; z <= maxz; ++z)
+	{
+		const float dz = (float)(z+0.5f) - cz;
+		
+		// Find the cells inside the box, the estimate is padded by a cell
+		// and trimmed using the exact test.
+		float dx0 = (float)(minx+0.5f) - cx;
+		float dx1 = (float)(maxx+0.5f) - cx;
+		if (!clipBoxSpan(c, dz*s, hx, dx0, dx1) || !clipBoxSpan(s, -dz*c, hz, dx0, dx1))
+			continue;
+		int x0 = dtMax(minx, (int)floorf(cx + dx0 - 0.5f) - 1);
+		int x1 = dtMin(maxx, (int)floorf(cx + dx1 - 0.5f) + 1);
+		while (x0 <= x1 && !insideOrientedBox((float)(x0+0.5f) - cx, dz, c, s, hx, hz))
+			x0++;
+		while (x1 >= x0 && !insideOrientedBox((float)(x1+0.5f) - cx, dz, c, s, hx, hz))
+			x1--;
+		markSpan(layer, z*w, x0, x1, miny, maxy, areaId);
 	}
 
 	return DT_SUCCESS;
@@ -2021,6 +2869,7 @@ dtStatus dtBuildTileCacheLayer(dtTileCacheCompressor* comp,
 	
 	// Store header
 	memcpy(data, header, sizeof(dtTileCacheLayerHeader));
+	((dtTileCacheLayerHeader*)data)->codec = comp->getCodec();
 	
 	// Concatenate grid data for compression.
 	const int bufferSize = gridSize*3;
@@ -2073,6 +2922,10 @@ dtStatus dtDecompressTileCacheLayer(dtTileCacheAlloc* alloc, dtTileCacheCompress
 		return DT_FAILURE | DT_WRONG_MAGIC;
 	if (compressedHeader->version != DT_TILECACHE_VERSION)
 		return DT_FAILURE | DT_WRONG_VERSION;
+	if (compressedHeader->codec != DT_TILECACHE_CODEC_UNKNOWN &&
+		comp->getCodec() != DT_TILECACHE_CODEC_UNKNOWN &&
+		compressedHeader->codec != comp->getCodec())
+		return DT_FAILURE | DT_INVALID_PARAM;
 	
 	const int layerSize = dtAlign4(sizeof(dtTileCacheLayer));
 	const int headerSize = dtAlign4(sizeof(dtTileCacheLayerHeader));
@@ -2113,6 +2966,206 @@ dtStatus dtDecompressTileCacheLayer(dtTileCacheAlloc* alloc, dtTileCacheCompress
 }
 
 
+// The layer codec predicts each grid value from the already decoded values and
+// run length encodes the residuals. The heights use the gradient of the left and
+// above neighbours, so flat floors and ramps turn into zeros, and the areas and
+// connections are predicted from the row above.
+//
+// The stream starts with the row width as two bytes, zero if the buffer is not
+// made of three square grids, in which case the left neighbour is used instead.
+// The runs are stored as a control byte c, where c < 128 is followed by c+1
+// literal bytes, and c >= 128 by a byte repeated (c&0x7f)+3 times.
+static const int LAYER_CODEC_HEADER_SIZE = 2;
+static const int LAYER_CODEC_MAX_LITERAL = 128;
+static const int LAYER_CODEC_MIN_RUN = 3;
+static const int LAYER_CODEC_MAX_RUN = 127 + LAYER_CODEC_MIN_RUN;
+
+static int layerCodecStride(const int bufferSize)
+{
+	const int gridSize = bufferSize / 3;
+	if (gridSize*3 != bufferSize)
+		return 0;
+	int w = (int)sqrtf((float)gridSize);
+	while (w*w < gridSize) w++;
+	while (w*w > gridSize) w--;
+	if (w*w != gridSize || w > 0xffff)
+		return 0;
+	return w;
+}
+
+// Returns the residual of the value at i.
+static unsigned char layerCodecValue(const unsigned char* buffer, const int i, const int gridSize, const int stride)
+{
+	const int grid = gridSize ? i / gridSize : 3;
+	if (grid >= 3)
+		return buffer[i];
+	const int j = i - grid*gridSize;
+	const unsigned char* b = buffer + i;
+	int pred = 0;
+	if (!stride)
+	{
+		if (j > 0)
+			pred = b[-1];
+	}
+	else
+	{
+		const int x = j % stride;
+		const int y = j / stride;
+		if (y == 0)
+			pred = x > 0 ? b[-1] : 0;
+		else if (grid != 0 || x == 0)
+			pred = b[-stride];
+		else
+			pred = b[-1] + b[-stride] - b[-stride-1];
+	}
+	return (unsigned char)(b[0] - pred);
+}
+
+static unsigned char* layerCodecLiterals(unsigned char* out, const unsigned char* buffer, const int start, const int n,
+										 const int gridSize, const int stride)
+{
+	*out++ = (unsigned char)(n-1);
+	for (int i = 0; i < n; ++i)
+		*out++ = layerCodecValue(buffer, start+i, gridSize, stride);
+	return out;
+}
+
+int dtTileCacheLayerCompressor::maxCompressedSize(const int bufferSize)
+{
+	return LAYER_CODEC_HEADER_SIZE + bufferSize + (bufferSize + LAYER_CODEC_MAX_LITERAL-1) / LAYER_CODEC_MAX_LITERAL;
+}
+
+dtStatus dtTileCacheLayerCompressor::compress(const unsigned char* buffer, const int bufferSize,
+											  unsigned char* compressed, const int maxCompressedSize, int* compressedSize)
+{
+	if (maxCompressedSize < dtTileCacheLayerCompressor::maxCompressedSize(bufferSize))
+		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
+	
+	const int gridSize = bufferSize / 3;
+	const int stride = layerCodecStride(bufferSize);
+	
+	unsigned char* out = compressed;
+	*out++ = (unsigned char)(stride & 0xff);
+	*out++ = (unsigned char)((stride >> 8) & 0xff);
+	
+	int literal = 0;
+	int nliteral = 0;
+	int i = 0;
+	while (i < bufferSize)
+	{
+		const unsigned char v = layerCodecValue(buffer, i, gridSize, stride);
+		int n = 1;
+		while (i+n < bufferSize && n < LAYER_CODEC_MAX_RUN && layerCodecValue(buffer, i+n, gridSize, stride) == v)
+			n++;
+		
+		if (n >= LAYER_CODEC_MIN_RUN)
+		{
+			// Flush literals and store run.
+			if (nliteral)
+			{
+				out = layerCodecLiterals(out, buffer, literal, nliteral, gridSize, stride);
+				nliteral = 0;
+			}
+			*out++ = (unsigned char)(0x80 | (n-LAYER_CODEC_MIN_RUN));
+			*out++ = v;
+			i += n;
+		}
+		else
+		{
+			if (!nliteral)
+				literal = i;
+			nliteral++;
+			i++;
+			if (nliteral == LAYER_CODEC_MAX_LITERAL)
+			{
+				out = layerCodecLiterals(out, buffer, literal, nliteral, gridSize, stride);
+				nliteral = 0;
+			}
+		}
+	}
+	if (nliteral)
+		out = layerCodecLiterals(out, buffer, literal, nliteral, gridSize, stride);
+	
+	*compressedSize = (int)(out - compressed);
+	
+	return DT_SUCCESS;
+}
+
+dtStatus dtTileCacheLayerCompressor::decompress(const unsigned char* compressed, const int compressedSize,
+												unsigned char* buffer, const int maxBufferSize, int* bufferSize)
+{
+	if (compressedSize < LAYER_CODEC_HEADER_SIZE)
+		return DT_FAILURE;
+	
+	const unsigned char* in = compressed;
+	const unsigned char* inEnd = compressed + compressedSize;
+	const int stride = (int)in[0] | ((int)in[1] << 8);
+	in += LAYER_CODEC_HEADER_SIZE;
+	
+	unsigned char* out = buffer;
+	unsigned char* outEnd = buffer + maxBufferSize;
+	while (in < inEnd)
+	{
+		const int c = *in++;
+		if (c < 0x80)
+		{
+			const int n = c+1;
+			if (n > inEnd-in || n > outEnd-out)
+				return DT_FAILURE;
+			memcpy(out, in, n);
+			in += n;
+			out += n;
+		}
+		else
+		{
+			const int n = (c & 0x7f) + LAYER_CODEC_MIN_RUN;
+			if (in >= inEnd || n > outEnd-out)
+				return DT_FAILURE;
+			memset(out, *in++, n);
+			out += n;
+		}
+	}
+	
+	const int size = (int)(out - buffer);
+	const int gridSize = size / 3;
+	if (stride && stride*stride != gridSize)
+		return DT_FAILURE;
+	
+	// Undo the prediction.
+	for (int grid = 0; grid < 3; ++grid)
+	{
+		unsigned char* b = buffer + grid*gridSize;
+		if (!stride)
+		{
+			for (int i = 1; i < gridSize; ++i)
+				b[i] = (unsigned char)(b[i] + b[i-1]);
+			continue;
+		}
+		for (int x = 1; x < stride; ++x)
+			b[x] = (unsigned char)(b[x] + b[x-1]);
+		for (int y = 1; y < stride; ++y)
+		{
+			unsigned char* row = b + y*stride;
+			const unsigned char* above = row - stride;
+			row[0] = (unsigned char)(row[0] + above[0]);
+			if (grid == 0)
+			{
+				for (int x = 1; x < stride; ++x)
+					row[x] = (unsigned char)(row[x] + row[x-1] + above[x] - above[x-1]);
+			}
+			else
+			{
+				for (int x = 1; x < stride; ++x)
+					row[x] = (unsigned char)(row[x] + above[x]);
+			}
+		}
+	}
+	
+	*bufferSize = size;
+	
+	return DT_SUCCESS;
+}
+
 
 bool dtTileCacheHeaderSwapEndian(unsigned char* data, const int dataSize)
 {
@@ -22,6 +22,20 @@
 /// The value of PI used by Recast.
 static const float RC_PI = 3.14159265f;
 
+// Define RC_WIDE_REGIONS if you wish to use 32-bit region ids.
+// The default 16-bit region ids limit a compact heightfield to about 32k
+// regions. Wide region ids raise the limit to about 134M regions, which
+// allows very large single tile builds at the cost of a larger rcCompactSpan.
+//#define RC_WIDE_REGIONS 1
+
+/// A region id.
+/// @see rcCompactSpan::reg, rcContour::reg, rcPolyMesh::regs
+#ifdef RC_WIDE_REGIONS
+typedef unsigned int rcRegionId;
+#else
+typedef unsigned short rcRegionId;
+#endif
+
 /// Recast log categories.
 /// @see rcContext
 enum rcLogCategory
@@ -95,6 +109,14 @@ enum rcTimerLabel
 	RC_MAX_TIMERS
 };
 
+/// A batch of independent jobs, see rcContext::runJobs.
+struct rcJob
+{
+	/// Runs the specified job.
+	///  @param[in]		index	The index of the job. [Limit: 0 <= value < count]
+	virtual void run(const int index) = 0;
+};
+
 /// Provides an interface for optional logging and performance tracking of the Recast 
 /// build process.
 /// @ingroup recast
@@ -139,6 +161,11 @@ public:
 	///  @return The accumulated time of the timer, or -1 if timers are disabled or the timer has never been started.
 	inline int getAccumulatedTime(const rcTimerLabel label) const { return m_timerEnabled ? doGetAccumulatedTime(label) : -1; }
 
+	/// Runs the jobs [0, count) and returns when all of them are done.
+	///  @param[in]		job		The jobs to run.
+	///  @param[in]		count	The number of jobs.
+	inline void runJobs(rcJob* job, const int count) { doRunJobs(job, count); }
+
 protected:
 
 	/// Clears all log entries.
@@ -166,6 +193,13 @@ protected:
 	///  @return The accumulated time of the timer, or -1 if timers are disabled or the timer has never been started.
 	virtual int doGetAccumulatedTime(const rcTimerLabel /*label*/) const { return -1; }
 	
+	/// Runs the jobs [0, count) and returns when all of them are done.
+	/// The jobs may run concurrently. They only allocate memory, and do not
+	/// log or use the timers. The default implementation runs them in order.
+	///  @param[in]		job		The jobs to run.
+	///  @param[in]		count	The number of jobs.
+	virtual void doRunJobs(rcJob* job, const int count) { for (int i = 0; i < count; ++i) job->run(i); }
+	
 	/// True if logging is enabled.
 	bool m_logEnabled;
 
@@ -295,7 +329,7 @@ struct rcCompactCell
 struct rcCompactSpan
 {
 	unsigned short y;			///< The lower extent of the span. (Measured from the heightfield's base.)
-	unsigned short reg;			///< The id of the region the span belongs to. (Or zero if not in a region.)
+	rcRegionId reg;				///< The id of the region the span belongs to. (Or zero if not in a region.)
 	unsigned int con : 24;		///< Packed neighbor connection data.
 	unsigned int h : 8;			///< The height of the span.  (Measured from #y.)
 };
@@ -311,7 +345,7 @@ struct rcCompactHeightfield
 	int walkableClimb;			///< The walkable climb used during the build of the field. (See: rcConfig::walkableClimb)
 	int borderSize;				///< The AABB border size used during the build of the field. (See: rcConfig::borderSize)
 	unsigned short maxDistance;	///< The maximum distance value of any span within the field. 
-	unsigned short maxRegions;	///< The maximum region id of any span within the field. 
+	rcRegionId maxRegions;		///< The maximum region id of any span within the field. 
 	float bmin[3];				///< The minimum bounds in world space. [(x, y, z)]
 	float bmax[3];				///< The maximum bounds in world space. [(x, y, z)]
 	float cs;					///< The size of each cell. (On the xz-plane.)
@@ -359,7 +393,7 @@ struct rcContour
 	int nverts;			///< The number of vertices in the simplified contour. 
 	int* rverts;		///< Raw contour vertex and connection data. [Size: 4 * #nrverts]
 	int nrverts;		///< The number of vertices in the raw contour. 
-	unsigned short reg;	///< The region id of the contour.
+	rcRegionId reg;		///< The region id of the contour.
 	unsigned char area;	///< The area id of the contour.
 };
 
@@ -384,7 +418,7 @@ struct rcPolyMesh
 {
 	unsigned short* verts;	///< The mesh vertices. [Form: (x, y, z) * #nverts]
 	unsigned short* polys;	///< Polygon and neighbor data. [Length: #maxpolys * 2 * #nvp]
-	unsigned short* regs;	///< The region id assigned to each polygon. [Length: #maxpolys]
+	rcRegionId* regs;		///< The region id assigned to each polygon. [Length: #maxpolys]
 	unsigned short* flags;	///< The user defined flags for each polygon. [Length: #maxpolys]
 	unsigned char* areas;	///< The area id assigned to each polygon. [Length: #maxpolys]
 	int nverts;				///< The number of vertices.
@@ -495,7 +529,11 @@ void rcFreePolyMeshDetail(rcPolyMeshDetail* dmesh);
 /// region and its spans are considered unwalkable.
 /// (Used during the region and contour build process.)
 /// @see rcCompactSpan::reg
-static const unsigned short RC_BORDER_REG = 0x8000;
+#ifdef RC_WIDE_REGIONS
+static const rcRegionId RC_BORDER_REG = 0x8000000;
+#else
+static const rcRegionId RC_BORDER_REG = 0x8000;
+#endif
 
 /// Border vertex flag.
 /// If a region ID has this bit set, then the associated element lies on
@@ -504,14 +542,31 @@ static const unsigned short RC_BORDER_REG = 0x8000;
 /// at tile boundaries.
 /// (Used during the build process.)
 /// @see rcCompactSpan::reg, #rcContour::verts, #rcContour::rverts
+#ifdef RC_WIDE_REGIONS
+static const int RC_BORDER_VERTEX = 0x10000000;
+#else
 static const int RC_BORDER_VERTEX = 0x10000;
+#endif
 
 /// Area border flag.
 /// If a region ID has this bit set, then the associated element lies on
 /// the border of an area.
 /// (Used during the region and contour build process.)
 /// @see rcCompactSpan::reg, #rcContour::verts, #rcContour::rverts
+#ifdef RC_WIDE_REGIONS
+static const int RC_AREA_BORDER = 0x20000000;
+#else
 static const int RC_AREA_BORDER = 0x20000;
+#endif
+
+/// Heightfield filter flags.
+/// @see rcFilterHeightfield
+enum rcFilterFlags
+{
+	RC_FILTER_LOW_HANGING_OBSTACLES = 0x01,		///< Apply #rcFilterLowHangingWalkableObstacles.
+	RC_FILTER_LEDGE_SPANS = 0x02,				///< Apply #rcFilterLedgeSpans.
+	RC_FILTER_WALKABLE_LOW_HEIGHT_SPANS = 0x04,	///< Apply #rcFilterWalkableLowHeightSpans.
+};
 
 /// Contour build flags.
 /// @see rcBuildContours
@@ -525,7 +580,11 @@ enum rcBuildContoursFlags
 /// The region id field of a vertex may have several flags applied to it.  So the
 /// fields value can't be used directly.
 /// @see rcContour::verts, rcContour::rverts
+#ifdef RC_WIDE_REGIONS
+static const int RC_CONTOUR_REG_MASK = 0xfffffff;
+#else
 static const int RC_CONTOUR_REG_MASK = 0xffff;
+#endif
 
 /// An value which indicates an invalid index within a mesh.
 /// @note This does not necessarily indicate an error.
@@ -872,6 +931,20 @@ void rcFilterLedgeSpans(rcContext* ctx, const int walkableHeight,
 ///  @param[in,out]	solid			A fully built heightfield.  (All spans have been added.)
 void rcFilterWalkableLowHeightSpans(rcContext* ctx, int walkableHeight, rcHeightfield& solid);
 
+/// Applies the selected filters to a heightfield, in the order low hanging obstacles,
+/// ledge spans, walkable low height spans.
+///  @ingroup recast
+///  @param[in,out]	ctx				The build context to use during the operation.
+///  @param[in]		filterFlags		The filters to apply. (See: #rcFilterFlags)
+///  @param[in]		walkableHeight	Minimum floor to 'ceiling' height that will still allow the floor area to 
+///  								be considered walkable. [Limit: >= 3] [Units: vx]
+///  @param[in]		walkableClimb	Maximum ledge height that is considered to still be traversable. 
+///  								[Limit: >=0] [Units: vx]
+///  @param[in,out]	solid			A fully built heightfield.  (All spans have been added.)
+///  @returns True if the operation completed successfully.
+bool rcFilterHeightfield(rcContext* ctx, const int filterFlags, const int walkableHeight,
+						 const int walkableClimb, rcHeightfield& solid);
+
 /// Returns the number of spans contained in the specified heightfield.
 ///  @ingroup recast
 ///  @param[in,out]	ctx		The build context to use during the operation.
@@ -897,6 +970,12 @@ int rcGetHeightFieldSpanCount(rcContext* ctx, rcHeightfield& hf);
 bool rcBuildCompactHeightfield(rcContext* ctx, const int walkableHeight, const int walkableClimb,
 							   rcHeightfield& hf, rcCompactHeightfield& chf);
 
+/// Returns the number of bytes used by the specified compact heightfield.
+///  @ingroup recast
+///  @param[in]		chf		A populated compact heightfield.
+///  @returns The memory used by the compact heightfield and its span data. [Units: bytes]
+int rcGetCompactHeightfieldMemoryUsage(const rcCompactHeightfield& chf);
+
 /// Erodes the walkable area within the heightfield by the specified radius. 
 ///  @ingroup recast
 ///  @param[in,out]	ctx		The build context to use during the operation.
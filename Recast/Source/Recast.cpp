@@ -403,8 +403,10 @@ bool rcBuildCompactHeightfield(rcContext* ctx, const int walkableHeight, const i
 			}
 		}
 	}
-
-	// Find neighbour connections.
+	
+	// Find neighbour connections. The spans of a column are sorted, so the spans of
+	// the neighbour column within walkableClimb of a span are found by merging the
+	// two columns.
 	const int MAX_LAYERS = RC_NOT_CONNECTED-1;
 	int tooHighNeighbour = 0;
 	for (int y = 0; y < h; ++y)
@@ -412,6 +414,27 @@ bool rcBuildCompactHeightfield(rcContext* ctx, const int walkableHeight, const i
 		for (int x = 0; x < w; ++x)
 		{
 			const rcCompactCell& c = chf.cells[x+y*w];
+			if (!c.count)
+				continue;
+			
+			// The neighbour cells, and the first neighbour span which is not below
+			// the climb height of the current span.
+			int nbase[4], nfirst[4], nlast[4];
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				const int nx = x + rcGetDirOffsetX(dir);
+				const int ny = y + rcGetDirOffsetY(dir);
+				// First check that the neighbour cell is in bounds.
+				if (nx < 0 || ny < 0 || nx >= w || ny >= h)
+				{
+					nbase[dir] = nfirst[dir] = nlast[dir] = 0;
+					continue;
+				}
+				const rcCompactCell& nc = chf.cells[nx+ny*w];
+				nbase[dir] = nfirst[dir] = (int)nc.index;
+				nlast[dir] = (int)(nc.index+nc.count);
+			}
+			
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
 				rcCompactSpan& s = chf.spans[i];
@@ -419,27 +442,25 @@ bool rcBuildCompactHeightfield(rcContext* ctx, const int walkableHeight, const i
 				for (int dir = 0; dir < 4; ++dir)
 				{
 					rcSetCon(s, dir, RC_NOT_CONNECTED);
-					const int nx = x + rcGetDirOffsetX(dir);
-					const int ny = y + rcGetDirOffsetY(dir);
-					// First check that the neighbour cell is in bounds.
-					if (nx < 0 || ny < 0 || nx >= w || ny >= h)
-						continue;
-						
-					// Iterate over all neighbour spans and check if any of the is
-					// accessible from current cell.
-					const rcCompactCell& nc = chf.cells[nx+ny*w];
-					for (int k = (int)nc.index, nk = (int)(nc.index+nc.count); k < nk; ++k)
+					
+					while (nfirst[dir] < nlast[dir] && (int)chf.spans[nfirst[dir]].y < (int)s.y - walkableClimb)
+						nfirst[dir]++;
+					
+					// Iterate over the neighbour spans within the climb height and
+					// check if any of them is accessible from current cell.
+					for (int k = nfirst[dir], nk = nlast[dir]; k < nk; ++k)
 					{
 						const rcCompactSpan& ns = chf.spans[k];
+						if ((int)ns.y > (int)s.y + walkableClimb)
+							break;
 						const int bot = rcMax(s.y, ns.y);
 						const int top = rcMin(s.y+s.h, ns.y+ns.h);
 
-						// Check that the gap between the spans is walkable,
-						// and that the climb height between the gaps is not too high.
-						if ((top - bot) >= walkableHeight && rcAbs((int)ns.y - (int)s.y) <= walkableClimb)
+						// Check that the gap between the spans is walkable.
+						if ((top - bot) >= walkableHeight)
 						{
 							// Mark direction as walkable.
-							const int lidx = k - (int)nc.index;
+							const int lidx = k - nbase[dir];
 							if (lidx < 0 || lidx > MAX_LAYERS)
 							{
 								tooHighNeighbour = rcMax(tooHighNeighbour, lidx);
@@ -481,13 +502,17 @@ static int getHeightfieldMemoryUsage(const rcHeightfield& hf)
 	}
 	return size;
 }
+*/
 
-static int getCompactHeightFieldMemoryusage(const rcCompactHeightfield& chf)
+int rcGetCompactHeightfieldMemoryUsage(const rcCompactHeightfield& chf)
 {
 	int size = 0;
 	size += sizeof(rcCompactHeightfield);
 	size += sizeof(rcCompactSpan) * chf.spanCount;
 	size += sizeof(rcCompactCell) * chf.width * chf.height;
+	if (chf.dist)
+		size += sizeof(unsigned short) * chf.spanCount;
+	if (chf.areas)
+		size += sizeof(unsigned char) * chf.spanCount;
 	return size;
 }
-*/
\ No newline at end of file
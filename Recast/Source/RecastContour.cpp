@@ -33,11 +33,13 @@ static int getCornerHeight(int x, int y, int i, int dir,
 	int ch = (int)s.y;
 	int dirp = (dir+1) & 0x3;
 	
-	unsigned int regs[4] = {0,0,0,0};
+	rcRegionId regs[4] = {0,0,0,0};
+	unsigned char areas[4] = {0,0,0,0};
 	
-	// Combine region and area codes in order to prevent
+	// Compare both region and area codes in order to prevent
 	// border vertices which are in between two areas to be removed. 
-	regs[0] = chf.spans[i].reg | (chf.areas[i] << 16);
+	regs[0] = chf.spans[i].reg;
+	areas[0] = chf.areas[i];
 	
 	if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
 	{
@@ -46,7 +48,8 @@ static int getCornerHeight(int x, int y, int i, int dir,
 		const int ai = (int)chf.cells[ax+ay*chf.width].index + rcGetCon(s, dir);
 		const rcCompactSpan& as = chf.spans[ai];
 		ch = rcMax(ch, (int)as.y);
-		regs[1] = chf.spans[ai].reg | (chf.areas[ai] << 16);
+		regs[1] = chf.spans[ai].reg;
+		areas[1] = chf.areas[ai];
 		if (rcGetCon(as, dirp) != RC_NOT_CONNECTED)
 		{
 			const int ax2 = ax + rcGetDirOffsetX(dirp);
@@ -54,7 +57,8 @@ static int getCornerHeight(int x, int y, int i, int dir,
 			const int ai2 = (int)chf.cells[ax2+ay2*chf.width].index + rcGetCon(as, dirp);
 			const rcCompactSpan& as2 = chf.spans[ai2];
 			ch = rcMax(ch, (int)as2.y);
-			regs[2] = chf.spans[ai2].reg | (chf.areas[ai2] << 16);
+			regs[2] = chf.spans[ai2].reg;
+			areas[2] = chf.areas[ai2];
 		}
 	}
 	if (rcGetCon(s, dirp) != RC_NOT_CONNECTED)
@@ -64,7 +68,8 @@ static int getCornerHeight(int x, int y, int i, int dir,
 		const int ai = (int)chf.cells[ax+ay*chf.width].index + rcGetCon(s, dirp);
 		const rcCompactSpan& as = chf.spans[ai];
 		ch = rcMax(ch, (int)as.y);
-		regs[3] = chf.spans[ai].reg | (chf.areas[ai] << 16);
+		regs[3] = chf.spans[ai].reg;
+		areas[3] = chf.areas[ai];
 		if (rcGetCon(as, dir) != RC_NOT_CONNECTED)
 		{
 			const int ax2 = ax + rcGetDirOffsetX(dir);
@@ -72,7 +77,8 @@ static int getCornerHeight(int x, int y, int i, int dir,
 			const int ai2 = (int)chf.cells[ax2+ay2*chf.width].index + rcGetCon(as, dir);
 			const rcCompactSpan& as2 = chf.spans[ai2];
 			ch = rcMax(ch, (int)as2.y);
-			regs[2] = chf.spans[ai2].reg | (chf.areas[ai2] << 16);
+			regs[2] = chf.spans[ai2].reg;
+			areas[2] = chf.areas[ai2];
 		}
 	}
 
@@ -86,10 +92,10 @@ static int getCornerHeight(int x, int y, int i, int dir,
 		
 		// The vertex is a border vertex there are two same exterior cells in a row,
 		// followed by two interior cells and none of the regions are out of bounds.
-		const bool twoSameExts = (regs[a] & regs[b] & RC_BORDER_REG) != 0 && regs[a] == regs[b];
+		const bool twoSameExts = (regs[a] & regs[b] & RC_BORDER_REG) != 0 && regs[a] == regs[b] && areas[a] == areas[b];
 		const bool twoInts = ((regs[c] | regs[d]) & RC_BORDER_REG) == 0;
-		const bool intsSameArea = (regs[c]>>16) == (regs[d]>>16);
-		const bool noZeros = regs[a] != 0 && regs[b] != 0 && regs[c] != 0 && regs[d] != 0;
+		const bool intsSameArea = areas[c] == areas[d];
+		const bool noZeros = (regs[a] || areas[a]) && (regs[b] || areas[b]) && (regs[c] || areas[c]) && (regs[d] || areas[d]);
 		if (twoSameExts && twoInts && intsSameArea && noZeros)
 		{
 			isBorderVertex = true;
@@ -590,6 +596,146 @@ static bool mergeContours(rcContour& ca, rcContour& cb, int ia, int ib)
 	return true;
 }
 
+static const int RC_MAX_CONTOUR_CHUNKS = 64;
+
+// The rows of the heightfield marked by one job.
+struct rcContourBand
+{
+	int ymin, ymax;			// The rows [ymin, ymax) of the band.
+	rcIntArray starts;		// Cell and span index of the spans which can start a contour.
+	int maxReg;				// The largest region id of the start spans.
+};
+
+// Marks the non-connected edges of the spans of a band, and collects the spans
+// which can start a contour in scan order.
+struct rcMarkContoursJob : public rcJob
+{
+	inline rcMarkContoursJob(const rcCompactHeightfield& c, unsigned char* f, rcContourBand* b) :
+		chf(c), flags(f), bands(b) {}
+	virtual void run(const int index)
+	{
+		rcContourBand& band = bands[index];
+		const int w = chf.width;
+		band.maxReg = 0;
+		for (int y = band.ymin; y < band.ymax; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				const rcCompactCell& c = chf.cells[x+y*w];
+				for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+				{
+					unsigned char res = 0;
+					const rcCompactSpan& s = chf.spans[i];
+					if (!chf.spans[i].reg || (chf.spans[i].reg & RC_BORDER_REG))
+					{
+						flags[i] = 0;
+						continue;
+					}
+					for (int dir = 0; dir < 4; ++dir)
+					{
+						rcRegionId r = 0;
+						if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+						{
+							const int ax = x + rcGetDirOffsetX(dir);
+							const int ay = y + rcGetDirOffsetY(dir);
+							const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
+							r = chf.spans[ai].reg;
+						}
+						if (r == chf.spans[i].reg)
+							res |= (1 << dir);
+					}
+					flags[i] = res ^ 0xf; // Inverse, mark non connected edges.
+					if (flags[i] == 0 || flags[i] == 0xf)
+					{
+						flags[i] = 0;
+						continue;
+					}
+					band.starts.push(x+y*w);
+					band.starts.push(i);
+					band.maxReg = rcMax(band.maxReg, (int)chf.spans[i].reg);
+				}
+			}
+		}
+	}
+	const rcCompactHeightfield& chf;
+	unsigned char* flags;
+	rcContourBand* bands;
+};
+
+// The contours of a range of regions, traced and simplified by one job.
+struct rcContourChunk
+{
+	int regMin, regMax;		// The regions [regMin, regMax) of the chunk.
+	rcIntArray verts;		// The raw vertices of the contours.
+	rcIntArray simplified;	// The simplified vertices of the contours.
+	rcIntArray conts;		// Raw offset, raw size, simplified offset and simplified size of each contour.
+};
+
+// Traces the contours of a chunk, starting from the start spans of each region in scan order.
+// The index of the contour started by each start span, or -1, is stored in startCont.
+struct rcTraceContoursJob : public rcJob
+{
+	inline rcTraceContoursJob(rcCompactHeightfield& c, unsigned char* f, const rcIntArray& s,
+							  const rcIntArray& rs, rcIntArray& sc, rcContourChunk* ch) :
+		chf(c), flags(f), starts(s), regStart(rs), startCont(sc), chunks(ch) {}
+	virtual void run(const int index)
+	{
+		rcContourChunk& chunk = chunks[index];
+		const int w = chf.width;
+		for (int k = regStart[chunk.regMin]; k < regStart[chunk.regMax]; ++k)
+		{
+			const int c = starts[k*2+0];
+			const int i = starts[k*2+1];
+			startCont[k] = -1;
+			// The edges may have been visited by an earlier contour of the region.
+			if (flags[i] == 0)
+				continue;
+			const int offset = chunk.verts.size();
+			walkContour(c % w, c / w, i, chf, flags, chunk.verts);
+			startCont[k] = chunk.conts.size()/4;
+			chunk.conts.push(offset);
+			chunk.conts.push(chunk.verts.size()-offset);
+			chunk.conts.push(0);
+			chunk.conts.push(0);
+		}
+	}
+	rcCompactHeightfield& chf;
+	unsigned char* flags;
+	const rcIntArray& starts;
+	const rcIntArray& regStart;
+	rcIntArray& startCont;
+	rcContourChunk* chunks;
+};
+
+// Simplifies the traced contours of a chunk.
+struct rcSimplifyContoursJob : public rcJob
+{
+	inline rcSimplifyContoursJob(const float me, const int mel, const int bf, rcContourChunk* ch) :
+		maxError(me), maxEdgeLen(mel), buildFlags(bf), chunks(ch) {}
+	virtual void run(const int index)
+	{
+		rcContourChunk& chunk = chunks[index];
+		rcIntArray points(256);
+		rcIntArray simplified(64);
+		for (int j = 0; j < chunk.conts.size(); j += 4)
+		{
+			points.resize(chunk.conts[j+1]);
+			memcpy(&points[0], &chunk.verts[chunk.conts[j+0]], sizeof(int)*points.size());
+			simplified.resize(0);
+			simplifyContour(points, simplified, maxError, maxEdgeLen, buildFlags);
+			removeDegenerateSegments(simplified);
+			chunk.conts[j+2] = chunk.simplified.size();
+			chunk.conts[j+3] = simplified.size();
+			for (int k = 0; k < simplified.size(); ++k)
+				chunk.simplified.push(simplified[k]);
+		}
+	}
+	float maxError;
+	int maxEdgeLen;
+	int buildFlags;
+	rcContourChunk* chunks;
+};
+
 /// @par
 ///
 /// The raw contours will match the region outlines exactly. The @p maxError and @p maxEdgeLen
@@ -600,6 +746,9 @@ static bool mergeContours(rcContour& ca, rcContour& cb, int ia, int ib)
 ///
 /// Setting @p maxEdgeLength to zero will disabled the edge length feature.
 /// 
+/// The regions are traced and simplified as jobs through rcContext::runJobs. The resulting
+/// contour set does not depend on how the jobs are run.
+/// 
 /// See the #rcConfig documentation for more information on the configuration parameters.
 /// 
 /// @see rcAllocContourSet, rcCompactHeightfield, rcContourSet, rcConfig
@@ -609,7 +758,6 @@ bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
 {
 	rcAssert(ctx);
 	
-	const int w = chf.width;
 	const int h = chf.height;
 	const int borderSize = chf.borderSize;
 	
@@ -647,153 +795,156 @@ bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
 	
 	ctx->startTimer(RC_TIMER_BUILD_CONTOURS_TRACE);
 	
-	// Mark boundaries.
-	for (int y = 0; y < h; ++y)
+	// Mark boundaries, and collect the spans which can start a contour.
+	rcContourBand bands[RC_MAX_CONTOUR_CHUNKS];
+	const int nbands = rcMax(1, rcMin(h, RC_MAX_CONTOUR_CHUNKS));
+	for (int b = 0; b < nbands; ++b)
 	{
-		for (int x = 0; x < w; ++x)
-		{
-			const rcCompactCell& c = chf.cells[x+y*w];
-			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
-			{
-				unsigned char res = 0;
-				const rcCompactSpan& s = chf.spans[i];
-				if (!chf.spans[i].reg || (chf.spans[i].reg & RC_BORDER_REG))
-				{
-					flags[i] = 0;
-					continue;
-				}
-				for (int dir = 0; dir < 4; ++dir)
-				{
-					unsigned short r = 0;
-					if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
-					{
-						const int ax = x + rcGetDirOffsetX(dir);
-						const int ay = y + rcGetDirOffsetY(dir);
-						const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
-						r = chf.spans[ai].reg;
-					}
-					if (r == chf.spans[i].reg)
-						res |= (1 << dir);
-				}
-				flags[i] = res ^ 0xf; // Inverse, mark non connected edges.
-			}
-		}
+		bands[b].ymin = b*h/nbands;
+		bands[b].ymax = (b+1)*h/nbands;
+	}
+	rcMarkContoursJob markJob(chf, flags, bands);
+	ctx->runJobs(&markJob, nbands);
+	
+	rcIntArray scanStarts;
+	int maxReg = 0;
+	for (int b = 0; b < nbands; ++b)
+	{
+		for (int j = 0; j < bands[b].starts.size(); ++j)
+			scanStarts.push(bands[b].starts[j]);
+		maxReg = rcMax(maxReg, bands[b].maxReg);
+	}
+	
+	// Group the start spans by region, keeping the scan order within each region.
+	const int nstarts = scanStarts.size()/2;
+	const int nregs = maxReg+1;
+	rcIntArray regStart(nregs+1);
+	memset(&regStart[0], 0, sizeof(int)*(nregs+1));
+	for (int j = 0; j < nstarts; ++j)
+		regStart[chf.spans[scanStarts[j*2+1]].reg+1]++;
+	for (int r = 0; r < nregs; ++r)
+		regStart[r+1] += regStart[r];
+	
+	rcIntArray starts(nstarts*2);
+	rcIntArray startOrder(nstarts);
+	rcIntArray startCont(nstarts);
+	rcIntArray next(nregs);
+	memcpy(&next[0], &regStart[0], sizeof(int)*nregs);
+	for (int j = 0; j < nstarts; ++j)
+	{
+		const int k = next[chf.spans[scanStarts[j*2+1]].reg]++;
+		starts[k*2+0] = scanStarts[j*2+0];
+		starts[k*2+1] = scanStarts[j*2+1];
+		startOrder[j] = k;
+	}
+	
+	// Split the regions into jobs of about the same number of start spans.
+	rcContourChunk chunks[RC_MAX_CONTOUR_CHUNKS];
+	rcIntArray regChunk(nregs);
+	const int chunkSize = rcMax(1, (nstarts + RC_MAX_CONTOUR_CHUNKS-1) / RC_MAX_CONTOUR_CHUNKS);
+	int nchunks = 0;
+	for (int r = 0; r < nregs; )
+	{
+		rcContourChunk& chunk = chunks[nchunks];
+		chunk.regMin = r;
+		while (r < nregs && (regStart[r]-regStart[chunk.regMin] < chunkSize || nchunks == RC_MAX_CONTOUR_CHUNKS-1))
+			regChunk[r++] = nchunks;
+		chunk.regMax = r;
+		nchunks++;
 	}
 	
+	rcTraceContoursJob traceJob(chf, flags, starts, regStart, startCont, chunks);
+	ctx->runJobs(&traceJob, nchunks);
+	
 	ctx->stopTimer(RC_TIMER_BUILD_CONTOURS_TRACE);
 	
-	rcIntArray verts(256);
-	rcIntArray simplified(64);
+	ctx->startTimer(RC_TIMER_BUILD_CONTOURS_SIMPLIFY);
+	
+	rcSimplifyContoursJob simplifyJob(maxError, maxEdgeLen, buildFlags, chunks);
+	ctx->runJobs(&simplifyJob, nchunks);
+	
+	ctx->stopTimer(RC_TIMER_BUILD_CONTOURS_SIMPLIFY);
 	
-	for (int y = 0; y < h; ++y)
+	// Store the contours in the order of their start spans.
+	for (int n = 0; n < nstarts; ++n)
 	{
-		for (int x = 0; x < w; ++x)
+		const int k = startOrder[n];
+		if (startCont[k] == -1)
+			continue;
+		const int i = starts[k*2+1];
+		const rcRegionId reg = chf.spans[i].reg;
+		const rcContourChunk& chunk = chunks[regChunk[reg]];
+		const int* ci = &chunk.conts[startCont[k]*4];
+		const int* verts = &chunk.verts[ci[0]];
+		const int nverts = ci[1]/4;
+		const int* simplified = &chunk.simplified[ci[2]];
+		const int nsimplified = ci[3]/4;
+		
+		// Create contour.
+		if (nsimplified >= 3)
 		{
-			const rcCompactCell& c = chf.cells[x+y*w];
-			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+			if (cset.nconts >= maxContours)
 			{
-				if (flags[i] == 0 || flags[i] == 0xf)
+				// Allocate more contours.
+				// This can happen when there are tiny holes in the heightfield.
+				const int oldMax = maxContours;
+				maxContours *= 2;
+				rcContour* newConts = (rcContour*)rcAlloc(sizeof(rcContour)*maxContours, RC_ALLOC_PERM);
+				for (int j = 0; j < cset.nconts; ++j)
 				{
-					flags[i] = 0;
-					continue;
+					newConts[j] = cset.conts[j];
+					// Reset source pointers to prevent data deletion.
+					cset.conts[j].verts = 0;
+					cset.conts[j].rverts = 0;
 				}
-				const unsigned short reg = chf.spans[i].reg;
-				if (!reg || (reg & RC_BORDER_REG))
-					continue;
-				const unsigned char area = chf.areas[i];
-				
-				verts.resize(0);
-				simplified.resize(0);
-
-				ctx->startTimer(RC_TIMER_BUILD_CONTOURS_TRACE);
-				walkContour(x, y, i, chf, flags, verts);
-				ctx->stopTimer(RC_TIMER_BUILD_CONTOURS_TRACE);
-
-				ctx->startTimer(RC_TIMER_BUILD_CONTOURS_SIMPLIFY);
-				simplifyContour(verts, simplified, maxError, maxEdgeLen, buildFlags);
-				removeDegenerateSegments(simplified);
-				ctx->stopTimer(RC_TIMER_BUILD_CONTOURS_SIMPLIFY);
+				rcFree(cset.conts);
+				cset.conts = newConts;
+			
+				ctx->log(RC_LOG_WARNING, "rcBuildContours: Expanding max contours from %d to %d.", oldMax, maxContours);
+			}
 				
-
-				// Store region->contour remap info.
-				// Create contour.
-				if (simplified.size()/4 >= 3)
+			rcContour* cont = &cset.conts[cset.nconts++];
+			
+			cont->nverts = nsimplified;
+			cont->verts = (int*)rcAlloc(sizeof(int)*cont->nverts*4, RC_ALLOC_PERM);
+			if (!cont->verts)
+			{
+				ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'verts' (%d).", cont->nverts);
+				return false;
+			}
+			memcpy(cont->verts, simplified, sizeof(int)*cont->nverts*4);
+			if (borderSize > 0)
+			{
+				// If the heightfield was build with bordersize, remove the offset.
+				for (int j = 0; j < cont->nverts; ++j)
 				{
-					if (cset.nconts >= maxContours)
-					{
-						// Allocate more contours.
-						// This can happen when there are tiny holes in the heightfield.
-						const int oldMax = maxContours;
-						maxContours *= 2;
-						rcContour* newConts = (rcContour*)rcAlloc(sizeof(rcContour)*maxContours, RC_ALLOC_PERM);
-						for (int j = 0; j < cset.nconts; ++j)
-						{
-							newConts[j] = cset.conts[j];
-							// Reset source pointers to prevent data deletion.
-							cset.conts[j].verts = 0;
-							cset.conts[j].rverts = 0;
-						}
-						rcFree(cset.conts);
-						cset.conts = newConts;
-					
-						ctx->log(RC_LOG_WARNING, "rcBuildContours: Expanding max contours from %d to %d.", oldMax, maxContours);
-					}
-						
-					rcContour* cont = &cset.conts[cset.nconts++];
-					
-					cont->nverts = simplified.size()/4;
-					cont->verts = (int*)rcAlloc(sizeof(int)*cont->nverts*4, RC_ALLOC_PERM);
-					if (!cont->verts)
-					{
-						ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'verts' (%d).", cont->nverts);
-						return false;
-					}
-					memcpy(cont->verts, &simplified[0], sizeof(int)*cont->nverts*4);
-					if (borderSize > 0)
-					{
-						// If the heightfield was build with bordersize, remove the offset.
-						for (int j = 0; j < cont->nverts; ++j)
-						{
-							int* v = &cont->verts[j*4];
-							v[0] -= borderSize;
-							v[2] -= borderSize;
-						}
-					}
-					
-					cont->nrverts = verts.size()/4;
-					cont->rverts = (int*)rcAlloc(sizeof(int)*cont->nrverts*4, RC_ALLOC_PERM);
-					if (!cont->rverts)
-					{
-						ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'rverts' (%d).", cont->nrverts);
-						return false;
-					}
-					memcpy(cont->rverts, &verts[0], sizeof(int)*cont->nrverts*4);
-					if (borderSize > 0)
-					{
-						// If the heightfield was build with bordersize, remove the offset.
-						for (int j = 0; j < cont->nrverts; ++j)
-						{
-							int* v = &cont->rverts[j*4];
-							v[0] -= borderSize;
-							v[2] -= borderSize;
-						}
-					}
-					
-/*					cont->cx = cont->cy = cont->cz = 0;
-					for (int i = 0; i < cont->nverts; ++i)
-					{
-						cont->cx += cont->verts[i*4+0];
-						cont->cy += cont->verts[i*4+1];
-						cont->cz += cont->verts[i*4+2];
-					}
-					cont->cx /= cont->nverts;
-					cont->cy /= cont->nverts;
-					cont->cz /= cont->nverts;*/
-					
-					cont->reg = reg;
-					cont->area = area;
+					int* v = &cont->verts[j*4];
+					v[0] -= borderSize;
+					v[2] -= borderSize;
+				}
+			}
+			
+			cont->nrverts = nverts;
+			cont->rverts = (int*)rcAlloc(sizeof(int)*cont->nrverts*4, RC_ALLOC_PERM);
+			if (!cont->rverts)
+			{
+				ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'rverts' (%d).", cont->nrverts);
+				return false;
+			}
+			memcpy(cont->rverts, verts, sizeof(int)*cont->nrverts*4);
+			if (borderSize > 0)
+			{
+				// If the heightfield was build with bordersize, remove the offset.
+				for (int j = 0; j < cont->nrverts; ++j)
+				{
+					int* v = &cont->rverts[j*4];
+					v[0] -= borderSize;
+					v[2] -= borderSize;
 				}
 			}
+			
+			cont->reg = reg;
+			cont->area = chf.areas[i];
 		}
 	}
 	
@@ -19,75 +19,394 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include "Recast.h"
+#include "RecastAlloc.h"
 #include "RecastAssert.h"
 
-/// @par
-///
-/// Allows the formation of walkable regions that will flow over low lying 
-/// objects such as curbs, and up structures such as stairways. 
-/// 
-/// Two neighboring spans are walkable if: <tt>rcAbs(currentSpan.smax - neighborSpan.smax) < waklableClimb</tt>
-/// 
-/// @warning Will override the effect of #rcFilterLedgeSpans.  So if both filters are used, call
-/// #rcFilterLedgeSpans after calling this filter. 
-///
-/// @see rcHeightfield, rcConfig
-void rcFilterLowHangingWalkableObstacles(rcContext* ctx, const int walkableClimb, rcHeightfield& solid)
+static const int RC_MAX_FILTER_BANDS = 64;
+static const int RC_FILTER_MAX_HEIGHT = 0xffff;
+
+// A copy of the spans of one row of a heightfield, with the spans of each
+// column stored contiguously so the filters do not need to follow the span lists.
+struct rcSpanRow
 {
-	rcAssert(ctx);
+	int* first;				// Index of the first span of each column, (width+1).
+	unsigned short* base;	// The minimum of the lowest span of each column, or RC_FILTER_MAX_HEIGHT.
+	unsigned short* bot;	// The maximum of each span, the floor of the open space above it.
+	unsigned short* top;	// The minimum of the next span up, or RC_FILTER_MAX_HEIGHT.
+	unsigned char* area;	// The area of each span.
+	unsigned char* orig;	// The area of each span in the heightfield.
+	int cap;				// The number of spans the row can hold.
+};
 
-	ctx->startTimer(RC_TIMER_FILTER_LOW_OBSTACLES);
-	
+static void freeSpanRow(rcSpanRow& row)
+{
+	rcFree(row.first);
+	rcFree(row.base);
+	rcFree(row.bot);
+	rcFree(row.top);
+	rcFree(row.area);
+	rcFree(row.orig);
+	memset(&row, 0, sizeof(row));
+}
+
+static bool allocSpanRow(rcSpanRow& row, const int w)
+{
+	memset(&row, 0, sizeof(row));
+	row.first = (int*)rcAlloc(sizeof(int)*(w+1), RC_ALLOC_TEMP);
+	row.base = (unsigned short*)rcAlloc(sizeof(unsigned short)*w, RC_ALLOC_TEMP);
+	return row.first && row.base;
+}
+
+static bool reserveSpanRow(rcSpanRow& row, const int n)
+{
+	if (n <= row.cap)
+		return true;
+	int cap = rcMax(row.cap*2, n);
+	unsigned short* bot = (unsigned short*)rcAlloc(sizeof(unsigned short)*cap, RC_ALLOC_TEMP);
+	unsigned short* top = (unsigned short*)rcAlloc(sizeof(unsigned short)*cap, RC_ALLOC_TEMP);
+	unsigned char* area = (unsigned char*)rcAlloc(sizeof(unsigned char)*cap, RC_ALLOC_TEMP);
+	unsigned char* orig = (unsigned char*)rcAlloc(sizeof(unsigned char)*cap, RC_ALLOC_TEMP);
+	if (bot && top && area && orig && row.cap)
+	{
+		memcpy(bot, row.bot, sizeof(unsigned short)*row.cap);
+		memcpy(top, row.top, sizeof(unsigned short)*row.cap);
+		memcpy(area, row.area, sizeof(unsigned char)*row.cap);
+	}
+	rcFree(row.bot);
+	rcFree(row.top);
+	rcFree(row.area);
+	rcFree(row.orig);
+	row.bot = bot;
+	row.top = top;
+	row.area = area;
+	row.orig = orig;
+	row.cap = cap;
+	return bot && top && area && orig;
+}
+
+static bool loadSpanRow(const rcHeightfield& solid, const int y, rcSpanRow& row)
+{
 	const int w = solid.width;
-	const int h = solid.height;
+	rcSpan* const* spans = &solid.spans[y*w];
+	int n = 0;
+	for (int x = 0; x < w; ++x)
+	{
+		row.first[x] = n;
+		const rcSpan* s = spans[x];
+		if (!s)
+		{
+			row.base[x] = RC_FILTER_MAX_HEIGHT;
+			continue;
+		}
+		row.base[x] = (unsigned short)s->smin;
+		
+		int ns = 0;
+		for (const rcSpan* t = s; t; t = t->next)
+			ns++;
+		if (n+ns > row.cap && !reserveSpanRow(row, n+ns))
+			return false;
+		
+		unsigned short* bot = row.bot;
+		unsigned short* top = row.top;
+		unsigned char* area = row.area;
+		for (; s->next; s = s->next, ++n)
+		{
+			bot[n] = (unsigned short)s->smax;
+			top[n] = (unsigned short)s->next->smin;
+			area[n] = (unsigned char)s->area;
+		}
+		bot[n] = (unsigned short)s->smax;
+		top[n] = RC_FILTER_MAX_HEIGHT;
+		area[n] = (unsigned char)s->area;
+		n++;
+	}
+	row.first[w] = n;
+	if (n)
+		memcpy(row.orig, row.area, n);
+	return true;
+}
+
+// The rows of the heightfield filtered by one job.
+struct rcFilterBand
+{
+	int ymin, ymax;			// The rows [ymin, ymax) of the band.
+	rcIntArray changes;		// Column index, span count and new areas of each changed column.
+	bool failed;			// True if the job ran out of memory.
+};
+
+// Filters the rows of a band, and records the columns whose areas changed.
+// The three rows around the filtered row are kept as rcSpanRow. A job reads
+// the spans of the rows next to its band, so the areas are stored by
+// rcStoreAreasJob once all the bands are filtered.
+struct rcFilterSpansJob : public rcJob
+{
+	inline rcFilterSpansJob(const rcHeightfield& s, const int ff, const int wh, const int wc, rcFilterBand* b) :
+		solid(s), filterFlags(ff), walkableHeight(wh), walkableClimb(wc), bands(b) {}
 	
-	for (int y = 0; y < h; ++y)
+	virtual void run(const int index)
 	{
+		rcFilterBand& band = bands[index];
+		band.failed = false;
+		
+		rcSpanRow rows[3];
+		bool ok = true;
+		for (int i = 0; i < 3; ++i)
+			ok &= allocSpanRow(rows[i], solid.width);
+		
+		// rows[0] is the row below y, rows[1] the row y and rows[2] the row above.
+		rcSpanRow* prev = &rows[0];
+		rcSpanRow* cur = &rows[1];
+		rcSpanRow* next = &rows[2];
+		if (ok && band.ymin > 0)
+			ok = loadSpanRow(solid, band.ymin-1, *prev);
+		if (ok && band.ymin < band.ymax)
+			ok = loadSpanRow(solid, band.ymin, *cur);
+		
+		for (int y = band.ymin; ok && y < band.ymax; ++y)
+		{
+			if (y+1 < solid.height && !loadSpanRow(solid, y+1, *next))
+			{
+				ok = false;
+				break;
+			}
+			filterRow(y > 0 ? prev : 0, *cur, y+1 < solid.height ? next : 0, y, band.changes);
+			
+			rcSpanRow* tmp = prev;
+			prev = cur;
+			cur = next;
+			next = tmp;
+		}
+		
+		for (int i = 0; i < 3; ++i)
+			freeSpanRow(rows[i]);
+		band.failed = !ok;
+	}
+	
+	void filterRow(const rcSpanRow* below, rcSpanRow& row, const rcSpanRow* above, const int y, rcIntArray& changes)
+	{
+		const int w = solid.width;
+		unsigned char* area = row.area;
+		
 		for (int x = 0; x < w; ++x)
 		{
-			rcSpan* ps = 0;
-			bool previousWalkable = false;
-			unsigned char previousArea = RC_NULL_AREA;
+			const int first = row.first[x];
+			const int last = row.first[x+1];
 			
-			for (rcSpan* s = solid.spans[x + y*w]; s; ps = s, s = s->next)
+			if (filterFlags & RC_FILTER_LOW_HANGING_OBSTACLES)
 			{
-				const bool walkable = s->area != RC_NULL_AREA;
-				// If current span is not walkable, but there is walkable
-				// span just below it, mark the span above it walkable too.
-				if (!walkable && previousWalkable)
+				bool previousWalkable = false;
+				unsigned char previousArea = RC_NULL_AREA;
+				for (int i = first; i < last; ++i)
 				{
-					if (rcAbs((int)s->smax - (int)ps->smax) <= walkableClimb)
-						s->area = previousArea;
+					const bool walkable = area[i] != RC_NULL_AREA;
+					// If current span is not walkable, but there is walkable
+					// span just below it, mark the span above it walkable too.
+					if (!walkable && previousWalkable)
+					{
+						if (rcAbs((int)row.bot[i] - (int)row.bot[i-1]) <= walkableClimb)
+							area[i] = previousArea;
+					}
+					// Copy walkable flag so that it cannot propagate
+					// past multiple non-walkable objects.
+					previousWalkable = walkable;
+					previousArea = area[i];
 				}
-				// Copy walkable flag so that it cannot propagate
-				// past multiple non-walkable objects.
-				previousWalkable = walkable;
-				previousArea = s->area;
+			}
+			
+			if (filterFlags & RC_FILTER_LEDGE_SPANS)
+				filterLedgeSpans(below, row, above, x);
+			
+			if (filterFlags & RC_FILTER_WALKABLE_LOW_HEIGHT_SPANS)
+			{
+				for (int i = first; i < last; ++i)
+				{
+					if ((int)row.top[i] - (int)row.bot[i] <= walkableHeight)
+						area[i] = RC_NULL_AREA;
+				}
+			}
+			
+			int changed = 0;
+			for (int i = first; i < last; ++i)
+				changed |= area[i] ^ row.orig[i];
+			if (changed)
+			{
+				changes.push(x + y*w);
+				changes.push(last-first);
+				for (int i = first; i < last; ++i)
+					changes.push(area[i]);
 			}
 		}
 	}
+	
+	void filterLedgeSpans(const rcSpanRow* below, rcSpanRow& row, const rcSpanRow* above, const int x)
+	{
+		const int w = solid.width;
+		
+		// The neighbour columns, and the first span of each whose top can still be
+		// above the floor of a span of this column. The spans are sorted, so it
+		// only moves up.
+		const rcSpanRow* nrow[4];
+		int ncol[4], nfirst[4], nlast[4];
+		for (int dir = 0; dir < 4; ++dir)
+		{
+			const int dx = x + rcGetDirOffsetX(dir);
+			const int dy = rcGetDirOffsetY(dir);
+			nrow[dir] = dy < 0 ? below : (dy > 0 ? above : &row);
+			if (dx < 0 || dx >= w || !nrow[dir])
+			{
+				nrow[dir] = 0;
+				continue;
+			}
+			ncol[dir] = dx;
+			nfirst[dir] = nrow[dir]->first[dx];
+			nlast[dir] = nrow[dir]->first[dx+1];
+		}
+		
+		for (int i = row.first[x], ni = row.first[x+1]; i < ni; ++i)
+		{
+			// Skip non walkable spans.
+			if (row.area[i] == RC_NULL_AREA)
+				continue;
+			
+			const int bot = (int)row.bot[i];
+			const int top = (int)row.top[i];
+			
+			// Find neighbours minimum height.
+			int minh = RC_FILTER_MAX_HEIGHT;
+			
+			// Min and max height of accessible neighbours.
+			int asmin = bot;
+			int asmax = bot;
+			
+			// The neighbours can only lower minh and widen [asmin, asmax],
+			// so stop as soon as the span is known to be a ledge.
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				// Skip neighbours which are out of bounds.
+				const rcSpanRow* nr = nrow[dir];
+				if (!nr)
+				{
+					minh = rcMin(minh, -walkableClimb - bot);
+					if (minh < -walkableClimb)
+						break;
+					continue;
+				}
+				
+				// From minus infinity to the first span.
+				int nbot = -walkableClimb;
+				int ntop = (int)nr->base[ncol[dir]];
+				// Skip neightbour if the gap between the spans is too small.
+				if (rcMin(top,ntop) - rcMax(bot,nbot) > walkableHeight)
+				{
+					minh = rcMin(minh, nbot - bot);
+					if (minh < -walkableClimb)
+						break;
+				}
+				
+				// Rest of the spans. A gap which ends too low for this span is
+				// too low for the spans above it as well.
+				while (nfirst[dir] < nlast[dir] && (int)nr->top[nfirst[dir]] - bot <= walkableHeight)
+					nfirst[dir]++;
+				for (int j = nfirst[dir]; j < nlast[dir]; ++j)
+				{
+					nbot = (int)nr->bot[j];
+					ntop = (int)nr->top[j];
+					// The gaps from here up start too high.
+					if (nbot >= top - walkableHeight)
+						break;
+					// Skip neightbour if the gap between the spans is too small.
+					if (rcMin(top,ntop) - rcMax(bot,nbot) > walkableHeight)
+					{
+						minh = rcMin(minh, nbot - bot);
+						
+						// Find min/max accessible neighbour height.
+						if (rcAbs(nbot - bot) <= walkableClimb)
+						{
+							asmin = rcMin(asmin, nbot);
+							asmax = rcMax(asmax, nbot);
+						}
+					}
+				}
+				
+				if (minh < -walkableClimb || (asmax - asmin) > walkableClimb)
+					break;
+			}
+			
+			// The current span is close to a ledge if the drop to any
+			// neighbour span is less than the walkableClimb.
+			if (minh < -walkableClimb)
+				row.area[i] = RC_NULL_AREA;
+			
+			// If the difference between all neighbours is too large,
+			// we are at steep slope, mark the span as ledge.
+			if ((asmax - asmin) > walkableClimb)
+				row.area[i] = RC_NULL_AREA;
+		}
+	}
+	
+	const rcHeightfield& solid;
+	const int filterFlags;
+	const int walkableHeight, walkableClimb;
+	rcFilterBand* bands;
+};
 
-	ctx->stopTimer(RC_TIMER_FILTER_LOW_OBSTACLES);
-}
+// Stores the changed areas of a band to the heightfield.
+struct rcStoreAreasJob : public rcJob
+{
+	inline rcStoreAreasJob(rcHeightfield& s, rcFilterBand* b) : solid(s), bands(b) {}
+	virtual void run(const int index)
+	{
+		const rcIntArray& changes = bands[index].changes;
+		for (int i = 0; i < changes.size(); )
+		{
+			rcSpan* s = solid.spans[changes[i]];
+			const int n = changes[i+1];
+			i += 2;
+			for (int j = 0; j < n; ++j, s = s->next)
+				s->area = (unsigned int)changes[i+j];
+			i += n;
+		}
+	}
+	rcHeightfield& solid;
+	rcFilterBand* bands;
+};
 
-/// @par
-///
-/// A ledge is a span with one or more neighbors whose maximum is further away than @p walkableClimb
-/// from the current span's maximum.
-/// This method removes the impact of the overestimation of conservative voxelization 
-/// so the resulting mesh will not have regions hanging in the air over ledges.
-/// 
-/// A span is a ledge if: <tt>rcAbs(currentSpan.smax - neighborSpan.smax) > walkableClimb</tt>
-/// 
-/// @see rcHeightfield, rcConfig
-void rcFilterLedgeSpans(rcContext* ctx, const int walkableHeight, const int walkableClimb,
-						rcHeightfield& solid)
+// Runs the row filter jobs. Returns false without changing the heightfield if
+// a job runs out of memory.
+static bool filterHeightfieldRows(rcContext* ctx, const int filterFlags, const int walkableHeight,
+								  const int walkableClimb, rcHeightfield& solid)
 {
-	rcAssert(ctx);
+	const int h = solid.height;
+	rcFilterBand bands[RC_MAX_FILTER_BANDS];
+	const int nbands = rcMax(1, rcMin(h, RC_MAX_FILTER_BANDS));
+	for (int b = 0; b < nbands; ++b)
+	{
+		bands[b].ymin = b*h/nbands;
+		bands[b].ymax = (b+1)*h/nbands;
+	}
 	
-	ctx->startTimer(RC_TIMER_FILTER_BORDER);
+	rcFilterSpansJob filterJob(solid, filterFlags, walkableHeight, walkableClimb, bands);
+	ctx->runJobs(&filterJob, nbands);
+	
+	for (int b = 0; b < nbands; ++b)
+	{
+		if (bands[b].failed)
+			return false;
+	}
+	
+	rcStoreAreasJob storeJob(solid, bands);
+	ctx->runJobs(&storeJob, nbands);
+	
+	return true;
+}
 
+// Marks the ledge spans directly in the span lists. Used by rcFilterLedgeSpans when
+// the row filter runs out of memory, as it needs no temporary memory.
+static void filterLedgeSpansInPlace(const int walkableHeight, const int walkableClimb,
+									rcHeightfield& solid)
+{
 	const int w = solid.width;
 	const int h = solid.height;
 	const int MAX_HEIGHT = 0xffff;
@@ -167,15 +486,136 @@ void rcFilterLedgeSpans(rcContext* ctx, const int walkableHeight, const int walk
 			}
 		}
 	}
+}
+
+/// @par
+///
+/// The selected filters give the same result as calling #rcFilterLowHangingWalkableObstacles,
+/// #rcFilterLedgeSpans and #rcFilterWalkableLowHeightSpans in that order, but the
+/// heightfield is only traversed once. Each row is copied with the spans of each
+/// column stored contiguously, and all the filters are applied to it while the row
+/// and its neighbours are in the cache. The rows are filtered in bands as jobs
+/// through rcContext::runJobs.
+///
+/// The time is accounted to the timer of the first selected filter.
+///
+/// @see rcHeightfield, rcConfig, rcFilterFlags
+bool rcFilterHeightfield(rcContext* ctx, const int filterFlags, const int walkableHeight,
+						 const int walkableClimb, rcHeightfield& solid)
+{
+	rcAssert(ctx);
+	
+	rcTimerLabel timer;
+	if (filterFlags & RC_FILTER_LOW_HANGING_OBSTACLES)
+		timer = RC_TIMER_FILTER_LOW_OBSTACLES;
+	else if (filterFlags & RC_FILTER_LEDGE_SPANS)
+		timer = RC_TIMER_FILTER_BORDER;
+	else if (filterFlags & RC_FILTER_WALKABLE_LOW_HEIGHT_SPANS)
+		timer = RC_TIMER_FILTER_WALKABLE;
+	else
+		return true;
+	
+	ctx->startTimer(timer);
+	
+	if (!filterHeightfieldRows(ctx, filterFlags, walkableHeight, walkableClimb, solid))
+	{
+		ctx->log(RC_LOG_ERROR, "rcFilterHeightfield: Out of memory 'rows' (%d).", solid.width);
+		ctx->stopTimer(timer);
+		return false;
+	}
+	
+	ctx->stopTimer(timer);
+	
+	return true;
+}
+
+/// @par
+///
+/// Allows the formation of walkable regions that will flow over low lying 
+/// objects such as curbs, and up structures such as stairways. 
+/// 
+/// Two neighboring spans are walkable if: <tt>rcAbs(currentSpan.smax - neighborSpan.smax) < waklableClimb</tt>
+/// 
+/// @warning Will override the effect of #rcFilterLedgeSpans.  So if both filters are used, call
+/// #rcFilterLedgeSpans after calling this filter. 
+///
+/// Use #rcFilterHeightfield to apply several filters at once.
+///
+/// @see rcHeightfield, rcConfig
+void rcFilterLowHangingWalkableObstacles(rcContext* ctx, const int walkableClimb, rcHeightfield& solid)
+{
+	rcAssert(ctx);
+
+	ctx->startTimer(RC_TIMER_FILTER_LOW_OBSTACLES);
+	
+	const int w = solid.width;
+	const int h = solid.height;
+	
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			rcSpan* ps = 0;
+			bool previousWalkable = false;
+			unsigned char previousArea = RC_NULL_AREA;
+			
+			for (rcSpan* s = solid.spans[x + y*w]; s; ps = s, s = s->next)
+			{
+				const bool walkable = s->area != RC_NULL_AREA;
+				// If current span is not walkable, but there is walkable
+				// span just below it, mark the span above it walkable too.
+				if (!walkable && previousWalkable)
+				{
+					if (rcAbs((int)s->smax - (int)ps->smax) <= walkableClimb)
+						s->area = previousArea;
+				}
+				// Copy walkable flag so that it cannot propagate
+				// past multiple non-walkable objects.
+				previousWalkable = walkable;
+				previousArea = s->area;
+			}
+		}
+	}
+
+	ctx->stopTimer(RC_TIMER_FILTER_LOW_OBSTACLES);
+}
+
+/// @par
+///
+/// A ledge is a span with one or more neighbors whose maximum is further away than @p walkableClimb
+/// from the current span's maximum.
+/// This method removes the impact of the overestimation of conservative voxelization 
+/// so the resulting mesh will not have regions hanging in the air over ledges.
+/// 
+/// A span is a ledge if: <tt>rcAbs(currentSpan.smax - neighborSpan.smax) > walkableClimb</tt>
+/// 
+/// Use #rcFilterHeightfield to apply several filters at once.
+///
+/// The spans are filtered by rows like #rcFilterHeightfield. If the row buffers cannot
+/// be allocated, the spans are filtered directly in the span lists instead, so the
+/// filter always completes.
+///
+/// @see rcHeightfield, rcConfig
+void rcFilterLedgeSpans(rcContext* ctx, const int walkableHeight, const int walkableClimb,
+						rcHeightfield& solid)
+{
+	rcAssert(ctx);
+	
+	ctx->startTimer(RC_TIMER_FILTER_BORDER);
+	
+	if (!filterHeightfieldRows(ctx, RC_FILTER_LEDGE_SPANS, walkableHeight, walkableClimb, solid))
+		filterLedgeSpansInPlace(walkableHeight, walkableClimb, solid);
 	
 	ctx->stopTimer(RC_TIMER_FILTER_BORDER);
-}	
+}
 
 /// @par
 ///
 /// For this filter, the clearance above the span is the distance from the span's 
 /// maximum to the next higher span's minimum. (Same grid column.)
 /// 
+/// Use #rcFilterHeightfield to apply several filters at once.
+///
 /// @see rcHeightfield, rcConfig
 void rcFilterWalkableLowHeightSpans(rcContext* ctx, int walkableHeight, rcHeightfield& solid)
 {
@@ -38,10 +38,10 @@ static bool buildMeshAdjacency(unsigned short* polys, const int npolys,
 	// http://www.terathon.com/code/edges.php
 	
 	int maxEdgeCount = npolys*vertsPerPoly;
-	unsigned short* firstEdge = (unsigned short*)rcAlloc(sizeof(unsigned short)*(nverts + maxEdgeCount), RC_ALLOC_TEMP);
+	int* firstEdge = (int*)rcAlloc(sizeof(int)*(nverts + maxEdgeCount), RC_ALLOC_TEMP);
 	if (!firstEdge)
 		return false;
-	unsigned short* nextEdge = firstEdge + nverts;
+	int* nextEdge = firstEdge + nverts;
 	int edgeCount = 0;
 	
 	rcEdge* edges = (rcEdge*)rcAlloc(sizeof(rcEdge)*maxEdgeCount, RC_ALLOC_TEMP);
@@ -52,7 +52,7 @@ static bool buildMeshAdjacency(unsigned short* polys, const int npolys,
 	}
 	
 	for (int i = 0; i < nverts; i++)
-		firstEdge[i] = RC_MESH_NULL_IDX;
+		firstEdge[i] = -1;
 	
 	for (int i = 0; i < npolys; ++i)
 	{
@@ -73,7 +73,7 @@ static bool buildMeshAdjacency(unsigned short* polys, const int npolys,
 				edge.polyEdge[1] = 0;
 				// Insert edge
 				nextEdge[edgeCount] = firstEdge[v0];
-				firstEdge[v0] = (unsigned short)edgeCount;
+				firstEdge[v0] = edgeCount;
 				edgeCount++;
 			}
 		}
@@ -89,7 +89,7 @@ static bool buildMeshAdjacency(unsigned short* polys, const int npolys,
 			unsigned short v1 = (j+1 >= vertsPerPoly || t[j+1] == RC_MESH_NULL_IDX) ? t[0] : t[j+1];
 			if (v0 > v1)
 			{
-				for (unsigned short e = firstEdge[v1]; e != RC_MESH_NULL_IDX; e = nextEdge[e])
+				for (int e = firstEdge[v1]; e != -1; e = nextEdge[e])
 				{
 					rcEdge& edge = edges[e];
 					if (edge.vert[1] == v0 && edge.poly[0] == edge.poly[1])
@@ -123,39 +123,51 @@ static bool buildMeshAdjacency(unsigned short* polys, const int npolys,
 }
 
 
-static const int VERTEX_BUCKET_COUNT = (1<<12);
-
 inline int computeVertexHash(int x, int y, int z)
 {
 	const unsigned int h1 = 0x8da6b343; // Large multiplicative constants;
 	const unsigned int h2 = 0xd8163841; // here arbitrarily chosen primes
 	const unsigned int h3 = 0xcb1ab31f;
 	unsigned int n = h1 * x + h2 * y + h3 * z;
-	return (int)(n & (VERTEX_BUCKET_COUNT-1));
+	return (int)(n & 0x7fffffff);
+}
+
+// Returns the bucket count of a vertex hash table which can hold the specified number of vertices.
+static int calcVertexBucketCount(const int maxVerts)
+{
+	int n = 64;
+	while (n < maxVerts*2)
+		n *= 2;
+	return n;
 }
 
+// Adds a vertex to the open addressing vertex hash table, or returns a previously
+// added vertex at the same location whose height is within 2 units.
 static unsigned short addVertex(unsigned short x, unsigned short y, unsigned short z,
-								unsigned short* verts, int* firstVert, int* nextVert, int& nv)
+								unsigned short* verts, int* buckets, const int nbuckets, int& nv)
 {
-	int bucket = computeVertexHash(x, 0, z);
-	int i = firstVert[bucket];
+	const int mask = nbuckets-1;
+	int bucket = computeVertexHash(x, 0, z) & mask;
 	
-	while (i != -1)
+	// The vertices of a location are probed in the order they were added,
+	// use the last match.
+	int found = -1;
+	for (int i = buckets[bucket]; i != -1; bucket = (bucket+1) & mask, i = buckets[bucket])
 	{
 		const unsigned short* v = &verts[i*3];
 		if (v[0] == x && (rcAbs(v[1] - y) <= 2) && v[2] == z)
-			return (unsigned short)i;
-		i = nextVert[i]; // next
+			found = i;
 	}
+	if (found != -1)
+		return (unsigned short)found;
 	
 	// Could not find, create new.
-	i = nv; nv++;
+	const int i = nv; nv++;
 	unsigned short* v = &verts[i*3];
 	v[0] = x;
 	v[1] = y;
 	v[2] = z;
-	nextVert[i] = firstVert[bucket];
-	firstVert[bucket] = i;
+	buckets[bucket] = i;
 	
 	return (unsigned short)i;
 }
@@ -793,7 +805,7 @@ static bool removeVertex(rcContext* ctx, rcPolyMesh& mesh, const unsigned short
 		ctx->log(RC_LOG_ERROR, "removeVertex: Out of memory 'polys' (%d).", (ntris+1)*nvp);
 		return false;
 	}
-	rcScopedDelete<unsigned short> pregs = (unsigned short*)rcAlloc(sizeof(unsigned short)*ntris, RC_ALLOC_TEMP);
+	rcScopedDelete<rcRegionId> pregs = (rcRegionId*)rcAlloc(sizeof(rcRegionId)*ntris, RC_ALLOC_TEMP);
 	if (!pregs)
 	{
 		ctx->log(RC_LOG_ERROR, "removeVertex: Out of memory 'pregs' (%d).", ntris);
@@ -819,7 +831,7 @@ static bool removeVertex(rcContext* ctx, rcPolyMesh& mesh, const unsigned short
 			polys[npolys*nvp+0] = (unsigned short)hole[t[0]];
 			polys[npolys*nvp+1] = (unsigned short)hole[t[1]];
 			polys[npolys*nvp+2] = (unsigned short)hole[t[2]];
-			pregs[npolys] = (unsigned short)hreg[t[0]];
+			pregs[npolys] = (rcRegionId)hreg[t[0]];
 			pareas[npolys] = (unsigned char)harea[t[0]];
 			npolys++;
 		}
@@ -951,7 +963,7 @@ bool rcBuildPolyMesh(rcContext* ctx, rcContourSet& cset, const int nvp, rcPolyMe
 		ctx->log(RC_LOG_ERROR, "rcBuildPolyMesh: Out of memory 'mesh.polys' (%d).", maxTris*nvp*2);
 		return false;
 	}
-	mesh.regs = (unsigned short*)rcAlloc(sizeof(unsigned short)*maxTris, RC_ALLOC_PERM);
+	mesh.regs = (rcRegionId*)rcAlloc(sizeof(rcRegionId)*maxTris, RC_ALLOC_PERM);
 	if (!mesh.regs)
 	{
 		ctx->log(RC_LOG_ERROR, "rcBuildPolyMesh: Out of memory 'mesh.regs' (%d).", maxTris);
@@ -971,25 +983,17 @@ bool rcBuildPolyMesh(rcContext* ctx, rcContourSet& cset, const int nvp, rcPolyMe
 	
 	memset(mesh.verts, 0, sizeof(unsigned short)*maxVertices*3);
 	memset(mesh.polys, 0xff, sizeof(unsigned short)*maxTris*nvp*2);
-	memset(mesh.regs, 0, sizeof(unsigned short)*maxTris);
+	memset(mesh.regs, 0, sizeof(rcRegionId)*maxTris);
 	memset(mesh.areas, 0, sizeof(unsigned char)*maxTris);
 	
-	rcScopedDelete<int> nextVert = (int*)rcAlloc(sizeof(int)*maxVertices, RC_ALLOC_TEMP);
-	if (!nextVert)
-	{
-		ctx->log(RC_LOG_ERROR, "rcBuildPolyMesh: Out of memory 'nextVert' (%d).", maxVertices);
-		return false;
-	}
-	memset(nextVert, 0, sizeof(int)*maxVertices);
-	
-	rcScopedDelete<int> firstVert = (int*)rcAlloc(sizeof(int)*VERTEX_BUCKET_COUNT, RC_ALLOC_TEMP);
-	if (!firstVert)
+	const int nbuckets = calcVertexBucketCount(maxVertices);
+	rcScopedDelete<int> buckets = (int*)rcAlloc(sizeof(int)*nbuckets, RC_ALLOC_TEMP);
+	if (!buckets)
 	{
-		ctx->log(RC_LOG_ERROR, "rcBuildPolyMesh: Out of memory 'firstVert' (%d).", VERTEX_BUCKET_COUNT);
+		ctx->log(RC_LOG_ERROR, "rcBuildPolyMesh: Out of memory 'buckets' (%d).", nbuckets);
 		return false;
 	}
-	for (int i = 0; i < VERTEX_BUCKET_COUNT; ++i)
-		firstVert[i] = -1;
+	memset(buckets, 0xff, sizeof(int)*nbuckets);
 	
 	rcScopedDelete<int> indices = (int*)rcAlloc(sizeof(int)*maxVertsPerCont, RC_ALLOC_TEMP);
 	if (!indices)
@@ -1046,7 +1050,7 @@ bool rcBuildPolyMesh(rcContext* ctx, rcContourSet& cset, const int nvp, rcPolyMe
 		{
 			const int* v = &cont.verts[j*4];
 			indices[j] = addVertex((unsigned short)v[0], (unsigned short)v[1], (unsigned short)v[2],
-								   mesh.verts, firstVert, nextVert, mesh.nverts);
+								   mesh.verts, buckets, nbuckets, mesh.nverts);
 			if (v[3] & RC_BORDER_VERTEX)
 			{
 				// This vertex should be removed.
@@ -1263,13 +1267,13 @@ bool rcMergePolyMeshes(rcContext* ctx, rcPolyMesh** meshes, const int nmeshes, r
 	}
 	memset(mesh.polys, 0xff, sizeof(unsigned short)*maxPolys*2*mesh.nvp);
 
-	mesh.regs = (unsigned short*)rcAlloc(sizeof(unsigned short)*maxPolys, RC_ALLOC_PERM);
+	mesh.regs = (rcRegionId*)rcAlloc(sizeof(rcRegionId)*maxPolys, RC_ALLOC_PERM);
 	if (!mesh.regs)
 	{
 		ctx->log(RC_LOG_ERROR, "rcMergePolyMeshes: Out of memory 'mesh.regs' (%d).", maxPolys);
 		return false;
 	}
-	memset(mesh.regs, 0, sizeof(unsigned short)*maxPolys);
+	memset(mesh.regs, 0, sizeof(rcRegionId)*maxPolys);
 
 	mesh.areas = (unsigned char*)rcAlloc(sizeof(unsigned char)*maxPolys, RC_ALLOC_PERM);
 	if (!mesh.areas)
@@ -1287,23 +1291,43 @@ bool rcMergePolyMeshes(rcContext* ctx, rcPolyMesh** meshes, const int nmeshes, r
 	}
 	memset(mesh.flags, 0, sizeof(unsigned short)*maxPolys);
 	
-	rcScopedDelete<int> nextVert = (int*)rcAlloc(sizeof(int)*maxVerts, RC_ALLOC_TEMP);
-	if (!nextVert)
+	const int nbuckets = calcVertexBucketCount(maxVerts);
+	rcScopedDelete<int> buckets = (int*)rcAlloc(sizeof(int)*nbuckets, RC_ALLOC_TEMP);
+	if (!buckets)
 	{
-		ctx->log(RC_LOG_ERROR, "rcMergePolyMeshes: Out of memory 'nextVert' (%d).", maxVerts);
+		ctx->log(RC_LOG_ERROR, "rcMergePolyMeshes: Out of memory 'buckets' (%d).", nbuckets);
 		return false;
 	}
-	memset(nextVert, 0, sizeof(int)*maxVerts);
+	memset(buckets, 0xff, sizeof(int)*nbuckets);
 	
-	rcScopedDelete<int> firstVert = (int*)rcAlloc(sizeof(int)*VERTEX_BUCKET_COUNT, RC_ALLOC_TEMP);
-	if (!firstVert)
+	// Calculate the xz-bounds of the meshes in merged mesh coordinates.
+	rcScopedDelete<int> bounds = (int*)rcAlloc(sizeof(int)*nmeshes*4, RC_ALLOC_TEMP);
+	if (!bounds)
 	{
-		ctx->log(RC_LOG_ERROR, "rcMergePolyMeshes: Out of memory 'firstVert' (%d).", VERTEX_BUCKET_COUNT);
+		ctx->log(RC_LOG_ERROR, "rcMergePolyMeshes: Out of memory 'bounds' (%d).", nmeshes*4);
 		return false;
 	}
-	for (int i = 0; i < VERTEX_BUCKET_COUNT; ++i)
-		firstVert[i] = -1;
-
+	for (int i = 0; i < nmeshes; ++i)
+	{
+		const rcPolyMesh* pmesh = meshes[i];
+		const unsigned short ox = (unsigned short)floorf((pmesh->bmin[0]-mesh.bmin[0])/mesh.cs+0.5f);
+		const unsigned short oz = (unsigned short)floorf((pmesh->bmin[2]-mesh.bmin[2])/mesh.cs+0.5f);
+		int* b = &bounds[i*4];
+		b[0] = b[1] = 0xffff;
+		b[2] = b[3] = 0;
+		for (int j = 0; j < pmesh->nverts; ++j)
+		{
+			const unsigned short* v = &pmesh->verts[j*3];
+			const int x = (unsigned short)(v[0]+ox);
+			const int z = (unsigned short)(v[2]+oz);
+			b[0] = rcMin(b[0], x);
+			b[1] = rcMin(b[1], z);
+			b[2] = rcMax(b[2], x);
+			b[3] = rcMax(b[3], z);
+		}
+	}
+	rcIntArray overlaps;
+	
 	rcScopedDelete<unsigned short> vremap = (unsigned short*)rcAlloc(sizeof(unsigned short)*maxVertsPerMesh, RC_ALLOC_PERM);
 	if (!vremap)
 	{
@@ -1319,11 +1343,41 @@ bool rcMergePolyMeshes(rcContext* ctx, rcPolyMesh** meshes, const int nmeshes, r
 		const unsigned short ox = (unsigned short)floorf((pmesh->bmin[0]-mesh.bmin[0])/mesh.cs+0.5f);
 		const unsigned short oz = (unsigned short)floorf((pmesh->bmin[2]-mesh.bmin[2])/mesh.cs+0.5f);
 		
+		// Find the meshes whose vertices may be shared with this mesh.
+		const int* bi = &bounds[i*4];
+		overlaps.resize(0);
+		for (int j = 0; j < nmeshes; ++j)
+		{
+			const int* bj = &bounds[j*4];
+			if (i != j && bi[0] <= bj[2] && bi[2] >= bj[0] && bi[1] <= bj[3] && bi[3] >= bj[1])
+				overlaps.push(j);
+		}
+		
 		for (int j = 0; j < pmesh->nverts; ++j)
 		{
 			unsigned short* v = &pmesh->verts[j*3];
-			vremap[j] = addVertex(v[0]+ox, v[1], v[2]+oz,
-								  mesh.verts, firstVert, nextVert, mesh.nverts);
+			const unsigned short x = (unsigned short)(v[0]+ox);
+			const unsigned short z = (unsigned short)(v[2]+oz);
+			bool shared = false;
+			for (int k = 0; k < overlaps.size() && !shared; ++k)
+			{
+				const int* bk = &bounds[overlaps[k]*4];
+				shared = x >= bk[0] && x <= bk[2] && z >= bk[1] && z <= bk[3];
+			}
+			if (shared)
+			{
+				vremap[j] = addVertex(x, v[1], z, mesh.verts, buckets, nbuckets, mesh.nverts);
+			}
+			else
+			{
+				// The vertices of a mesh are unique, and vertices outside the other
+				// meshes cannot be shared, so the vertex can be added without a lookup.
+				unsigned short* dst = &mesh.verts[mesh.nverts*3];
+				dst[0] = x;
+				dst[1] = v[1];
+				dst[2] = z;
+				vremap[j] = (unsigned short)mesh.nverts++;
+			}
 		}
 		
 		for (int j = 0; j < pmesh->npolys; ++j)
@@ -1400,13 +1454,13 @@ bool rcCopyPolyMesh(rcContext* ctx, const rcPolyMesh& src, rcPolyMesh& dst)
 	}
 	memcpy(dst.polys, src.polys, sizeof(unsigned short)*src.npolys*2*src.nvp);
 	
-	dst.regs = (unsigned short*)rcAlloc(sizeof(unsigned short)*src.npolys, RC_ALLOC_PERM);
+	dst.regs = (rcRegionId*)rcAlloc(sizeof(rcRegionId)*src.npolys, RC_ALLOC_PERM);
 	if (!dst.regs)
 	{
 		ctx->log(RC_LOG_ERROR, "rcCopyPolyMesh: Out of memory 'dst.regs' (%d).", src.npolys);
 		return false;
 	}
-	memcpy(dst.regs, src.regs, sizeof(unsigned short)*src.npolys);
+	memcpy(dst.regs, src.regs, sizeof(rcRegionId)*src.npolys);
 	
 	dst.areas = (unsigned char*)rcAlloc(sizeof(unsigned char)*src.npolys, RC_ALLOC_PERM);
 	if (!dst.areas)
@@ -160,9 +160,10 @@ static float distancePtSeg2d(const float* pt, const float* p, const float* q)
 	return dx*dx + dz*dz;
 }
 
-static float distToTriMesh(const float* p, const float* verts, const int /*nverts*/, const int* tris, const int ntris)
+static float distToTriMesh(const float* p, const float* verts, const int* tris, const int ntris, int& tri)
 {
 	float dmin = FLT_MAX;
+	tri = -1;
 	for (int i = 0; i < ntris; ++i)
 	{
 		const float* va = &verts[tris[i*4+0]*3];
@@ -170,7 +171,28 @@ static float distToTriMesh(const float* p, const float* verts, const int /*nvert
 		const float* vc = &verts[tris[i*4+2]*3];
 		float d = distPtTri(p, va,vb,vc);
 		if (d < dmin)
+		{
 			dmin = d;
+			tri = i;
+		}
+	}
+	if (dmin == FLT_MAX) return -1;
+	return dmin;
+}
+
+static float distToTriList(const float* p, const float* verts, const int* tris, const int* list, const int nlist, int& tri)
+{
+	float dmin = FLT_MAX;
+	tri = -1;
+	for (int i = 0; i < nlist; ++i)
+	{
+		const int* t = &tris[list[i]*4];
+		float d = distPtTri(p, &verts[t[0]*3], &verts[t[1]*3], &verts[t[2]*3]);
+		if (d < dmin)
+		{
+			dmin = d;
+			tri = list[i];
+		}
 	}
 	if (dmin == FLT_MAX) return -1;
 	return dmin;
@@ -490,6 +512,191 @@ static void delaunayHull(rcContext* ctx, const int npts, const float* pts,
 }
 
 
+static const int MAX_TRI_PTS = 256;
+static const int MAX_TRI_EDGES = 256*3;
+static const int MAX_TRI_CAVITY = 256;
+
+// Returns true if the triangulation has as many triangles as a triangulation of the hull
+// and the points inside it should have. delaunayHull() may fail to cover the hull or produce
+// overlapping triangles when there are many collinear points on the hull.
+inline bool isValidTriangulation(const int npts, const int nhull, const rcIntArray& tris)
+{
+	return tris.size()/4 == 2*(npts-nhull) + nhull-2;
+}
+
+// Finds the neighbour across each edge of the triangles, or -1 on the hull. The edge k
+// of triangle t goes from vertex k to vertex k+1, and its neighbour is stored in adj[t*3+k].
+// Returns false if the triangulation is too large.
+static bool buildTriAdjacency(const int npts, rcIntArray& tris, rcIntArray& adj)
+{
+	const int ntris = tris.size()/4;
+	if (npts > MAX_TRI_PTS || ntris*3 > MAX_TRI_EDGES)
+		return false;
+	
+	int firstEdge[MAX_TRI_PTS];
+	int nextEdge[MAX_TRI_EDGES];
+	for (int i = 0; i < npts; ++i)
+		firstEdge[i] = -1;
+	for (int i = 0; i < ntris*3; ++i)
+	{
+		const int a = tris[(i/3)*4 + i%3];
+		nextEdge[i] = firstEdge[a];
+		firstEdge[a] = i;
+	}
+	
+	adj.resize(ntris*3);
+	for (int i = 0; i < ntris*3; ++i)
+	{
+		const int a = tris[(i/3)*4 + i%3];
+		const int b = tris[(i/3)*4 + (i+1)%3];
+		adj[i] = -1;
+		for (int e = firstEdge[b]; e != -1; e = nextEdge[e])
+		{
+			if (tris[(e/3)*4 + (e+1)%3] == a)
+			{
+				adj[i] = e/3;
+				break;
+			}
+		}
+	}
+	
+	for (int i = 0; i < ntris; ++i)
+		tris[i*4+3] = 0;
+	
+	return true;
+}
+
+// Inserts the point p into the triangulation, Bowyer-Watson style. The triangles whose
+// circumcircle contains the point are removed, starting from tri which contains the point,
+// and the hole is filled with a fan of triangles around the point. The new triangles are
+// stored in fan, which can hold MAX_TRI_CAVITY+2 triangles. Returns false, leaving the
+// triangulation unchanged, if the hole cannot be made star shaped around the point.
+static bool insertPoint(const float* pts, const int p, const int tri, rcIntArray& tris, rcIntArray& adj,
+						int* fan, int& nfan)
+{
+	static const float EPS = 1e-5f;
+	int cavity[MAX_TRI_CAVITY];
+	int ncavity = 0;
+	int bound[(MAX_TRI_CAVITY+2)*3];
+	int nbound = 0;
+	
+	const float* pp = &pts[p*3];
+	tris[tri*4+3] = 1;
+	cavity[ncavity++] = tri;
+	
+	// Grow the cavity over the neighbours whose circumcircle contains the point.
+	for (int i = 0; i < ncavity; ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			const int n = adj[cavity[i]*3+k];
+			if (n == -1 || tris[n*4+3] == 1)
+				continue;
+			const int* t = &tris[n*4];
+			float c[3], r;
+			if (!circumCircle(&pts[t[0]*3], &pts[t[1]*3], &pts[t[2]*3], c, r))
+				continue;
+			if (vdist2(c, pp) >= r)
+				continue;
+			if (ncavity >= MAX_TRI_CAVITY)
+				break;
+			tris[n*4+3] = 1;
+			cavity[ncavity++] = n;
+		}
+	}
+	
+	// Collect the boundary of the cavity. The triangles are clockwise, add the triangles
+	// behind the edges which do not face the point, so that the fan will not fold over.
+	bool valid = true;
+	for (;;)
+	{
+		int hidden = -1;
+		nbound = 0;
+		for (int i = 0; i < ncavity && hidden == -1 && valid; ++i)
+		{
+			const int* t = &tris[cavity[i]*4];
+			for (int k = 0; k < 3; ++k)
+			{
+				const int n = adj[cavity[i]*3+k];
+				if (n != -1 && tris[n*4+3] == 1)
+					continue;
+				const int a = t[k];
+				const int b = t[(k+1)%3];
+				if (vcross2(&pts[a*3], &pts[b*3], pp) > -EPS)
+				{
+					if (n == -1)
+						valid = false;
+					hidden = n;
+					break;
+				}
+				bound[nbound*3+0] = a;
+				bound[nbound*3+1] = b;
+				bound[nbound*3+2] = n;
+				nbound++;
+			}
+		}
+		if (!valid || hidden == -1)
+			break;
+		if (ncavity >= MAX_TRI_CAVITY)
+		{
+			valid = false;
+			break;
+		}
+		tris[hidden*4+3] = 1;
+		cavity[ncavity++] = hidden;
+	}
+	
+	for (int i = 0; i < ncavity; ++i)
+		tris[cavity[i]*4+3] = 0;
+	
+	// A simple star shaped hole has two edges more than it has triangles.
+	if (!valid || nbound != ncavity+2)
+		return false;
+	
+	// Fill the hole with a fan, reusing the slots of the removed triangles.
+	const int ntris = tris.size()/4;
+	tris.resize((ntris+2)*4);
+	adj.resize((ntris+2)*3);
+	nfan = nbound;
+	for (int i = 0; i < nbound; ++i)
+		fan[i] = i < ncavity ? cavity[i] : ntris + (i-ncavity);
+	
+	for (int i = 0; i < nbound; ++i)
+	{
+		const int a = bound[i*3+0];
+		const int b = bound[i*3+1];
+		const int n = bound[i*3+2];
+		const int s = fan[i];
+		int* t = &tris[s*4];
+		t[0] = a;
+		t[1] = b;
+		t[2] = p;
+		t[3] = 0;
+		adj[s*3+0] = n;
+		adj[s*3+1] = -1;
+		adj[s*3+2] = -1;
+		for (int j = 0; j < nbound; ++j)
+		{
+			if (bound[j*3+0] == b)
+				adj[s*3+1] = fan[j];
+			if (bound[j*3+1] == a)
+				adj[s*3+2] = fan[j];
+		}
+		// Point the outside neighbour to the new triangle.
+		if (n != -1)
+		{
+			const int* nt = &tris[n*4];
+			for (int k = 0; k < 3; ++k)
+			{
+				if (nt[k] == b && nt[(k+1)%3] == a)
+					adj[n*3+k] = s;
+			}
+		}
+	}
+	
+	return true;
+}
+
 inline float getJitterX(const int i)
 {
 	return (((i * 0x8da6b343) & 0xffff) / 65535.0f * 2.0f) - 1.0f;
@@ -500,6 +707,15 @@ inline float getJitterY(const int i)
 	return (((i * 0xd8163841) & 0xffff) / 65535.0f * 2.0f) - 1.0f;
 }
 
+inline void getSamplePos(const int* s, const int i, const float sampleDist, const float cs, const float ch, float* pt)
+{
+	// The sample location is jittered to get rid of some bad triangulations
+	// which are cause by symmetrical data from the grid structure.
+	pt[0] = s[0]*sampleDist + getJitterX(i)*cs*0.1f;
+	pt[1] = s[1]*ch;
+	pt[2] = s[2]*sampleDist + getJitterY(i)*cs*0.1f;
+}
+
 static bool buildPolyDetail(rcContext* ctx, const float* in, const int nin,
 							const float sampleDist, const float sampleMaxError,
 							const rcCompactHeightfield& chf, const rcHeightPatch& hp,
@@ -685,33 +901,41 @@ static bool buildPolyDetail(rcContext* ctx, const float* in, const int nin,
 		// Add the samples starting from the one that has the most
 		// error. The procedure stops when all samples are added
 		// or when the max error is within treshold.
+		// The points are inserted into the triangulation incrementally, and
+		// the error of a sample is only updated when its triangle changes.
 		const int nsamples = samples.size()/4;
+		rcScopedDelete<float> serr = (float*)rcAlloc(sizeof(float)*rcMax(1,nsamples), RC_ALLOC_TEMP);
+		rcScopedDelete<int> stri = (int*)rcAlloc(sizeof(int)*rcMax(1,nsamples), RC_ALLOC_TEMP);
+		if (!serr || !stri)
+		{
+			ctx->log(RC_LOG_ERROR, "buildPolyDetail: Out of memory 'serr' (%d).", nsamples);
+			return false;
+		}
+		
+		bool incremental = isValidTriangulation(nverts, nhull, tris) && buildTriAdjacency(nverts, tris, edges);
+		for (int i = 0; i < nsamples; ++i)
+		{
+			float pt[3];
+			getSamplePos(&samples[i*4], i, sampleDist, cs, chf.ch, pt);
+			serr[i] = distToTriMesh(pt, verts, &tris[0], tris.size()/4, stri[i]);
+		}
+		
 		for (int iter = 0; iter < nsamples; ++iter)
 		{
 			if (nverts >= MAX_VERTS)
 				break;
 
 			// Find sample with most error.
-			float bestpt[3] = {0,0,0};
 			float bestd = 0;
 			int besti = -1;
 			for (int i = 0; i < nsamples; ++i)
 			{
-				const int* s = &samples[i*4];
-				if (s[3]) continue; // skip added.
-				float pt[3];
-				// The sample location is jittered to get rid of some bad triangulations
-				// which are cause by symmetrical data from the grid structure.
-				pt[0] = s[0]*sampleDist + getJitterX(i)*cs*0.1f;
-				pt[1] = s[1]*chf.ch;
-				pt[2] = s[2]*sampleDist + getJitterY(i)*cs*0.1f;
-				float d = distToTriMesh(pt, verts, nverts, &tris[0], tris.size()/4);
-				if (d < 0) continue; // did not hit the mesh.
-				if (d > bestd)
+				if (samples[i*4+3]) continue; // skip added.
+				if (stri[i] == -1) continue; // did not hit the mesh.
+				if (serr[i] > bestd)
 				{
-					bestd = d;
+					bestd = serr[i];
 					besti = i;
-					rcVcopy(bestpt,pt);
 				}
 			}
 			// If the max error is within accepted threshold, stop tesselating.
@@ -720,15 +944,45 @@ static bool buildPolyDetail(rcContext* ctx, const float* in, const int nin,
 			// Mark sample as added.
 			samples[besti*4+3] = 1;
 			// Add the new sample point.
-			rcVcopy(&verts[nverts*3],bestpt);
+			getSamplePos(&samples[besti*4], besti, sampleDist, cs, chf.ch, &verts[nverts*3]);
 			nverts++;
 			
-			// Create new triangulation.
-			// TODO: Incremental add instead of full rebuild.
-			edges.resize(0);
-			tris.resize(0);
-			delaunayHull(ctx, nverts, verts, nhull, hull, tris, edges);
-		}		
+			int fan[MAX_TRI_CAVITY+2];
+			int nfan = 0;
+			if (incremental && insertPoint(verts, nverts-1, stri[besti], tris, edges, fan, nfan))
+			{
+				// Update the samples which were inside the removed triangles.
+				for (int i = 0; i < nfan; ++i)
+					tris[fan[i]*4+3] = 1;
+				for (int i = 0; i < nsamples; ++i)
+				{
+					if (samples[i*4+3] || stri[i] == -1 || tris[stri[i]*4+3] != 1)
+						continue;
+					float pt[3];
+					getSamplePos(&samples[i*4], i, sampleDist, cs, chf.ch, pt);
+					serr[i] = distToTriList(pt, verts, &tris[0], fan, nfan, stri[i]);
+					if (stri[i] == -1)
+						serr[i] = distToTriMesh(pt, verts, &tris[0], tris.size()/4, stri[i]);
+				}
+				for (int i = 0; i < nfan; ++i)
+					tris[fan[i]*4+3] = 0;
+			}
+			else
+			{
+				// Create new triangulation.
+				edges.resize(0);
+				tris.resize(0);
+				delaunayHull(ctx, nverts, verts, nhull, hull, tris, edges);
+				incremental = isValidTriangulation(nverts, nhull, tris) && buildTriAdjacency(nverts, tris, edges);
+				for (int i = 0; i < nsamples; ++i)
+				{
+					if (samples[i*4+3]) continue;
+					float pt[3];
+					getSamplePos(&samples[i*4], i, sampleDist, cs, chf.ch, pt);
+					serr[i] = distToTriMesh(pt, verts, &tris[0], tris.size()/4, stri[i]);
+				}
+			}
+		}
 	}
 
 	const int ntris = tris.size()/4;
@@ -941,10 +1195,256 @@ static unsigned char getTriFlags(const float* va, const float* vb, const float*
 	return flags;
 }
 
+static const int RC_MAX_DETAIL_CHUNKS = 64;
+
+// Collects the messages logged by a job, so that they can be passed on to the
+// build context in polygon order once all the jobs are done.
+class rcDetailLog : public rcContext
+{
+public:
+	inline rcDetailLog() : m_text(0), m_size(0), m_cap(0) {}
+	inline ~rcDetailLog() { rcFree(m_text); }
+	
+	void flush(rcContext* ctx)
+	{
+		for (int i = 0; i < m_size; i += (int)strlen(&m_text[i+1]) + 2)
+			ctx->log((rcLogCategory)m_text[i], "%s", &m_text[i+1]);
+		m_size = 0;
+	}
+	
+protected:
+	virtual void doLog(const rcLogCategory category, const char* msg, const int len)
+	{
+		if (m_size+len+2 > m_cap)
+		{
+			const int cap = rcMax(m_cap*2, m_size+len+2+256);
+			char* text = (char*)rcAlloc(sizeof(char)*cap, RC_ALLOC_TEMP);
+			if (!text)
+				return;
+			if (m_size)
+				memcpy(text, m_text, m_size);
+			rcFree(m_text);
+			m_text = text;
+			m_cap = cap;
+		}
+		m_text[m_size++] = (char)category;
+		memcpy(&m_text[m_size], msg, len);
+		m_size += len;
+		m_text[m_size++] = '\0';
+	}
+	
+private:
+	char* m_text;
+	int m_size, m_cap;
+};
+
+// The detail meshes of a range of polygons, built by one job.
+struct rcDetailChunk
+{
+	inline rcDetailChunk() : polyMin(0), polyMax(0), verts(0), nverts(0), tris(0), ntris(0), failed(false) {}
+	inline ~rcDetailChunk() { rcFree(verts); rcFree(tris); }
+	int polyMin, polyMax;	// The polygons [polyMin, polyMax) of the chunk.
+	float* verts;			// The detail vertices of the chunk.
+	int nverts;
+	unsigned char* tris;	// The detail triangles of the chunk.
+	int ntris;
+	bool failed;			// True if the chunk ran out of memory.
+	rcDetailLog log;		// The messages logged while building the chunk.
+};
+
+// Builds the detail meshes of the polygons of a chunk. The submesh of each polygon
+// is stored in the polygon's slot in meshes, relative to the start of the chunk.
+struct rcBuildDetailJob : public rcJob
+{
+	inline rcBuildDetailJob(const rcPolyMesh& m, const rcCompactHeightfield& c,
+							const float sd, const float sme, const int* b, const int hw, const int hh,
+							unsigned int* ms, rcDetailChunk* ch) :
+		mesh(m), chf(c), sampleDist(sd), sampleMaxError(sme), bounds(b), maxhw(hw), maxhh(hh),
+		meshes(ms), chunks(ch) {}
+	virtual void run(const int index)
+	{
+		rcDetailChunk& chunk = chunks[index];
+		rcContext* ctx = &chunk.log;
+		
+		const int nvp = mesh.nvp;
+		const float cs = mesh.cs;
+		const float ch = mesh.ch;
+		const float* orig = mesh.bmin;
+		const int borderSize = mesh.borderSize;
+		
+		rcIntArray edges(64);
+		rcIntArray tris(512);
+		rcIntArray stack(512);
+		rcIntArray samples(512);
+		float verts[256*3];
+		rcHeightPatch hp;
+		
+		rcScopedDelete<float> poly = (float*)rcAlloc(sizeof(float)*nvp*3, RC_ALLOC_TEMP);
+		if (!poly)
+		{
+			ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'poly' (%d).", nvp*3);
+			chunk.failed = true;
+			return;
+		}
+		hp.data = (unsigned short*)rcAlloc(sizeof(unsigned short)*maxhw*maxhh, RC_ALLOC_TEMP);
+		if (!hp.data)
+		{
+			ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'hp.data' (%d).", maxhw*maxhh);
+			chunk.failed = true;
+			return;
+		}
+		
+		int nPolyVerts = 0;
+		for (int i = chunk.polyMin; i < chunk.polyMax; ++i)
+		{
+			const unsigned short* p = &mesh.polys[i*nvp*2];
+			for (int j = 0; j < nvp && p[j] != RC_MESH_NULL_IDX; ++j)
+				nPolyVerts++;
+		}
+		
+		int vcap = nPolyVerts+nPolyVerts/2;
+		int tcap = vcap*2;
+		
+		chunk.nverts = 0;
+		chunk.verts = (float*)rcAlloc(sizeof(float)*vcap*3, RC_ALLOC_TEMP);
+		if (!chunk.verts)
+		{
+			ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'verts' (%d).", vcap*3);
+			chunk.failed = true;
+			return;
+		}
+		chunk.ntris = 0;
+		chunk.tris = (unsigned char*)rcAlloc(sizeof(unsigned char)*tcap*4, RC_ALLOC_TEMP);
+		if (!chunk.tris)
+		{
+			ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'tris' (%d).", tcap*4);
+			chunk.failed = true;
+			return;
+		}
+		
+		for (int i = chunk.polyMin; i < chunk.polyMax; ++i)
+		{
+			const unsigned short* p = &mesh.polys[i*nvp*2];
+			
+			// Store polygon vertices for processing.
+			int npoly = 0;
+			for (int j = 0; j < nvp; ++j)
+			{
+				if(p[j] == RC_MESH_NULL_IDX) break;
+				const unsigned short* v = &mesh.verts[p[j]*3];
+				poly[j*3+0] = v[0]*cs;
+				poly[j*3+1] = v[1]*ch;
+				poly[j*3+2] = v[2]*cs;
+				npoly++;
+			}
+			
+			// Get the height data from the area of the polygon.
+			hp.xmin = bounds[i*4+0];
+			hp.ymin = bounds[i*4+2];
+			hp.width = bounds[i*4+1]-bounds[i*4+0];
+			hp.height = bounds[i*4+3]-bounds[i*4+2];
+			getHeightData(chf, p, npoly, mesh.verts, borderSize, hp, stack);
+			
+			// Build detail mesh.
+			int nverts = 0;
+			if (!buildPolyDetail(ctx, poly, npoly,
+								 sampleDist, sampleMaxError,
+								 chf, hp, verts, nverts, tris,
+								 edges, samples))
+			{
+				chunk.failed = true;
+				return;
+			}
+			
+			// Move detail verts to world space.
+			for (int j = 0; j < nverts; ++j)
+			{
+				verts[j*3+0] += orig[0];
+				verts[j*3+1] += orig[1] + chf.ch; // Is this offset necessary?
+				verts[j*3+2] += orig[2];
+			}
+			// Offset poly too, will be used to flag checking.
+			for (int j = 0; j < npoly; ++j)
+			{
+				poly[j*3+0] += orig[0];
+				poly[j*3+1] += orig[1];
+				poly[j*3+2] += orig[2];
+			}
+			
+			// Store detail submesh.
+			const int ntris = tris.size()/4;
+			
+			meshes[i*4+0] = (unsigned int)chunk.nverts;
+			meshes[i*4+1] = (unsigned int)nverts;
+			meshes[i*4+2] = (unsigned int)chunk.ntris;
+			meshes[i*4+3] = (unsigned int)ntris;
+			
+			// Store vertices, allocate more memory if necessary.
+			if (chunk.nverts+nverts > vcap)
+			{
+				while (chunk.nverts+nverts > vcap)
+					vcap += 256;
+				
+				float* newv = (float*)rcAlloc(sizeof(float)*vcap*3, RC_ALLOC_TEMP);
+				if (!newv)
+				{
+					ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'newv' (%d).", vcap*3);
+					chunk.failed = true;
+					return;
+				}
+				if (chunk.nverts)
+					memcpy(newv, chunk.verts, sizeof(float)*3*chunk.nverts);
+				rcFree(chunk.verts);
+				chunk.verts = newv;
+			}
+			memcpy(&chunk.verts[chunk.nverts*3], verts, sizeof(float)*3*nverts);
+			chunk.nverts += nverts;
+			
+			// Store triangles, allocate more memory if necessary.
+			if (chunk.ntris+ntris > tcap)
+			{
+				while (chunk.ntris+ntris > tcap)
+					tcap += 256;
+				unsigned char* newt = (unsigned char*)rcAlloc(sizeof(unsigned char)*tcap*4, RC_ALLOC_TEMP);
+				if (!newt)
+				{
+					ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'newt' (%d).", tcap*4);
+					chunk.failed = true;
+					return;
+				}
+				if (chunk.ntris)
+					memcpy(newt, chunk.tris, sizeof(unsigned char)*4*chunk.ntris);
+				rcFree(chunk.tris);
+				chunk.tris = newt;
+			}
+			for (int j = 0; j < ntris; ++j)
+			{
+				const int* t = &tris[j*4];
+				chunk.tris[chunk.ntris*4+0] = (unsigned char)t[0];
+				chunk.tris[chunk.ntris*4+1] = (unsigned char)t[1];
+				chunk.tris[chunk.ntris*4+2] = (unsigned char)t[2];
+				chunk.tris[chunk.ntris*4+3] = getTriFlags(&verts[t[0]*3], &verts[t[1]*3], &verts[t[2]*3], poly, npoly);
+				chunk.ntris++;
+			}
+		}
+	}
+	const rcPolyMesh& mesh;
+	const rcCompactHeightfield& chf;
+	float sampleDist;
+	float sampleMaxError;
+	const int* bounds;
+	int maxhw, maxhh;
+	unsigned int* meshes;
+	rcDetailChunk* chunks;
+};
+
 /// @par
 ///
 /// See the #rcConfig documentation for more information on the configuration parameters.
 ///
+/// The polygons are processed in batches as jobs through rcContext::runJobs. The resulting
+/// detail mesh does not depend on how the jobs are run.
+///
 /// @see rcAllocPolyMeshDetail, rcPolyMesh, rcCompactHeightfield, rcPolyMeshDetail, rcConfig
 bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompactHeightfield& chf,
 						   const float sampleDist, const float sampleMaxError,
@@ -958,19 +1458,8 @@ bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompa
 		return true;
 	
 	const int nvp = mesh.nvp;
-	const float cs = mesh.cs;
-	const float ch = mesh.ch;
-	const float* orig = mesh.bmin;
-	const int borderSize = mesh.borderSize;
-	
-	rcIntArray edges(64);
-	rcIntArray tris(512);
-	rcIntArray stack(512);
-	rcIntArray samples(512);
-	float verts[256*3];
-	rcHeightPatch hp;
-	int nPolyVerts = 0;
 	int maxhw = 0, maxhh = 0;
+	int totalArea = 0;
 	
 	rcScopedDelete<int> bounds = (int*)rcAlloc(sizeof(int)*mesh.npolys*4, RC_ALLOC_TEMP);
 	if (!bounds)
@@ -978,12 +1467,6 @@ bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompa
 		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'bounds' (%d).", mesh.npolys*4);
 		return false;
 	}
-	rcScopedDelete<float> poly = (float*)rcAlloc(sizeof(float)*nvp*3, RC_ALLOC_TEMP);
-	if (!poly)
-	{
-		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'poly' (%d).", nvp*3);
-		return false;
-	}
 	
 	// Find max size for a polygon area.
 	for (int i = 0; i < mesh.npolys; ++i)
@@ -1005,7 +1488,6 @@ bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompa
 			xmax = rcMax(xmax, (int)v[0]);
 			ymin = rcMin(ymin, (int)v[2]);
 			ymax = rcMax(ymax, (int)v[2]);
-			nPolyVerts++;
 		}
 		xmin = rcMax(0,xmin-1);
 		xmax = rcMin(chf.width,xmax+1);
@@ -1014,13 +1496,7 @@ bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompa
 		if (xmin >= xmax || ymin >= ymax) continue;
 		maxhw = rcMax(maxhw, xmax-xmin);
 		maxhh = rcMax(maxhh, ymax-ymin);
-	}
-	
-	hp.data = (unsigned short*)rcAlloc(sizeof(unsigned short)*maxhw*maxhh, RC_ALLOC_TEMP);
-	if (!hp.data)
-	{
-		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'hp.data' (%d).", maxhw*maxhh);
-		return false;
+		totalArea += (xmax-xmin)*(ymax-ymin);
 	}
 	
 	dmesh.nmeshes = mesh.npolys;
@@ -1032,133 +1508,73 @@ bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompa
 		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'dmesh.meshes' (%d).", dmesh.nmeshes*4);
 		return false;
 	}
+	
+	// Split the polygons into chunks of about the same height patch area,
+	// the cost of a polygon grows with the number of samples inside it.
+	rcDetailChunk chunks[RC_MAX_DETAIL_CHUNKS];
+	int nchunks = 0;
+	const int chunkArea = rcMax(1, (totalArea + RC_MAX_DETAIL_CHUNKS-1) / RC_MAX_DETAIL_CHUNKS);
+	for (int i = 0; i < mesh.npolys; )
+	{
+		rcDetailChunk& chunk = chunks[nchunks++];
+		chunk.polyMin = i;
+		int area = 0;
+		while (i < mesh.npolys && (area < chunkArea || nchunks == RC_MAX_DETAIL_CHUNKS))
+		{
+			const int* b = &bounds[i*4];
+			if (b[0] < b[1] && b[2] < b[3])
+				area += (b[1]-b[0])*(b[3]-b[2]);
+			++i;
+		}
+		chunk.polyMax = i;
+	}
+	
+	rcBuildDetailJob job(mesh, chf, sampleDist, sampleMaxError, bounds, maxhw, maxhh, dmesh.meshes, chunks);
+	ctx->runJobs(&job, nchunks);
+	
+	// Pass on the messages of the jobs and store the chunks in polygon order.
+	bool failed = false;
+	for (int i = 0; i < nchunks; ++i)
+	{
+		chunks[i].log.flush(ctx);
+		if (chunks[i].failed)
+			failed = true;
+		dmesh.nverts += chunks[i].nverts;
+		dmesh.ntris += chunks[i].ntris;
+	}
+	if (failed)
+		return false;
 
-	int vcap = nPolyVerts+nPolyVerts/2;
-	int tcap = vcap*2;
-
-	dmesh.nverts = 0;
-	dmesh.verts = (float*)rcAlloc(sizeof(float)*vcap*3, RC_ALLOC_PERM);
+	dmesh.verts = (float*)rcAlloc(sizeof(float)*dmesh.nverts*3, RC_ALLOC_PERM);
 	if (!dmesh.verts)
 	{
-		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'dmesh.verts' (%d).", vcap*3);
+		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'dmesh.verts' (%d).", dmesh.nverts*3);
 		return false;
 	}
-	dmesh.ntris = 0;
-	dmesh.tris = (unsigned char*)rcAlloc(sizeof(unsigned char*)*tcap*4, RC_ALLOC_PERM);
+	dmesh.tris = (unsigned char*)rcAlloc(sizeof(unsigned char)*dmesh.ntris*4, RC_ALLOC_PERM);
 	if (!dmesh.tris)
 	{
-		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'dmesh.tris' (%d).", tcap*4);
+		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'dmesh.tris' (%d).", dmesh.ntris*4);
 		return false;
 	}
 	
-	for (int i = 0; i < mesh.npolys; ++i)
+	int vbase = 0, tbase = 0;
+	for (int i = 0; i < nchunks; ++i)
 	{
-		const unsigned short* p = &mesh.polys[i*nvp*2];
-		
-		// Store polygon vertices for processing.
-		int npoly = 0;
-		for (int j = 0; j < nvp; ++j)
-		{
-			if(p[j] == RC_MESH_NULL_IDX) break;
-			const unsigned short* v = &mesh.verts[p[j]*3];
-			poly[j*3+0] = v[0]*cs;
-			poly[j*3+1] = v[1]*ch;
-			poly[j*3+2] = v[2]*cs;
-			npoly++;
-		}
-		
-		// Get the height data from the area of the polygon.
-		hp.xmin = bounds[i*4+0];
-		hp.ymin = bounds[i*4+2];
-		hp.width = bounds[i*4+1]-bounds[i*4+0];
-		hp.height = bounds[i*4+3]-bounds[i*4+2];
-		getHeightData(chf, p, npoly, mesh.verts, borderSize, hp, stack);
-		
-		// Build detail mesh.
-		int nverts = 0;
-		if (!buildPolyDetail(ctx, poly, npoly,
-							 sampleDist, sampleMaxError,
-							 chf, hp, verts, nverts, tris,
-							 edges, samples))
-		{
-			return false;
-		}
-
-		// Move detail verts to world space.
-		for (int j = 0; j < nverts; ++j)
-		{
-			verts[j*3+0] += orig[0];
-			verts[j*3+1] += orig[1] + chf.ch; // Is this offset necessary?
-			verts[j*3+2] += orig[2];
-		}
-		// Offset poly too, will be used to flag checking.
-		for (int j = 0; j < npoly; ++j)
-		{
-			poly[j*3+0] += orig[0];
-			poly[j*3+1] += orig[1];
-			poly[j*3+2] += orig[2];
-		}
-	
-		// Store detail submesh.
-		const int ntris = tris.size()/4;
-
-		dmesh.meshes[i*4+0] = (unsigned int)dmesh.nverts;
-		dmesh.meshes[i*4+1] = (unsigned int)nverts;
-		dmesh.meshes[i*4+2] = (unsigned int)dmesh.ntris;
-		dmesh.meshes[i*4+3] = (unsigned int)ntris;		
-		
-		// Store vertices, allocate more memory if necessary.
-		if (dmesh.nverts+nverts > vcap)
+		const rcDetailChunk& chunk = chunks[i];
+		for (int j = chunk.polyMin; j < chunk.polyMax; ++j)
 		{
-			while (dmesh.nverts+nverts > vcap)
-				vcap += 256;
-				
-			float* newv = (float*)rcAlloc(sizeof(float)*vcap*3, RC_ALLOC_PERM);
-			if (!newv)
-			{
-				ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'newv' (%d).", vcap*3);
-				return false;
-			}
-			if (dmesh.nverts)
-				memcpy(newv, dmesh.verts, sizeof(float)*3*dmesh.nverts);
-			rcFree(dmesh.verts);
-			dmesh.verts = newv;
-		}
-		for (int j = 0; j < nverts; ++j)
-		{
-			dmesh.verts[dmesh.nverts*3+0] = verts[j*3+0];
-			dmesh.verts[dmesh.nverts*3+1] = verts[j*3+1];
-			dmesh.verts[dmesh.nverts*3+2] = verts[j*3+2];
-			dmesh.nverts++;
-		}
-		
-		// Store triangles, allocate more memory if necessary.
-		if (dmesh.ntris+ntris > tcap)
-		{
-			while (dmesh.ntris+ntris > tcap)
-				tcap += 256;
-			unsigned char* newt = (unsigned char*)rcAlloc(sizeof(unsigned char)*tcap*4, RC_ALLOC_PERM);
-			if (!newt)
-			{
-				ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'newt' (%d).", tcap*4);
-				return false;
-			}
-			if (dmesh.ntris)
-				memcpy(newt, dmesh.tris, sizeof(unsigned char)*4*dmesh.ntris);
-			rcFree(dmesh.tris);
-			dmesh.tris = newt;
-		}
-		for (int j = 0; j < ntris; ++j)
-		{
-			const int* t = &tris[j*4];
-			dmesh.tris[dmesh.ntris*4+0] = (unsigned char)t[0];
-			dmesh.tris[dmesh.ntris*4+1] = (unsigned char)t[1];
-			dmesh.tris[dmesh.ntris*4+2] = (unsigned char)t[2];
-			dmesh.tris[dmesh.ntris*4+3] = getTriFlags(&verts[t[0]*3], &verts[t[1]*3], &verts[t[2]*3], poly, npoly);
-			dmesh.ntris++;
+			dmesh.meshes[j*4+0] += (unsigned int)vbase;
+			dmesh.meshes[j*4+2] += (unsigned int)tbase;
 		}
+		if (chunk.nverts)
+			memcpy(&dmesh.verts[vbase*3], chunk.verts, sizeof(float)*3*chunk.nverts);
+		if (chunk.ntris)
+			memcpy(&dmesh.tris[tbase*4], chunk.tris, sizeof(unsigned char)*4*chunk.ntris);
+		vbase += chunk.nverts;
+		tbase += chunk.ntris;
 	}
-		
+	
 	ctx->stopTimer(RC_TIMER_BUILD_POLYMESHDETAIL);
 
 	return true;
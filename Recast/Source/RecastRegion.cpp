@@ -28,19 +28,24 @@
 #include <new>
 
 
-static void calculateDistanceField(rcCompactHeightfield& chf, unsigned short* src, unsigned short& maxDist)
+static const int RC_MAX_DIST_TILES = 16;
+static const int RC_MIN_DIST_TILE_SIZE = 32;
+static const int RC_MAX_BLUR_BANDS = 64;
+
+// Pass 1 of the distance field over the rows [y0,y1) and the cells of each row
+// whose x+y is in [u0,u1), see rcDistanceFieldJob. The boundary
+// cells are marked as they are visited. The neighbours read by the pass
+// precede the span in raster order and are already done.
+static void distanceForward(const rcCompactHeightfield& chf, unsigned short* src,
+							const int u0, const int y0, const int u1, const int y1)
 {
 	const int w = chf.width;
-	const int h = chf.height;
-	
-	// Init distance and points.
-	for (int i = 0; i < chf.spanCount; ++i)
-		src[i] = 0xffff;
 	
-	// Mark boundary cells.
-	for (int y = 0; y < h; ++y)
+	for (int y = y0; y < y1; ++y)
 	{
-		for (int x = 0; x < w; ++x)
+		const int x0 = rcMax(0, u0-y);
+		const int x1 = rcMin(w, u1-y);
+		for (int x = x0; x < x1; ++x)
 		{
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
@@ -48,6 +53,7 @@ static void calculateDistanceField(rcCompactHeightfield& chf, unsigned short* sr
 				const rcCompactSpan& s = chf.spans[i];
 				const unsigned char area = chf.areas[i];
 				
+				// Mark boundary cells.
 				int nc = 0;
 				for (int dir = 0; dir < 4; ++dir)
 				{
@@ -61,159 +67,227 @@ static void calculateDistanceField(rcCompactHeightfield& chf, unsigned short* sr
 					}
 				}
 				if (nc != 4)
+				{
 					src[i] = 0;
-			}
-		}
-	}
-	
-			
-	// Pass 1
-	for (int y = 0; y < h; ++y)
-	{
-		for (int x = 0; x < w; ++x)
-		{
-			const rcCompactCell& c = chf.cells[x+y*w];
-			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
-			{
-				const rcCompactSpan& s = chf.spans[i];
+					continue;
+				}
+				src[i] = 0xffff;
 				
-				if (rcGetCon(s, 0) != RC_NOT_CONNECTED)
+				// (-1,0)
+				const int ax0 = x + rcGetDirOffsetX(0);
+				const int ay0 = y + rcGetDirOffsetY(0);
+				const int ai0 = (int)chf.cells[ax0+ay0*w].index + rcGetCon(s, 0);
+				const rcCompactSpan& as0 = chf.spans[ai0];
+				if (src[ai0]+2 < src[i])
+					src[i] = src[ai0]+2;
+				
+				// (-1,-1)
+				if (rcGetCon(as0, 3) != RC_NOT_CONNECTED)
 				{
-					// (-1,0)
-					const int ax = x + rcGetDirOffsetX(0);
-					const int ay = y + rcGetDirOffsetY(0);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 0);
-					const rcCompactSpan& as = chf.spans[ai];
-					if (src[ai]+2 < src[i])
-						src[i] = src[ai]+2;
-					
-					// (-1,-1)
-					if (rcGetCon(as, 3) != RC_NOT_CONNECTED)
-					{
-						const int aax = ax + rcGetDirOffsetX(3);
-						const int aay = ay + rcGetDirOffsetY(3);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 3);
-						if (src[aai]+3 < src[i])
-							src[i] = src[aai]+3;
-					}
+					const int aax = ax0 + rcGetDirOffsetX(3);
+					const int aay = ay0 + rcGetDirOffsetY(3);
+					const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as0, 3);
+					if (src[aai]+3 < src[i])
+						src[i] = src[aai]+3;
 				}
-				if (rcGetCon(s, 3) != RC_NOT_CONNECTED)
+				
+				// (0,-1)
+				const int ax3 = x + rcGetDirOffsetX(3);
+				const int ay3 = y + rcGetDirOffsetY(3);
+				const int ai3 = (int)chf.cells[ax3+ay3*w].index + rcGetCon(s, 3);
+				const rcCompactSpan& as3 = chf.spans[ai3];
+				if (src[ai3]+2 < src[i])
+					src[i] = src[ai3]+2;
+				
+				// (1,-1)
+				if (rcGetCon(as3, 2) != RC_NOT_CONNECTED)
 				{
-					// (0,-1)
-					const int ax = x + rcGetDirOffsetX(3);
-					const int ay = y + rcGetDirOffsetY(3);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 3);
-					const rcCompactSpan& as = chf.spans[ai];
-					if (src[ai]+2 < src[i])
-						src[i] = src[ai]+2;
-					
-					// (1,-1)
-					if (rcGetCon(as, 2) != RC_NOT_CONNECTED)
-					{
-						const int aax = ax + rcGetDirOffsetX(2);
-						const int aay = ay + rcGetDirOffsetY(2);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 2);
-						if (src[aai]+3 < src[i])
-							src[i] = src[aai]+3;
-					}
+					const int aax = ax3 + rcGetDirOffsetX(2);
+					const int aay = ay3 + rcGetDirOffsetY(2);
+					const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as3, 2);
+					if (src[aai]+3 < src[i])
+						src[i] = src[aai]+3;
 				}
 			}
 		}
 	}
+}
+
+// Pass 2 of the distance field over the same cells as distanceForward, in
+// reverse raster order. The distances are final once the span is visited.
+static unsigned short distanceBackward(const rcCompactHeightfield& chf, unsigned short* src,
+									   const int u0, const int y0, const int u1, const int y1)
+{
+	const int w = chf.width;
+	unsigned short maxDist = 0;
 	
-	// Pass 2
-	for (int y = h-1; y >= 0; --y)
+	for (int y = y1-1; y >= y0; --y)
 	{
-		for (int x = w-1; x >= 0; --x)
+		const int x0 = rcMax(0, u0-y);
+		const int x1 = rcMin(w, u1-y);
+		for (int x = x1-1; x >= x0; --x)
 		{
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
+				// Boundary cells stay at zero, all the other cells are connected in every direction.
+				if (src[i] == 0)
+					continue;
+				
 				const rcCompactSpan& s = chf.spans[i];
 				
-				if (rcGetCon(s, 2) != RC_NOT_CONNECTED)
+				// (1,0)
+				const int ax2 = x + rcGetDirOffsetX(2);
+				const int ay2 = y + rcGetDirOffsetY(2);
+				const int ai2 = (int)chf.cells[ax2+ay2*w].index + rcGetCon(s, 2);
+				const rcCompactSpan& as2 = chf.spans[ai2];
+				if (src[ai2]+2 < src[i])
+					src[i] = src[ai2]+2;
+				
+				// (1,1)
+				if (rcGetCon(as2, 1) != RC_NOT_CONNECTED)
 				{
-					// (1,0)
-					const int ax = x + rcGetDirOffsetX(2);
-					const int ay = y + rcGetDirOffsetY(2);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 2);
-					const rcCompactSpan& as = chf.spans[ai];
-					if (src[ai]+2 < src[i])
-						src[i] = src[ai]+2;
-					
-					// (1,1)
-					if (rcGetCon(as, 1) != RC_NOT_CONNECTED)
-					{
-						const int aax = ax + rcGetDirOffsetX(1);
-						const int aay = ay + rcGetDirOffsetY(1);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 1);
-						if (src[aai]+3 < src[i])
-							src[i] = src[aai]+3;
-					}
+					const int aax = ax2 + rcGetDirOffsetX(1);
+					const int aay = ay2 + rcGetDirOffsetY(1);
+					const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as2, 1);
+					if (src[aai]+3 < src[i])
+						src[i] = src[aai]+3;
 				}
-				if (rcGetCon(s, 1) != RC_NOT_CONNECTED)
+				
+				// (0,1)
+				const int ax1 = x + rcGetDirOffsetX(1);
+				const int ay1 = y + rcGetDirOffsetY(1);
+				const int ai1 = (int)chf.cells[ax1+ay1*w].index + rcGetCon(s, 1);
+				const rcCompactSpan& as1 = chf.spans[ai1];
+				if (src[ai1]+2 < src[i])
+					src[i] = src[ai1]+2;
+				
+				// (-1,1)
+				if (rcGetCon(as1, 0) != RC_NOT_CONNECTED)
 				{
-					// (0,1)
-					const int ax = x + rcGetDirOffsetX(1);
-					const int ay = y + rcGetDirOffsetY(1);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 1);
-					const rcCompactSpan& as = chf.spans[ai];
-					if (src[ai]+2 < src[i])
-						src[i] = src[ai]+2;
-					
-					// (-1,1)
-					if (rcGetCon(as, 0) != RC_NOT_CONNECTED)
-					{
-						const int aax = ax + rcGetDirOffsetX(0);
-						const int aay = ay + rcGetDirOffsetY(0);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 0);
-						if (src[aai]+3 < src[i])
-							src[i] = src[aai]+3;
-					}
+					const int aax = ax1 + rcGetDirOffsetX(0);
+					const int aay = ay1 + rcGetDirOffsetY(0);
+					const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as1, 0);
+					if (src[aai]+3 < src[i])
+						src[i] = src[aai]+3;
 				}
+				
+				maxDist = rcMax(src[i], maxDist);
 			}
 		}
-	}	
+	}
+	return maxDist;
+}
+
+// Runs one wavefront of a distance field pass. The field is split into tiles
+// of rows and skewed columns, the column tx holds the cells whose x+y falls in
+// its range. The first pass reads the neighbours (-1,0), (-1,-1), (0,-1) and
+// (1,-1) of a cell, which are in the same column or the column to the left,
+// so the tile (tx,ty) only reads the tiles (tx-1,ty), (tx,ty-1) and
+// (tx-1,ty-1). The tiles with the same tx+ty are independent once the earlier
+// fronts are done. The second pass runs the same fronts on the mirrored grid.
+struct rcDistanceFieldJob : public rcJob
+{
+	inline rcDistanceFieldJob(const rcCompactHeightfield& c, unsigned short* s) :
+		chf(c), src(s), forward(true), front(0), tymin(0)
+	{
+		ncols = chf.width + chf.height - 1;
+		ntx = rcClamp(ncols / RC_MIN_DIST_TILE_SIZE, 1, RC_MAX_DIST_TILES);
+		nty = rcClamp(chf.height / RC_MIN_DIST_TILE_SIZE, 1, RC_MAX_DIST_TILES);
+	}
 	
-	maxDist = 0;
-	for (int i = 0; i < chf.spanCount; ++i)
-		maxDist = rcMax(src[i], maxDist);
+	inline int getFrontCount() const { return ntx + nty - 1; }
 	
-}
+	// Selects the front to run, and returns the number of tiles in it.
+	inline int setFront(const int f, const bool fwd)
+	{
+		front = f;
+		forward = fwd;
+		tymin = rcMax(0, front - (ntx-1));
+		const int tymax = rcMin(nty-1, front);
+		return tymax - tymin + 1;
+	}
+	
+	virtual void run(const int index)
+	{
+		int ty = tymin + index;
+		int tx = front - ty;
+		if (!forward)
+		{
+			tx = ntx-1 - tx;
+			ty = nty-1 - ty;
+		}
+		const int u0 = tx*ncols/ntx;
+		const int u1 = (tx+1)*ncols/ntx;
+		const int y0 = ty*chf.height/nty;
+		const int y1 = (ty+1)*chf.height/nty;
+		if (forward)
+			distanceForward(chf, src, u0, y0, u1, y1);
+		else
+			tileMaxDist[tx+ty*ntx] = distanceBackward(chf, src, u0, y0, u1, y1);
+	}
+	
+	const rcCompactHeightfield& chf;
+	unsigned short* src;
+	int ncols, ntx, nty;
+	bool forward;
+	int front;
+	int tymin;
+	unsigned short tileMaxDist[RC_MAX_DIST_TILES*RC_MAX_DIST_TILES];
+};
 
-static unsigned short* boxBlur(rcCompactHeightfield& chf, int thr,
-							   unsigned short* src, unsigned short* dst)
+static void calculateDistanceField(rcContext* ctx, const rcCompactHeightfield& chf,
+								   unsigned short* src, unsigned short& maxDist)
 {
-	const int w = chf.width;
-	const int h = chf.height;
+	rcDistanceFieldJob job(chf, src);
+	const int nfronts = job.getFrontCount();
+	for (int f = 0; f < nfronts; ++f)
+		ctx->runJobs(&job, job.setFront(f, true));
+	for (int f = 0; f < nfronts; ++f)
+		ctx->runJobs(&job, job.setFront(f, false));
 	
-	thr *= 2;
+	maxDist = 0;
+	for (int i = 0; i < job.ntx*job.nty; ++i)
+		maxDist = rcMax(job.tileMaxDist[i], maxDist);
+}
+
+// Blurs the rows of a band. The job only reads src and writes dst.
+struct rcBoxBlurJob : public rcJob
+{
+	inline rcBoxBlurJob(const rcCompactHeightfield& c, const int t, const unsigned short* s,
+						unsigned short* d, const int nb) :
+		chf(c), thr(t*2), src(s), dst(d), nbands(nb) {}
 	
-	for (int y = 0; y < h; ++y)
+	virtual void run(const int index)
 	{
-		for (int x = 0; x < w; ++x)
+		const int w = chf.width;
+		const int y0 = index*chf.height/nbands;
+		const int y1 = (index+1)*chf.height/nbands;
+		
+		for (int y = y0; y < y1; ++y)
 		{
-			const rcCompactCell& c = chf.cells[x+y*w];
-			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+			for (int x = 0; x < w; ++x)
 			{
-				const rcCompactSpan& s = chf.spans[i];
-				const unsigned short cd = src[i];
-				if (cd <= thr)
+				const rcCompactCell& c = chf.cells[x+y*w];
+				for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 				{
-					dst[i] = cd;
-					continue;
-				}
+					const rcCompactSpan& s = chf.spans[i];
+					const unsigned short cd = src[i];
+					if (cd <= thr)
+					{
+						dst[i] = cd;
+						continue;
+					}
 
-				int d = (int)cd;
-				for (int dir = 0; dir < 4; ++dir)
-				{
-					if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+					// Cells with non-zero distance are connected in every direction.
+					int d = (int)cd;
+					for (int dir = 0; dir < 4; ++dir)
 					{
 						const int ax = x + rcGetDirOffsetX(dir);
 						const int ay = y + rcGetDirOffsetY(dir);
 						const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
 						d += (int)src[ai];
-						
+					
 						const rcCompactSpan& as = chf.spans[ai];
 						const int dir2 = (dir+1) & 0x3;
 						if (rcGetCon(as, dir2) != RC_NOT_CONNECTED)
@@ -228,23 +302,33 @@ static unsigned short* boxBlur(rcCompactHeightfield& chf, int thr,
 							d += cd;
 						}
 					}
-					else
-					{
-						d += cd*2;
-					}
+					dst[i] = (unsigned short)((d+5)/9);
 				}
-				dst[i] = (unsigned short)((d+5)/9);
 			}
 		}
 	}
+	
+	const rcCompactHeightfield& chf;
+	const int thr;
+	const unsigned short* src;
+	unsigned short* dst;
+	const int nbands;
+};
+
+static unsigned short* boxBlur(rcContext* ctx, const rcCompactHeightfield& chf, int thr,
+							   unsigned short* src, unsigned short* dst)
+{
+	const int nbands = rcMax(1, rcMin(chf.height, RC_MAX_BLUR_BANDS));
+	rcBoxBlurJob job(chf, thr, src, dst, nbands);
+	ctx->runJobs(&job, nbands);
 	return dst;
 }
 
 
 static bool floodRegion(int x, int y, int i,
-						unsigned short level, unsigned short r,
+						unsigned short level, rcRegionId r,
 						rcCompactHeightfield& chf,
-						unsigned short* srcReg, unsigned short* srcDist,
+						rcRegionId* srcReg, unsigned short* srcDist,
 						rcIntArray& stack)
 {
 	const int w = chf.width;
@@ -271,7 +355,7 @@ static bool floodRegion(int x, int y, int i,
 		const rcCompactSpan& cs = chf.spans[ci];
 		
 		// Check if any of the neighbours already have a valid region set.
-		unsigned short ar = 0;
+		rcRegionId ar = 0;
 		for (int dir = 0; dir < 4; ++dir)
 		{
 			// 8 connected
@@ -282,7 +366,7 @@ static bool floodRegion(int x, int y, int i,
 				const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(cs, dir);
 				if (chf.areas[ai] != area)
 					continue;
-				unsigned short nr = srcReg[ai];
+				rcRegionId nr = srcReg[ai];
 				if (nr & RC_BORDER_REG) // Do not take borders into account.
 					continue;
 				if (nr != 0 && nr != r)
@@ -298,7 +382,7 @@ static bool floodRegion(int x, int y, int i,
 					const int ai2 = (int)chf.cells[ax2+ay2*w].index + rcGetCon(as, dir2);
 					if (chf.areas[ai2] != area)
 						continue;
-					unsigned short nr2 = srcReg[ai2];
+					rcRegionId nr2 = srcReg[ai2];
 					if (nr2 != 0 && nr2 != r)
 						ar = nr2;
 				}				
@@ -336,41 +420,22 @@ static bool floodRegion(int x, int y, int i,
 	return count > 0;
 }
 
-static unsigned short* expandRegions(int maxIter, unsigned short level,
-									 rcCompactHeightfield& chf,
-									 unsigned short* srcReg, unsigned short* srcDist,
-									 unsigned short* dstReg, unsigned short* dstDist, 
-									 rcIntArray& stack)
+// Expands the regions into the unassigned spans in stack, which holds (x, y, span index)
+// triples of the spans whose distance is at least level. Assigned spans are marked with
+// -1 in the stack. The spans are updated after each iteration, so the result does not
+// depend on the order of the stack.
+static void expandRegions(int maxIter, unsigned short level,
+						  rcCompactHeightfield& chf,
+						  rcRegionId* srcReg, unsigned short* srcDist,
+						  rcIntArray& stack, rcIntArray& dirtyEntries)
 {
 	const int w = chf.width;
-	const int h = chf.height;
 
-	// Find cells revealed by the raised level.
-	stack.resize(0);
-	for (int y = 0; y < h; ++y)
-	{
-		for (int x = 0; x < w; ++x)
-		{
-			const rcCompactCell& c = chf.cells[x+y*w];
-			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
-			{
-				if (chf.dist[i] >= level && srcReg[i] == 0 && chf.areas[i] != RC_NULL_AREA)
-				{
-					stack.push(x);
-					stack.push(y);
-					stack.push(i);
-				}
-			}
-		}
-	}
-	
 	int iter = 0;
 	while (stack.size() > 0)
 	{
 		int failed = 0;
-		
-		memcpy(dstReg, srcReg, sizeof(unsigned short)*chf.spanCount);
-		memcpy(dstDist, srcDist, sizeof(unsigned short)*chf.spanCount);
+		dirtyEntries.resize(0);
 		
 		for (int j = 0; j < stack.size(); j += 3)
 		{
@@ -383,7 +448,7 @@ static unsigned short* expandRegions(int maxIter, unsigned short level,
 				continue;
 			}
 			
-			unsigned short r = srcReg[i];
+			rcRegionId r = srcReg[i];
 			unsigned short d2 = 0xffff;
 			const unsigned char area = chf.areas[i];
 			const rcCompactSpan& s = chf.spans[i];
@@ -406,8 +471,9 @@ static unsigned short* expandRegions(int maxIter, unsigned short level,
 			if (r)
 			{
 				stack[j+2] = -1; // mark as used
-				dstReg[i] = r;
-				dstDist[i] = d2;
+				dirtyEntries.push(i);
+				dirtyEntries.push(r);
+				dirtyEntries.push(d2);
 			}
 			else
 			{
@@ -415,9 +481,13 @@ static unsigned short* expandRegions(int maxIter, unsigned short level,
 			}
 		}
 		
-		// rcSwap source and dest.
-		rcSwap(srcReg, dstReg);
-		rcSwap(srcDist, dstDist);
+		// Apply the changes of this iteration.
+		for (int j = 0; j < dirtyEntries.size(); j += 3)
+		{
+			const int i = dirtyEntries[j];
+			srcReg[i] = (rcRegionId)dirtyEntries[j+1];
+			srcDist[i] = (unsigned short)dirtyEntries[j+2];
+		}
 		
 		if (failed*3 == stack.size())
 			break;
@@ -429,14 +499,108 @@ static unsigned short* expandRegions(int maxIter, unsigned short level,
 				break;
 		}
 	}
+}
+
+// Sorts the walkable spans by distance into buckets of two levels. Each bucket holds
+// (cell index, span index) pairs in the order of the spans.
+static void sortSpansByLevel(rcCompactHeightfield& chf, const rcRegionId* srcReg,
+							 rcIntArray& levelSpans, rcIntArray& levelStart)
+{
+	const int w = chf.width;
+	const int h = chf.height;
+	const int nbuckets = (chf.maxDistance >> 1) + 1;
+	
+	levelStart.resize(nbuckets+1);
+	for (int i = 0; i <= nbuckets; ++i)
+		levelStart[i] = 0;
 	
-	return srcReg;
+	int n = 0;
+	for (int i = 0; i < chf.spanCount; ++i)
+	{
+		if (chf.areas[i] == RC_NULL_AREA || srcReg[i] != 0)
+			continue;
+		levelStart[(chf.dist[i] >> 1) + 1]++;
+		n++;
+	}
+	for (int i = 0; i < nbuckets; ++i)
+		levelStart[i+1] += levelStart[i];
+	
+	levelSpans.resize(n*2);
+	
+	rcIntArray next(nbuckets);
+	for (int i = 0; i < nbuckets; ++i)
+		next[i] = levelStart[i]*2;
+	
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			const rcCompactCell& c = chf.cells[x+y*w];
+			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+			{
+				if (chf.areas[i] == RC_NULL_AREA || srcReg[i] != 0)
+					continue;
+				int& k = next[chf.dist[i] >> 1];
+				levelSpans[k++] = x+y*w;
+				levelSpans[k++] = i;
+			}
+		}
+	}
+}
+
+// Merges the spans of a level bucket, which are still unassigned, into the
+// (x, y, span index) triples of stack. Both are ordered by span index.
+static void mergeLevelSpans(const int w, const rcRegionId* srcReg,
+							const int* spans, const int nspans,
+							rcIntArray& stack, rcIntArray& merged)
+{
+	merged.resize(0);
+	int j = 0;
+	for (int k = 0; k < nspans; k += 2)
+	{
+		const int i = spans[k+1];
+		if (srcReg[i] != 0)
+			continue;
+		while (j < stack.size() && stack[j+2] < i)
+		{
+			merged.push(stack[j+0]);
+			merged.push(stack[j+1]);
+			merged.push(stack[j+2]);
+			j += 3;
+		}
+		merged.push(spans[k] % w);
+		merged.push(spans[k] / w);
+		merged.push(i);
+	}
+	for (; j < stack.size(); j += 3)
+	{
+		merged.push(stack[j+0]);
+		merged.push(stack[j+1]);
+		merged.push(stack[j+2]);
+	}
+}
+
+// Removes the assigned spans from the stack.
+static void compactLevelStack(const rcRegionId* srcReg, rcIntArray& stack)
+{
+	int n = 0;
+	for (int j = 0; j < stack.size(); j += 3)
+	{
+		const int i = stack[j+2];
+		if (i < 0 || srcReg[i] != 0)
+			continue;
+		stack[n+0] = stack[j+0];
+		stack[n+1] = stack[j+1];
+		stack[n+2] = i;
+		n += 3;
+	}
+	stack.resize(n);
 }
 
 
 struct rcRegion
 {
-	inline rcRegion(unsigned short i) :
+	inline rcRegion(rcRegionId i) :
 		spanCount(0),
 		id(i),
 		areaType(0),
@@ -445,7 +609,7 @@ struct rcRegion
 	{}
 	
 	int spanCount;					// Number of spans belonging to this region
-	unsigned short id;				// ID of the region
+	rcRegionId id;					// ID of the region
 	unsigned char areaType;			// Are type.
 	bool remap;
 	bool visited;
@@ -471,12 +635,12 @@ static void removeAdjacentNeighbours(rcRegion& reg)
 	}
 }
 
-static void replaceNeighbour(rcRegion& reg, unsigned short oldId, unsigned short newId)
+static void replaceNeighbour(rcRegion& reg, rcRegionId oldId, rcRegionId newId)
 {
 	bool neiChanged = false;
 	for (int i = 0; i < reg.connections.size(); ++i)
 	{
-		if (reg.connections[i] == oldId)
+		if (reg.connections[i] == (int)oldId)
 		{
 			reg.connections[i] = newId;
 			neiChanged = true;
@@ -484,7 +648,7 @@ static void replaceNeighbour(rcRegion& reg, unsigned short oldId, unsigned short
 	}
 	for (int i = 0; i < reg.floors.size(); ++i)
 	{
-		if (reg.floors[i] == oldId)
+		if (reg.floors[i] == (int)oldId)
 			reg.floors[i] = newId;
 	}
 	if (neiChanged)
@@ -498,14 +662,14 @@ static bool canMergeWithRegion(const rcRegion& rega, const rcRegion& regb)
 	int n = 0;
 	for (int i = 0; i < rega.connections.size(); ++i)
 	{
-		if (rega.connections[i] == regb.id)
+		if (rega.connections[i] == (int)regb.id)
 			n++;
 	}
 	if (n > 1)
 		return false;
 	for (int i = 0; i < rega.floors.size(); ++i)
 	{
-		if (rega.floors[i] == regb.id)
+		if (rega.floors[i] == (int)regb.id)
 			return false;
 	}
 	return true;
@@ -521,8 +685,8 @@ static void addUniqueFloorRegion(rcRegion& reg, int n)
 
 static bool mergeRegions(rcRegion& rega, rcRegion& regb)
 {
-	unsigned short aid = rega.id;
-	unsigned short bid = regb.id;
+	rcRegionId aid = rega.id;
+	rcRegionId bid = regb.id;
 	
 	// Duplicate current neighbourhood.
 	rcIntArray acon;
@@ -535,7 +699,7 @@ static bool mergeRegions(rcRegion& rega, rcRegion& regb)
 	int insa = -1;
 	for (int i = 0; i < acon.size(); ++i)
 	{
-		if (acon[i] == bid)
+		if (acon[i] == (int)bid)
 		{
 			insa = i;
 			break;
@@ -548,7 +712,7 @@ static bool mergeRegions(rcRegion& rega, rcRegion& regb)
 	int insb = -1;
 	for (int i = 0; i < bcon.size(); ++i)
 	{
-		if (bcon[i] == aid)
+		if (bcon[i] == (int)aid)
 		{
 			insb = i;
 			break;
@@ -588,11 +752,11 @@ static bool isRegionConnectedToBorder(const rcRegion& reg)
 	return false;
 }
 
-static bool isSolidEdge(rcCompactHeightfield& chf, unsigned short* srcReg,
+static bool isSolidEdge(rcCompactHeightfield& chf, rcRegionId* srcReg,
 						int x, int y, int i, int dir)
 {
 	const rcCompactSpan& s = chf.spans[i];
-	unsigned short r = 0;
+	rcRegionId r = 0;
 	if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
 	{
 		const int ax = x + rcGetDirOffsetX(dir);
@@ -607,14 +771,14 @@ static bool isSolidEdge(rcCompactHeightfield& chf, unsigned short* srcReg,
 
 static void walkContour(int x, int y, int i, int dir,
 						rcCompactHeightfield& chf,
-						unsigned short* srcReg,
+						rcRegionId* srcReg,
 						rcIntArray& cont)
 {
 	int startDir = dir;
 	int starti = i;
 
 	const rcCompactSpan& ss = chf.spans[i];
-	unsigned short curReg = 0;
+	rcRegionId curReg = 0;
 	if (rcGetCon(ss, dir) != RC_NOT_CONNECTED)
 	{
 		const int ax = x + rcGetDirOffsetX(dir);
@@ -632,7 +796,7 @@ static void walkContour(int x, int y, int i, int dir,
 		if (isSolidEdge(chf, srcReg, x, y, i, dir))
 		{
 			// Choose the edge corner
-			unsigned short r = 0;
+			rcRegionId r = 0;
 			if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
 			{
 				const int ax = x + rcGetDirOffsetX(dir);
@@ -694,9 +858,9 @@ static void walkContour(int x, int y, int i, int dir,
 }
 
 static bool filterSmallRegions(rcContext* ctx, int minRegionArea, int mergeRegionSize,
-							   unsigned short& maxRegionId,
+							   rcRegionId& maxRegionId,
 							   rcCompactHeightfield& chf,
-							   unsigned short* srcReg)
+							   rcRegionId* srcReg)
 {
 	const int w = chf.width;
 	const int h = chf.height;
@@ -711,7 +875,7 @@ static bool filterSmallRegions(rcContext* ctx, int minRegionArea, int mergeRegio
 
 	// Construct regions
 	for (int i = 0; i < nreg; ++i)
-		new(&regions[i]) rcRegion((unsigned short)i);
+		new(&regions[i]) rcRegion((rcRegionId)i);
 	
 	// Find edge of a region and find connections around the contour.
 	for (int y = 0; y < h; ++y)
@@ -721,8 +885,8 @@ static bool filterSmallRegions(rcContext* ctx, int minRegionArea, int mergeRegio
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				unsigned short r = srcReg[i];
-				if (r == 0 || r >= nreg)
+				rcRegionId r = srcReg[i];
+				if (r == 0 || (int)r >= nreg)
 					continue;
 				
 				rcRegion& reg = regions[r];
@@ -733,8 +897,8 @@ static bool filterSmallRegions(rcContext* ctx, int minRegionArea, int mergeRegio
 				for (int j = (int)c.index; j < ni; ++j)
 				{
 					if (i == j) continue;
-					unsigned short floorId = srcReg[j];
-					if (floorId == 0 || floorId >= nreg)
+					rcRegionId floorId = srcReg[j];
+					if (floorId == 0 || (int)floorId >= nreg)
 						continue;
 					addUniqueFloorRegion(reg, floorId);
 				}
@@ -853,7 +1017,7 @@ static bool filterSmallRegions(rcContext* ctx, int minRegionArea, int mergeRegio
 			// Or region which is not connected to a border at all.
 			// Find smallest neighbour region that connects to this one.
 			int smallest = 0xfffffff;
-			unsigned short mergeId = reg.id;
+			rcRegionId mergeId = reg.id;
 			for (int j = 0; j < reg.connections.size(); ++j)
 			{
 				if (reg.connections[j] & RC_BORDER_REG) continue;
@@ -870,7 +1034,7 @@ static bool filterSmallRegions(rcContext* ctx, int minRegionArea, int mergeRegio
 			// Found new id.
 			if (mergeId != reg.id)
 			{
-				unsigned short oldId = reg.id;
+				rcRegionId oldId = reg.id;
 				rcRegion& target = regions[mergeId];
 				
 				// Merge neighbours.
@@ -904,13 +1068,13 @@ static bool filterSmallRegions(rcContext* ctx, int minRegionArea, int mergeRegio
 		regions[i].remap = true;
 	}
 	
-	unsigned short regIdGen = 0;
+	rcRegionId regIdGen = 0;
 	for (int i = 0; i < nreg; ++i)
 	{
 		if (!regions[i].remap)
 			continue;
-		unsigned short oldId = regions[i].id;
-		unsigned short newId = ++regIdGen;
+		rcRegionId oldId = regions[i].id;
+		rcRegionId newId = ++regIdGen;
 		for (int j = i; j < nreg; ++j)
 		{
 			if (regions[j].id == oldId)
@@ -945,6 +1109,11 @@ static bool filterSmallRegions(rcContext* ctx, int minRegionArea, int mergeRegio
 /// After this step, the distance data is available via the rcCompactHeightfield::maxDistance
 /// and rcCompactHeightfield::dist fields.
 ///
+/// Both passes of the distance transform run in tiles, one wavefront of independent tiles
+/// at a time, and the blur runs in bands of rows. The work is run as jobs through
+/// rcContext::runJobs, which is called once per wavefront. The result does not depend
+/// on how the jobs are run.
+///
 /// @see rcCompactHeightfield, rcBuildRegions, rcBuildRegionsMonotone
 bool rcBuildDistanceField(rcContext* ctx, rcCompactHeightfield& chf)
 {
@@ -976,7 +1145,7 @@ bool rcBuildDistanceField(rcContext* ctx, rcCompactHeightfield& chf)
 
 	ctx->startTimer(RC_TIMER_BUILD_DISTANCEFIELD_DIST);
 	
-	calculateDistanceField(chf, src, maxDist);
+	calculateDistanceField(ctx, chf, src, maxDist);
 	chf.maxDistance = maxDist;
 	
 	ctx->stopTimer(RC_TIMER_BUILD_DISTANCEFIELD_DIST);
@@ -984,7 +1153,7 @@ bool rcBuildDistanceField(rcContext* ctx, rcCompactHeightfield& chf)
 	ctx->startTimer(RC_TIMER_BUILD_DISTANCEFIELD_BLUR);
 	
 	// Blur
-	if (boxBlur(chf, 1, src, dst) != src)
+	if (boxBlur(ctx, chf, 1, src, dst) != src)
 		rcSwap(src, dst);
 	
 	// Store distance.
@@ -999,8 +1168,8 @@ bool rcBuildDistanceField(rcContext* ctx, rcCompactHeightfield& chf)
 	return true;
 }
 
-static void paintRectRegion(int minx, int maxx, int miny, int maxy, unsigned short regId,
-							rcCompactHeightfield& chf, unsigned short* srcReg)
+static void paintRectRegion(int minx, int maxx, int miny, int maxy, rcRegionId regId,
+							rcCompactHeightfield& chf, rcRegionId* srcReg)
 {
 	const int w = chf.width;	
 	for (int y = miny; y < maxy; ++y)
@@ -1018,14 +1187,14 @@ static void paintRectRegion(int minx, int maxx, int miny, int maxy, unsigned sho
 }
 
 
-static const unsigned short RC_NULL_NEI = 0xffff;
+static const rcRegionId RC_NULL_NEI = (rcRegionId)~0;
 
 struct rcSweepSpan
 {
-	unsigned short rid;	// row id
-	unsigned short id;	// region id
+	rcRegionId rid;		// row id
+	rcRegionId id;		// region id
 	unsigned short ns;	// number samples
-	unsigned short nei;	// neighbour id
+	rcRegionId nei;		// neighbour id
 };
 
 /// @par
@@ -1056,15 +1225,15 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 	
 	const int w = chf.width;
 	const int h = chf.height;
-	unsigned short id = 1;
+	rcRegionId id = 1;
 	
-	rcScopedDelete<unsigned short> srcReg = (unsigned short*)rcAlloc(sizeof(unsigned short)*chf.spanCount, RC_ALLOC_TEMP);
+	rcScopedDelete<rcRegionId> srcReg = (rcRegionId*)rcAlloc(sizeof(rcRegionId)*chf.spanCount, RC_ALLOC_TEMP);
 	if (!srcReg)
 	{
 		ctx->log(RC_LOG_ERROR, "rcBuildRegionsMonotone: Out of memory 'src' (%d).", chf.spanCount);
 		return false;
 	}
-	memset(srcReg,0,sizeof(unsigned short)*chf.spanCount);
+	memset(srcReg,0,sizeof(rcRegionId)*chf.spanCount);
 
 	const int nsweeps = rcMax(chf.width,chf.height);
 	rcScopedDelete<rcSweepSpan> sweeps = (rcSweepSpan*)rcAlloc(sizeof(rcSweepSpan)*nsweeps, RC_ALLOC_TEMP);
@@ -1098,7 +1267,7 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 		// Collect spans from this row.
 		prev.resize(id+1);
 		memset(&prev[0],0,sizeof(int)*id);
-		unsigned short rid = 1;
+		rcRegionId rid = 1;
 		
 		for (int x = borderSize; x < w-borderSize; ++x)
 		{
@@ -1110,7 +1279,7 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 				if (chf.areas[i] == RC_NULL_AREA) continue;
 				
 				// -x
-				unsigned short previd = 0;
+				rcRegionId previd = 0;
 				if (rcGetCon(s, 0) != RC_NOT_CONNECTED)
 				{
 					const int ax = x + rcGetDirOffsetX(0);
@@ -1136,7 +1305,7 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 3);
 					if (srcReg[ai] && (srcReg[ai] & RC_BORDER_REG) == 0 && chf.areas[i] == chf.areas[ai])
 					{
-						unsigned short nr = srcReg[ai];
+						rcRegionId nr = srcReg[ai];
 						if (!sweeps[previd].nei || sweeps[previd].nei == nr)
 						{
 							sweeps[previd].nei = nr;
@@ -1155,7 +1324,7 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 		}
 		
 		// Create unique ID.
-		for (int i = 1; i < rid; ++i)
+		for (int i = 1; i < (int)rid; ++i)
 		{
 			if (sweeps[i].nei != RC_NULL_NEI && sweeps[i].nei != 0 &&
 				prev[sweeps[i].nei] == (int)sweeps[i].ns)
@@ -1164,6 +1333,11 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 			}
 			else
 			{
+				if (id == RC_BORDER_REG-1)
+				{
+					ctx->log(RC_LOG_ERROR, "rcBuildRegionsMonotone: Region ID overflow (%d).", (int)id);
+					return false;
+				}
 				sweeps[i].id = id++;
 			}
 		}
@@ -1228,10 +1402,16 @@ bool rcBuildRegions(rcContext* ctx, rcCompactHeightfield& chf,
 	const int w = chf.width;
 	const int h = chf.height;
 	
-	rcScopedDelete<unsigned short> buf = (unsigned short*)rcAlloc(sizeof(unsigned short)*chf.spanCount*4, RC_ALLOC_TEMP);
-	if (!buf)
+	rcScopedDelete<rcRegionId> srcReg = (rcRegionId*)rcAlloc(sizeof(rcRegionId)*chf.spanCount, RC_ALLOC_TEMP);
+	if (!srcReg)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildRegions: Out of memory 'srcReg' (%d).", chf.spanCount);
+		return false;
+	}
+	rcScopedDelete<unsigned short> srcDist = (unsigned short*)rcAlloc(sizeof(unsigned short)*chf.spanCount, RC_ALLOC_TEMP);
+	if (!srcDist)
 	{
-		ctx->log(RC_LOG_ERROR, "rcBuildRegions: Out of memory 'tmp' (%d).", chf.spanCount*4);
+		ctx->log(RC_LOG_ERROR, "rcBuildRegions: Out of memory 'srcDist' (%d).", chf.spanCount);
 		return false;
 	}
 	
@@ -1239,16 +1419,16 @@ bool rcBuildRegions(rcContext* ctx, rcCompactHeightfield& chf,
 	
 	rcIntArray stack(1024);
 	rcIntArray visited(1024);
+	rcIntArray levelStackA(1024);
+	rcIntArray levelStackB(1024);
+	rcIntArray dirtyEntries(1024);
+	rcIntArray levelSpans;
+	rcIntArray levelStart;
 	
-	unsigned short* srcReg = buf;
-	unsigned short* srcDist = buf+chf.spanCount;
-	unsigned short* dstReg = buf+chf.spanCount*2;
-	unsigned short* dstDist = buf+chf.spanCount*3;
-	
-	memset(srcReg, 0, sizeof(unsigned short)*chf.spanCount);
+	memset(srcReg, 0, sizeof(rcRegionId)*chf.spanCount);
 	memset(srcDist, 0, sizeof(unsigned short)*chf.spanCount);
 	
-	unsigned short regionId = 1;
+	rcRegionId regionId = 1;
 	unsigned short level = (chf.maxDistance+1) & ~1;
 
 	// TODO: Figure better formula, expandIters defines how much the 
@@ -1271,49 +1451,68 @@ bool rcBuildRegions(rcContext* ctx, rcCompactHeightfield& chf,
 		chf.borderSize = borderSize;
 	}
 	
+	// Bucket the spans by level once, so that each level only visits the
+	// spans it reveals and the spans which are still unassigned.
+	sortSpansByLevel(chf, srcReg, levelSpans, levelStart);
+	int nextBucket = (int)(chf.maxDistance >> 1);
+	rcIntArray* levelStack = &levelStackA;
+	rcIntArray* mergedStack = &levelStackB;
+	levelStack->resize(0);
+	
 	while (level > 0)
 	{
 		level = level >= 2 ? level-2 : 0;
 		
+		// Add the spans revealed by the raised level, in span order.
+		for (; nextBucket >= (int)(level >> 1); --nextBucket)
+		{
+			const int start = levelStart[nextBucket];
+			mergeLevelSpans(w, srcReg, &levelSpans[start*2], (levelStart[nextBucket+1]-start)*2,
+							*levelStack, *mergedStack);
+			rcSwap(levelStack, mergedStack);
+		}
+		
 		ctx->startTimer(RC_TIMER_BUILD_REGIONS_EXPAND);
 		
 		// Expand current regions until no empty connected cells found.
-		if (expandRegions(expandIters, level, chf, srcReg, srcDist, dstReg, dstDist, stack) != srcReg)
-		{
-			rcSwap(srcReg, dstReg);
-			rcSwap(srcDist, dstDist);
-		}
+		expandRegions(expandIters, level, chf, srcReg, srcDist, *levelStack, dirtyEntries);
 		
 		ctx->stopTimer(RC_TIMER_BUILD_REGIONS_EXPAND);
 		
 		ctx->startTimer(RC_TIMER_BUILD_REGIONS_FLOOD);
 		
 		// Mark new regions with IDs.
-		for (int y = 0; y < h; ++y)
+		for (int j = 0; j < levelStack->size(); j += 3)
 		{
-			for (int x = 0; x < w; ++x)
+			const int i = (*levelStack)[j+2];
+			if (i < 0 || srcReg[i] != 0)
+				continue;
+			if (floodRegion((*levelStack)[j+0], (*levelStack)[j+1], i, level, regionId, chf, srcReg, srcDist, stack))
 			{
-				const rcCompactCell& c = chf.cells[x+y*w];
-				for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+				if (regionId == RC_BORDER_REG-1)
 				{
-					if (chf.dist[i] < level || srcReg[i] != 0 || chf.areas[i] == RC_NULL_AREA)
-						continue;
-					if (floodRegion(x, y, i, level, regionId, chf, srcReg, srcDist, stack))
-						regionId++;
+					ctx->log(RC_LOG_ERROR, "rcBuildRegions: Region ID overflow (%d).", (int)regionId);
+					return false;
 				}
+				regionId++;
 			}
 		}
+		compactLevelStack(srcReg, *levelStack);
 		
 		ctx->stopTimer(RC_TIMER_BUILD_REGIONS_FLOOD);
 	}
 	
-	// Expand current regions until no empty connected cells found.
-	if (expandRegions(expandIters*8, 0, chf, srcReg, srcDist, dstReg, dstDist, stack) != srcReg)
+	for (; nextBucket >= 0; --nextBucket)
 	{
-		rcSwap(srcReg, dstReg);
-		rcSwap(srcDist, dstDist);
+		const int start = levelStart[nextBucket];
+		mergeLevelSpans(w, srcReg, &levelSpans[start*2], (levelStart[nextBucket+1]-start)*2,
+						*levelStack, *mergedStack);
+		rcSwap(levelStack, mergedStack);
 	}
 	
+	// Expand current regions until no empty connected cells found.
+	expandRegions(expandIters*8, 0, chf, srcReg, srcDist, *levelStack, dirtyEntries);
+	
 	ctx->stopTimer(RC_TIMER_BUILD_REGIONS_WATERSHED);
 	
 	ctx->startTimer(RC_TIMER_BUILD_REGIONS_FILTER);
@@ -19,6 +19,8 @@
 #ifndef CHUNKYTRIMESH_H
 #define CHUNKYTRIMESH_H
 
+#include <stdio.h>
+
 struct rcChunkyTriMeshNode
 {
 	float bmin[2], bmax[2];
@@ -48,5 +50,42 @@ int rcGetChunksOverlappingRect(const rcChunkyTriMesh* cm, float bmin[2], float b
 /// Returns the chunk indices which overlap the input segment.
 int rcGetChunksOverlappingSegment(const rcChunkyTriMesh* cm, float p[2], float q[2], int* ids, const int maxIds);
 
+/// Writes the chunky mesh into a file as a triangle soup, ordered by chunk and
+/// preceded by the nodes of the tree, so that the triangles of a chunk can be read
+/// without reading the rest of the mesh. See rcChunkyTriMeshFile.
+bool rcSaveChunkyTriMesh(const char* path, const float* verts, const rcChunkyTriMesh* cm);
+
+/// Streams the triangles of a chunky mesh file. Only the tree is kept in memory,
+/// the triangles of a chunk are read from the file when they are requested.
+class rcChunkyTriMeshFile
+{
+public:
+	rcChunkyTriMeshFile();
+	~rcChunkyTriMeshFile();
+	
+	bool open(const char* path);
+	void close();
+	
+	/// Returns the tree of the mesh, the triangle indices are not loaded.
+	inline const rcChunkyTriMesh* getChunkyMesh() const { return &m_mesh; }
+	inline const float* getBoundsMin() const { return m_bmin; }
+	inline const float* getBoundsMax() const { return m_bmax; }
+	
+	/// Reads the triangles of a leaf node.
+	///  @param[in]		node	The index of the leaf node.
+	///  @param[out]	verts	The triangle vertices. [(ax, ay, az, bx, by, bz, cx, cy, cz) * node.n]
+	bool readChunk(const int node, float* verts);
+	
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	rcChunkyTriMeshFile(const rcChunkyTriMeshFile&);
+	rcChunkyTriMeshFile& operator=(const rcChunkyTriMeshFile&);
+	
+	FILE* m_fp;
+	long long m_dataOffset;
+	rcChunkyTriMesh m_mesh;
+	float m_bmin[3], m_bmax[3];
+};
+
 
 #endif // CHUNKYTRIMESH_H
@@ -30,6 +30,7 @@ struct FileList
 	int size;
 };
 
+void scanDirectoryAppend(const char* path, const char* ext, FileList& list);
 void scanDirectory(const char* path, const char* ext, FileList& list);
 
 #endif // FILELIST_H
@@ -37,6 +37,13 @@ class InputGeom
 	rcMeshLoaderObj* m_mesh;
 	float m_meshBMin[3], m_meshBMax[3];
 	
+	/// @name Streamed mesh, used instead of the mesh when a chunky mesh file is loaded.
+	///@{
+	rcChunkyTriMeshFile* m_chunkyFile;
+	float* m_chunkVerts;
+	int* m_chunkTris;
+	///@}
+	
 	/// @name Off-Mesh connections.
 	///@{
 	static const int MAX_OFFMESH_CONNECTIONS = 256;
@@ -56,6 +63,8 @@ class InputGeom
 	int m_volumeCount;
 	///@}
 	
+	bool loadChunkyFile(class rcContext* ctx, const char* filepath);
+	
 public:
 	InputGeom();
 	~InputGeom();
@@ -64,12 +73,17 @@ public:
 	
 	bool load(class rcContext* ctx, const char* filepath);
 	bool save(const char* filepath);
+	/// Writes the loaded mesh as a chunky mesh file, which can later be streamed.
+	bool saveChunkyMesh(class rcContext* ctx, const char* filepath);
 	
 	/// Method to return static mesh data.
 	inline const rcMeshLoaderObj* getMesh() const { return m_mesh; }
 	inline const float* getMeshBoundsMin() const { return m_meshBMin; }
 	inline const float* getMeshBoundsMax() const { return m_meshBMax; }
-	inline const rcChunkyTriMesh* getChunkyMesh() const { return m_chunkyMesh; }
+	inline const rcChunkyTriMesh* getChunkyMesh() const { return m_chunkyFile ? m_chunkyFile->getChunkyMesh() : m_chunkyMesh; }
+	/// Returns the triangles of a leaf node of the chunky mesh. When the mesh is streamed,
+	/// the triangles are read from the file and are valid until the next call.
+	bool getChunkTris(const int node, const float*& verts, int& nverts, const int*& tris, int& ntris);
 	bool raycastMesh(float* src, float* dst, float& tmin);
 
 	/// @name Off-Mesh connections.
@@ -39,7 +39,11 @@ class BuildContext : public rcContext
 	char m_textPool[TEXT_POOL_SIZE];
 	int m_textPoolSize;
 	
+	int m_jobThreads;
+	
 public:
+	static const int MAX_JOB_THREADS = 8;
+	
 	BuildContext();
 	virtual ~BuildContext();
 	
@@ -49,6 +53,8 @@ public:
 	int getLogCount() const;
 	/// Returns log message text.
 	const char* getLogText(const int i) const;
+	/// Sets the number of threads used to run the build jobs.
+	void setJobThreads(const int n);
 	
 protected:	
 	/// Virtual functions for custom implementations.
@@ -59,9 +65,21 @@ protected:
 	virtual void doStartTimer(const rcTimerLabel /*label*/);
 	virtual void doStopTimer(const rcTimerLabel /*label*/);
 	virtual int doGetAccumulatedTime(const rcTimerLabel /*label*/) const;
+	virtual void doRunJobs(rcJob* job, const int count);
 	///@}
 };
 
+/// Runs a job of a batch, see runJobThreads.
+///  @param[in]		data	The user data passed to runJobThreads.
+///  @param[in]		index	The index of the job. [Limit: 0 <= value < count]
+///  @param[in]		thread	The index of the thread running the job. [Limit: 0 <= value < nthreads]
+typedef void (*JobThreadFunc)(void* data, const int index, const int thread);
+
+/// Runs a batch of independent jobs on SDL threads, the calling thread acts as the first thread.
+/// Thread t runs the jobs t, t+nthreads, t+2*nthreads... and the function returns when all jobs are done.
+///  @param[in]		nthreads	The number of threads to use. [Limit: 1 <= value <= BuildContext::MAX_JOB_THREADS]
+void runJobThreads(JobThreadFunc func, void* data, const int count, const int nthreads);
+
 /// OpenGL debug draw implementation.
 class DebugDrawGL : public duDebugDraw
 {
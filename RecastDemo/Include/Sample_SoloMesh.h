@@ -27,6 +27,7 @@ class Sample_SoloMesh : public Sample
 {
 protected:
 	bool m_keepInterResults;
+	float m_buildThreads;
 	float m_totalBuildTimeMs;
 
 	unsigned char* m_triareas;
@@ -32,7 +32,9 @@ protected:
 
 	struct LinearAllocator* m_talloc;
 	struct FastLZCompressor* m_tcomp;
+	struct dtTileCacheLayerCompressor* m_layerComp;
 	struct MeshProcess* m_tmproc;
+	struct ThreadedWorkers* m_tworkers;
 
 	class dtTileCache* m_tileCache;
 	
@@ -41,6 +43,8 @@ protected:
 	int m_cacheRawSize;
 	int m_cacheLayerCount;
 	int m_cacheBuildMemUsage;
+	int m_cacheBuildPolyCount;
+	float m_cacheDecompressTimeMs;
 	
 	enum DrawMode
 	{
@@ -60,6 +64,15 @@ protected:
 	int m_maxTiles;
 	int m_maxPolysPerTile;
 	float m_tileSize;
+	float m_updateThreads;
+	float m_maxTilesPerUpdate;
+	bool m_layerCodec;
+	float m_layerCacheSize;
+	
+	unsigned char* m_archive;			///< Loaded tile cache archive, the tiles point to it.
+	
+	void saveAll(const char* path);
+	void loadAll(const char* path);
 	
 public:
 	Sample_TempObstacles();
@@ -79,7 +92,7 @@ public:
 	void renderCachedTile(const int tx, const int ty, const int type);
 	void renderCachedTileOverlay(const int tx, const int ty, double* proj, double* model, int* view);
 
-	void addTempObstacle(const float* pos);
+	void addTempObstacle(const float* pos, const int type, const float yRadians);
 	void removeTempObstacle(const float* sp, const float* sq);
 	void clearAllTempObstacles();
 };
@@ -26,11 +26,30 @@ class TestCase
 	enum TestType
 	{
 		TEST_PATHFIND,
+		TEST_POLYS_AROUND_CIRCLE,
 	};
 	
 	struct Test
 	{
-		Test() : straight(0), nstraight(0), polys(0), npolys(0) {};
+		Test() :
+			type(TEST_PATHFIND),
+			radius(0),
+			includeFlags(0),
+			excludeFlags(0),
+			expand(false),
+			straight(0),
+			nstraight(0),
+			polys(0),
+			npolys(0),
+			findNearestPolyTime(0),
+			findPathTime(0),
+			findStraightPathTime(0),
+			findPolysAroundCircleTime(0),
+			next(0)
+		{
+			spos[0] = spos[1] = spos[2] = 0;
+			epos[0] = epos[1] = epos[2] = 0;
+		}
 		~Test()
 		{
 			delete [] straight;
@@ -51,6 +70,7 @@ class TestCase
 		int findNearestPolyTime;
 		int findPathTime;
 		int findStraightPathTime;
+		int findPolysAroundCircleTime;
 		
 		Test* next;
 	};
@@ -58,8 +78,10 @@ class TestCase
 	char m_sampleName[256];
 	char m_geomFileName[256];
 	Test* m_tests;
+	int m_tileChurn;
 	
 	void resetTimes();
+	void churnTiles(class dtNavMesh* navmesh);
 	
 public:
 	TestCase();
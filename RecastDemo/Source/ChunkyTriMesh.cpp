@@ -313,3 +313,218 @@ int rcGetChunksOverlappingSegment(const rcChunkyTriMesh* cm,
 	
 	return n;
 }
+
+
+static const int CHUNKYMESH_MAGIC = 'C'<<24 | 'T'<<16 | 'M'<<8 | 'F'; //'CTMF';
+static const int CHUNKYMESH_VERSION = 1;
+
+struct ChunkyTriMeshFileHeader
+{
+	int magic;
+	int version;
+	int nnodes;
+	int ntris;
+	int maxTrisPerChunk;
+	float bmin[3], bmax[3];
+};
+
+static bool seekFile(FILE* fp, const long long offset)
+{
+#ifdef WIN32
+	return _fseeki64(fp, offset, SEEK_SET) == 0;
+#else
+	return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static long long getFileSize(FILE* fp)
+{
+#ifdef WIN32
+	if (_fseeki64(fp, 0, SEEK_END) != 0)
+		return -1;
+	return _ftelli64(fp);
+#else
+	if (fseeko(fp, 0, SEEK_END) != 0)
+		return -1;
+	return (long long)ftello(fp);
+#endif
+}
+
+// Checks that the tree only references triangles stored in the file, and that
+// the escape indices of the tree stay inside the node array.
+static bool validateNodes(const rcChunkyTriMeshNode* nodes, const int nnodes,
+						  const int ntris, const int maxTrisPerChunk)
+{
+	for (int i = 0; i < nnodes; ++i)
+	{
+		const rcChunkyTriMeshNode& node = nodes[i];
+		if (node.i >= 0)
+		{
+			if (node.n < 0 || node.n > maxTrisPerChunk)
+				return false;
+			if (node.i > ntris - node.n)
+				return false;
+		}
+		else
+		{
+			if (node.i < -(nnodes - i))
+				return false;
+		}
+	}
+	return true;
+}
+
+bool rcSaveChunkyTriMesh(const char* path, const float* verts, const rcChunkyTriMesh* cm)
+{
+	if (!cm || !cm->nodes || !cm->tris || !cm->ntris)
+		return false;
+	
+	ChunkyTriMeshFileHeader header;
+	header.magic = CHUNKYMESH_MAGIC;
+	header.version = CHUNKYMESH_VERSION;
+	header.nnodes = cm->nnodes;
+	header.ntris = cm->ntris;
+	header.maxTrisPerChunk = cm->maxTrisPerChunk;
+	for (int i = 0; i < 3; ++i)
+	{
+		header.bmin[i] = verts[cm->tris[0]*3+i];
+		header.bmax[i] = verts[cm->tris[0]*3+i];
+	}
+	for (int i = 0; i < cm->ntris*3; ++i)
+	{
+		const float* v = &verts[cm->tris[i]*3];
+		for (int j = 0; j < 3; ++j)
+		{
+			if (v[j] < header.bmin[j]) header.bmin[j] = v[j];
+			if (v[j] > header.bmax[j]) header.bmax[j] = v[j];
+		}
+	}
+	
+	FILE* fp = fopen(path, "wb");
+	if (!fp)
+		return false;
+	
+	fwrite(&header, sizeof(ChunkyTriMeshFileHeader), 1, fp);
+	fwrite(cm->nodes, sizeof(rcChunkyTriMeshNode), cm->nnodes, fp);
+	
+	// The leaves store their triangles contiguously, write them in the same order.
+	bool res = true;
+	for (int i = 0; i < cm->ntris && res; ++i)
+	{
+		const int* t = &cm->tris[i*3];
+		float tv[9];
+		for (int j = 0; j < 3; ++j)
+		{
+			tv[j*3+0] = verts[t[j]*3+0];
+			tv[j*3+1] = verts[t[j]*3+1];
+			tv[j*3+2] = verts[t[j]*3+2];
+		}
+		res = fwrite(tv, sizeof(float), 9, fp) == 9;
+	}
+	
+	if (fclose(fp) != 0)
+		res = false;
+	
+	return res;
+}
+
+rcChunkyTriMeshFile::rcChunkyTriMeshFile() :
+	m_fp(0),
+	m_dataOffset(0)
+{
+	m_mesh.nnodes = 0;
+	m_mesh.ntris = 0;
+	m_mesh.maxTrisPerChunk = 0;
+	m_bmin[0] = m_bmin[1] = m_bmin[2] = 0;
+	m_bmax[0] = m_bmax[1] = m_bmax[2] = 0;
+}
+
+rcChunkyTriMeshFile::~rcChunkyTriMeshFile()
+{
+	close();
+}
+
+bool rcChunkyTriMeshFile::open(const char* path)
+{
+	close();
+	
+	m_fp = fopen(path, "rb");
+	if (!m_fp)
+		return false;
+	
+	const long long fileSize = getFileSize(m_fp);
+	if (fileSize < 0 || !seekFile(m_fp, 0))
+	{
+		close();
+		return false;
+	}
+	
+	ChunkyTriMeshFileHeader header;
+	if (fread(&header, sizeof(ChunkyTriMeshFileHeader), 1, m_fp) != 1 ||
+		header.magic != CHUNKYMESH_MAGIC || header.version != CHUNKYMESH_VERSION ||
+		header.nnodes <= 0 || header.ntris <= 0 ||
+		header.maxTrisPerChunk <= 0 || header.maxTrisPerChunk > header.ntris)
+	{
+		close();
+		return false;
+	}
+	
+	// The nodes and the triangles must fit in the file.
+	const long long dataOffset = (long long)sizeof(ChunkyTriMeshFileHeader) + (long long)sizeof(rcChunkyTriMeshNode)*header.nnodes;
+	const long long dataSize = (long long)header.ntris*9*(long long)sizeof(float);
+	if (dataOffset + dataSize > fileSize)
+	{
+		close();
+		return false;
+	}
+	
+	m_mesh.nodes = new rcChunkyTriMeshNode[header.nnodes];
+	if (!m_mesh.nodes)
+	{
+		close();
+		return false;
+	}
+	if (fread(m_mesh.nodes, sizeof(rcChunkyTriMeshNode), header.nnodes, m_fp) != (size_t)header.nnodes ||
+		!validateNodes(m_mesh.nodes, header.nnodes, header.ntris, header.maxTrisPerChunk))
+	{
+		close();
+		return false;
+	}
+	m_mesh.nnodes = header.nnodes;
+	m_mesh.ntris = header.ntris;
+	m_mesh.maxTrisPerChunk = header.maxTrisPerChunk;
+	for (int i = 0; i < 3; ++i)
+	{
+		m_bmin[i] = header.bmin[i];
+		m_bmax[i] = header.bmax[i];
+	}
+	m_dataOffset = dataOffset;
+	
+	return true;
+}
+
+void rcChunkyTriMeshFile::close()
+{
+	if (m_fp)
+	{
+		fclose(m_fp);
+		m_fp = 0;
+	}
+	delete [] m_mesh.nodes;
+	m_mesh.nodes = 0;
+	m_mesh.nnodes = 0;
+	m_mesh.ntris = 0;
+	m_mesh.maxTrisPerChunk = 0;
+}
+
+bool rcChunkyTriMeshFile::readChunk(const int node, float* verts)
+{
+	if (!m_fp || node < 0 || node >= m_mesh.nnodes)
+		return false;
+	const rcChunkyTriMeshNode& n = m_mesh.nodes[node];
+	if (n.i < 0 || n.n > m_mesh.maxTrisPerChunk)
+		return false;
+	if (!seekFile(m_fp, m_dataOffset + (long long)n.i*9*sizeof(float)))
+		return false;
+	return fread(verts, sizeof(float), n.n*9, m_fp) == (size_t)(n.n*9);
+}
@@ -58,10 +58,8 @@ static int cmp(const void* a, const void* b)
 	return strcmp(*(const char**)a, *(const char**)b);
 }
 	
-void scanDirectory(const char* path, const char* ext, FileList& list)
+void scanDirectoryAppend(const char* path, const char* ext, FileList& list)
 {
-	fileListClear(list);
-	
 #ifdef WIN32
 	_finddata_t dir;
 	char pathWithExt[260];
@@ -98,3 +96,9 @@ void scanDirectory(const char* path, const char* ext, FileList& list)
 	if (list.size > 1)
 		qsort(list.files, list.size, sizeof(char*), cmp);
 }
+
+void scanDirectory(const char* path, const char* ext, FileList& list)
+{
+	fileListClear(list);
+	scanDirectoryAppend(path, ext, list);
+}
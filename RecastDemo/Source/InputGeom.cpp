@@ -107,6 +107,9 @@ static char* parseRow(char* buf, char* bufEnd, char* row, int len)
 InputGeom::InputGeom() :
 	m_chunkyMesh(0),
 	m_mesh(0),
+	m_chunkyFile(0),
+	m_chunkVerts(0),
+	m_chunkTris(0),
 	m_offMeshConCount(0),
 	m_volumeCount(0)
 {
@@ -116,6 +119,9 @@ InputGeom::~InputGeom()
 {
 	delete m_chunkyMesh;
 	delete m_mesh;
+	delete m_chunkyFile;
+	delete [] m_chunkVerts;
+	delete [] m_chunkTris;
 }
 		
 bool InputGeom::loadMesh(rcContext* ctx, const char* filepath)
@@ -127,9 +133,23 @@ bool InputGeom::loadMesh(rcContext* ctx, const char* filepath)
 		delete m_mesh;
 		m_mesh = 0;
 	}
+	if (m_chunkyFile)
+	{
+		delete m_chunkyFile;
+		m_chunkyFile = 0;
+		delete [] m_chunkVerts;
+		m_chunkVerts = 0;
+		delete [] m_chunkTris;
+		m_chunkTris = 0;
+	}
 	m_offMeshConCount = 0;
 	m_volumeCount = 0;
 	
+	// Chunky mesh files are streamed, only the tree is loaded.
+	const int len = (int)strlen(filepath);
+	if (len > 4 && strcmp(filepath+len-4, ".ctm") == 0)
+		return loadChunkyFile(ctx, filepath);
+	
 	m_mesh = new rcMeshLoaderObj;
 	if (!m_mesh)
 	{
@@ -159,6 +179,62 @@ bool InputGeom::loadMesh(rcContext* ctx, const char* filepath)
 	return true;
 }
 
+bool InputGeom::loadChunkyFile(rcContext* ctx, const char* filepath)
+{
+	m_chunkyFile = new rcChunkyTriMeshFile;
+	if (!m_chunkyFile)
+	{
+		ctx->log(RC_LOG_ERROR, "loadMesh: Out of memory 'm_chunkyFile'.");
+		return false;
+	}
+	if (!m_chunkyFile->open(filepath))
+	{
+		ctx->log(RC_LOG_ERROR, "loadMesh: Could not load '%s'", filepath);
+		return false;
+	}
+	
+	rcVcopy(m_meshBMin, m_chunkyFile->getBoundsMin());
+	rcVcopy(m_meshBMax, m_chunkyFile->getBoundsMax());
+	
+	// The triangles of a chunk are read as a triangle soup.
+	const int maxTris = m_chunkyFile->getChunkyMesh()->maxTrisPerChunk;
+	m_chunkVerts = new float[maxTris*9];
+	m_chunkTris = new int[maxTris*3];
+	if (!m_chunkVerts || !m_chunkTris)
+	{
+		ctx->log(RC_LOG_ERROR, "loadMesh: Out of memory 'm_chunkVerts' (%d).", maxTris*9);
+		return false;
+	}
+	for (int i = 0; i < maxTris*3; ++i)
+		m_chunkTris[i] = i;
+	
+	return true;
+}
+
+bool InputGeom::getChunkTris(const int node, const float*& verts, int& nverts, const int*& tris, int& ntris)
+{
+	const rcChunkyTriMesh* cm = getChunkyMesh();
+	if (!cm || node < 0 || node >= cm->nnodes)
+		return false;
+	const rcChunkyTriMeshNode& n = cm->nodes[node];
+	if (m_chunkyFile)
+	{
+		if (!m_chunkyFile->readChunk(node, m_chunkVerts))
+			return false;
+		verts = m_chunkVerts;
+		nverts = n.n*3;
+		tris = m_chunkTris;
+	}
+	else
+	{
+		verts = m_mesh->getVerts();
+		nverts = m_mesh->getVertCount();
+		tris = &m_chunkyMesh->tris[n.i*3];
+	}
+	ntris = n.n;
+	return true;
+}
+
 bool InputGeom::load(rcContext* ctx, const char* filePath)
 {
 	char* buf = 0;
@@ -281,6 +357,22 @@ bool InputGeom::save(const char* filepath)
 	return true;
 }
 
+bool InputGeom::saveChunkyMesh(rcContext* ctx, const char* filepath)
+{
+	if (!m_mesh || !m_chunkyMesh)
+	{
+		ctx->log(RC_LOG_ERROR, "saveChunkyMesh: No mesh loaded.");
+		return false;
+	}
+	if (!rcSaveChunkyTriMesh(filepath, m_mesh->getVerts(), m_chunkyMesh))
+	{
+		ctx->log(RC_LOG_ERROR, "saveChunkyMesh: Could not write '%s'", filepath);
+		return false;
+	}
+	ctx->log(RC_LOG_PROGRESS, "saveChunkyMesh: Wrote '%s' (%d tris)", filepath, m_chunkyMesh->ntris);
+	return true;
+}
+
 static bool isectSegAABB(const float* sp, const float* sq,
 						 const float* amin, const float* amax,
 						 float& tmin, float& tmax)
@@ -333,19 +425,20 @@ bool InputGeom::raycastMesh(float* src, float* dst, float& tmin)
 	q[1] = src[2] + (dst[2]-src[2])*btmax;
 	
 	int cid[512];
-	const int ncid = rcGetChunksOverlappingSegment(m_chunkyMesh, p, q, cid, 512);
+	const int ncid = rcGetChunksOverlappingSegment(getChunkyMesh(), p, q, cid, 512);
 	if (!ncid)
 		return false;
 	
 	tmin = 1.0f;
 	bool hit = false;
-	const float* verts = m_mesh->getVerts();
 	
 	for (int i = 0; i < ncid; ++i)
 	{
-		const rcChunkyTriMeshNode& node = m_chunkyMesh->nodes[cid[i]];
-		const int* tris = &m_chunkyMesh->tris[node.i*3];
-		const int ntris = node.n;
+		const float* verts = 0;
+		const int* tris = 0;
+		int nverts = 0, ntris = 0;
+		if (!getChunkTris(cid[i], verts, nverts, tris, ntris))
+			continue;
 
 		for (int j = 0; j < ntris*3; j += 3)
 		{
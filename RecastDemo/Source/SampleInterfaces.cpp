@@ -18,7 +18,8 @@
 
 BuildContext::BuildContext() :
 	m_messageCount(0),
-	m_textPoolSize(0)
+	m_textPoolSize(0),
+	m_jobThreads(1)
 {
 	resetTimers();
 }
@@ -82,6 +83,21 @@ int BuildContext::doGetAccumulatedTime(const rcTimerLabel label) const
 	return m_accTime[label];
 }
 
+static void runRecastJob(void* data, const int index, const int /*thread*/)
+{
+	((rcJob*)data)->run(index);
+}
+
+void BuildContext::doRunJobs(rcJob* job, const int count)
+{
+	runJobThreads(runRecastJob, job, count, m_jobThreads);
+}
+
+void BuildContext::setJobThreads(const int n)
+{
+	m_jobThreads = rcClamp(n, 1, (int)MAX_JOB_THREADS);
+}
+
 void BuildContext::dumpLog(const char* format, ...)
 {
 	// Print header.
@@ -139,6 +155,53 @@ const char* BuildContext::getLogText(const int i) const
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+struct JobThread
+{
+	JobThreadFunc func;
+	void* data;
+	int index;
+	int stride;
+	int count;
+};
+
+static int jobThreadMain(void* data)
+{
+	JobThread* t = (JobThread*)data;
+	for (int i = t->index; i < t->count; i += t->stride)
+		t->func(t->data, i, t->index);
+	return 0;
+}
+
+void runJobThreads(JobThreadFunc func, void* data, const int count, const int nthreads)
+{
+	const int n = rcMin(rcClamp(nthreads, 1, (int)BuildContext::MAX_JOB_THREADS), count);
+	JobThread threads[BuildContext::MAX_JOB_THREADS];
+	SDL_Thread* handles[BuildContext::MAX_JOB_THREADS];
+	for (int i = 0; i < n; ++i)
+	{
+		threads[i].func = func;
+		threads[i].data = data;
+		threads[i].index = i;
+		threads[i].stride = n;
+		threads[i].count = count;
+	}
+	// The calling thread acts as the first thread.
+	for (int i = 1; i < n; ++i)
+		handles[i] = SDL_CreateThread(jobThreadMain, &threads[i]);
+	if (n > 0)
+		jobThreadMain(&threads[0]);
+	for (int i = 1; i < n; ++i)
+	{
+		// Run the jobs of a thread that could not be created here.
+		if (handles[i])
+			SDL_WaitThread(handles[i], 0);
+		else
+			jobThreadMain(&threads[i]);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 class GLCheckerTexture
 {
 	unsigned int m_texId;
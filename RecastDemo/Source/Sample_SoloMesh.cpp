@@ -45,6 +45,7 @@
 
 Sample_SoloMesh::Sample_SoloMesh() :
 	m_keepInterResults(true),
+	m_buildThreads(1),
 	m_totalBuildTimeMs(0),
 	m_triareas(0),
 	m_solid(0),
@@ -86,6 +87,7 @@ void Sample_SoloMesh::handleSettings()
 	
 	if (imguiCheck("Keep Itermediate Results", m_keepInterResults))
 		m_keepInterResults = !m_keepInterResults;
+	imguiSlider("Build Threads", &m_buildThreads, 1.0f, (float)BuildContext::MAX_JOB_THREADS, 1.0f);
 
 	imguiSeparator();
 	
@@ -398,6 +400,7 @@ bool Sample_SoloMesh::handleBuild()
 
 	// Reset build times gathering.
 	m_ctx->resetTimers();
+	m_ctx->setJobThreads((int)m_buildThreads);
 
 	// Start the build process.	
 	m_ctx->startTimer(RC_TIMER_TOTAL);
@@ -453,9 +456,12 @@ bool Sample_SoloMesh::handleBuild()
 	// Once all geoemtry is rasterized, we do initial pass of filtering to
 	// remove unwanted overhangs caused by the conservative rasterization
 	// as well as filter spans where the character cannot possibly stand.
-	rcFilterLowHangingWalkableObstacles(m_ctx, m_cfg.walkableClimb, *m_solid);
-	rcFilterLedgeSpans(m_ctx, m_cfg.walkableHeight, m_cfg.walkableClimb, *m_solid);
-	rcFilterWalkableLowHeightSpans(m_ctx, m_cfg.walkableHeight, *m_solid);
+	const int filterFlags = RC_FILTER_LOW_HANGING_OBSTACLES | RC_FILTER_LEDGE_SPANS | RC_FILTER_WALKABLE_LOW_HEIGHT_SPANS;
+	if (!rcFilterHeightfield(m_ctx, filterFlags, m_cfg.walkableHeight, m_cfg.walkableClimb, *m_solid))
+	{
+		m_ctx->log(RC_LOG_ERROR, "buildNavigation: Could not filter heightfield.");
+		return false;
+	}
 
 
 	//
@@ -122,6 +122,11 @@ struct FastLZCompressor : public dtTileCacheCompressor
 		*bufferSize = fastlz_decompress(compressed, compressedSize, buffer, maxBufferSize);
 		return *bufferSize < 0 ? DT_FAILURE : DT_SUCCESS;
 	}
+	
+	virtual unsigned char getCodec()
+	{
+		return DT_TILECACHE_CODEC_FASTLZ;
+	}
 };
 
 struct LinearAllocator : public dtTileCacheAlloc
@@ -171,6 +176,54 @@ struct LinearAllocator : public dtTileCacheAlloc
 	}
 };
 
+struct ThreadedWorkers : public dtTileCacheWorkers
+{
+	static const int MAX_WORKERS = BuildContext::MAX_JOB_THREADS;
+	
+	// Each worker thread has its own allocator.
+	LinearAllocator* m_tallocs[MAX_WORKERS];
+	dtTileCacheJob* m_job;
+	int m_nworkers;
+	
+	ThreadedWorkers(const int allocSize) : m_job(0), m_nworkers(1)
+	{
+		for (int i = 0; i < MAX_WORKERS; ++i)
+			m_tallocs[i] = new LinearAllocator(allocSize);
+	}
+	
+	~ThreadedWorkers()
+	{
+		for (int i = 0; i < MAX_WORKERS; ++i)
+			delete m_tallocs[i];
+	}
+	
+	void setWorkerCount(const int n)
+	{
+		m_nworkers = rcClamp(n, 1, (int)MAX_WORKERS);
+	}
+	
+	int getPeakMemUsage() const
+	{
+		int high = 0;
+		for (int i = 0; i < MAX_WORKERS; ++i)
+			high = dtMax(high, m_tallocs[i]->high);
+		return high;
+	}
+	
+	static void runJob(void* data, const int index, const int thread)
+	{
+		ThreadedWorkers* w = (ThreadedWorkers*)data;
+		w->m_job->run(index, w->m_tallocs[thread]);
+	}
+	
+	virtual void run(dtTileCacheJob* job, const int count)
+	{
+		m_job = job;
+		runJobThreads(runJob, this, count, m_nworkers);
+		m_job = 0;
+	}
+};
+
 struct MeshProcess : public dtTileCacheMeshProcess
 {
 	InputGeom* m_geom;
@@ -268,22 +321,20 @@ struct RasterizationContext
 };
 
 static int rasterizeTileLayers(BuildContext* ctx, InputGeom* geom,
+							   dtTileCacheCompressor* comp,
 							   const int tx, const int ty,
 							   const rcConfig& cfg,
 							   TileCacheData* tiles,
 							   const int maxTiles)
 {
-	if (!geom || !geom->getMesh() || !geom->getChunkyMesh())
+	if (!geom || !geom->getChunkyMesh())
 	{
 		ctx->log(RC_LOG_ERROR, "buildTile: Input mesh is not specified.");
 		return 0;
 	}
 	
-	FastLZCompressor comp;
 	RasterizationContext rc;
 	
-	const float* verts = geom->getMesh()->getVerts();
-	const int nverts = geom->getMesh()->getVertCount();
 	const rcChunkyTriMesh* chunkyMesh = geom->getChunkyMesh();
 	
 	// Tile bounds.
@@ -340,9 +391,14 @@ static int rasterizeTileLayers(BuildContext* ctx, InputGeom* geom,
 	
 	for (int i = 0; i < ncid; ++i)
 	{
-		const rcChunkyTriMeshNode& node = chunkyMesh->nodes[cid[i]];
-		const int* tris = &chunkyMesh->tris[node.i*3];
-		const int ntris = node.n;
+		const float* verts = 0;
+		const int* tris = 0;
+		int nverts = 0, ntris = 0;
+		if (!geom->getChunkTris(cid[i], verts, nverts, tris, ntris))
+		{
+			ctx->log(RC_LOG_ERROR, "buildTile: Could not read chunk %d.", cid[i]);
+			return 0;
+		}
 		
 		memset(rc.triareas, 0, ntris*sizeof(unsigned char));
 		rcMarkWalkableTriangles(ctx, tcfg.walkableSlopeAngle,
@@ -354,9 +410,12 @@ static int rasterizeTileLayers(BuildContext* ctx, InputGeom* geom,
 	// Once all geometry is rasterized, we do initial pass of filtering to
 	// remove unwanted overhangs caused by the conservative rasterization
 	// as well as filter spans where the character cannot possibly stand.
-	rcFilterLowHangingWalkableObstacles(ctx, tcfg.walkableClimb, *rc.solid);
-	rcFilterLedgeSpans(ctx, tcfg.walkableHeight, tcfg.walkableClimb, *rc.solid);
-	rcFilterWalkableLowHeightSpans(ctx, tcfg.walkableHeight, *rc.solid);
+	const int filterFlags = RC_FILTER_LOW_HANGING_OBSTACLES | RC_FILTER_LEDGE_SPANS | RC_FILTER_WALKABLE_LOW_HEIGHT_SPANS;
+	if (!rcFilterHeightfield(ctx, filterFlags, tcfg.walkableHeight, tcfg.walkableClimb, *rc.solid))
+	{
+		ctx->log(RC_LOG_ERROR, "buildNavigation: Could not filter heightfield.");
+		return 0;
+	}
 	
 	
 	rc.chf = rcAllocCompactHeightfield();
@@ -427,7 +486,7 @@ static int rasterizeTileLayers(BuildContext* ctx, InputGeom* geom,
 		header.hmin = (unsigned short)layer->hmin;
 		header.hmax = (unsigned short)layer->hmax;
 
-		dtStatus status = dtBuildTileCacheLayer(&comp, &header, layer->heights, layer->areas, layer->cons,
+		dtStatus status = dtBuildTileCacheLayer(comp, &header, layer->heights, layer->areas, layer->cons,
 												&tile->data, &tile->dataSize);
 		if (dtStatusFailed(status))
 		{
@@ -513,7 +572,6 @@ void drawDetail(duDebugDraw* dd, dtTileCache* tc, const int tx, const int ty, in
 	const int ntiles = tc->getTilesAt(tx,ty,tiles,MAX_LAYERS);
 
 	dtTileCacheAlloc* talloc = tc->getAlloc();
-	dtTileCacheCompressor* tcomp = tc->getCompressor();
 	const dtTileCacheParams* params = tc->getParams();
 
 	for (int i = 0; i < ntiles; ++i)
@@ -527,7 +585,8 @@ void drawDetail(duDebugDraw* dd, dtTileCache* tc, const int tx, const int ty, in
 		dtStatus status;
 		
 		// Decompress tile layer data. 
-		status = dtDecompressTileCacheLayer(talloc, tcomp, tile->data, tile->dataSize, &bc.layer);
+		status = dtDecompressTileCacheLayer(talloc, tc->getCompressor(tile->header->codec),
+											tile->data, tile->dataSize, &bc.layer);
 		if (dtStatusFailed(status))
 			return;
 		if (type == DRAWDETAIL_AREAS)
@@ -537,7 +596,10 @@ void drawDetail(duDebugDraw* dd, dtTileCache* tc, const int tx, const int ty, in
 		}
 
 		// Build navmesh
-		status = dtBuildTileCacheRegions(talloc, *bc.layer, walkableClimbVx);
+		if (params->partitionType == DT_TILECACHE_PARTITION_WATERSHED)
+			status = dtBuildTileCacheWatershedRegions(talloc, *bc.layer, walkableClimbVx);
+		else
+			status = dtBuildTileCacheRegions(talloc, *bc.layer, walkableClimbVx);
 		if (dtStatusFailed(status))
 			return;
 		if (type == DRAWDETAIL_REGIONS)
@@ -635,6 +697,50 @@ dtObstacleRef hitTestObstacle(const dtTileCache* tc, const float* sp, const floa
 	return tc->getObstacleRef(obmin);
 }
 	
+static void drawOrientedBox(duDebugDraw* dd, const dtObstacleOrientedBox* box, const unsigned int col)
+{
+	const float c = box->rotAux[0];
+	const float s = box->rotAux[1];
+	const float* he = box->halfExtents;
+	float verts[8*3];
+	for (int i = 0; i < 8; ++i)
+	{
+		const float lx = (i & 1) ? he[0] : -he[0];
+		const float lz = (i & 2) ? he[2] : -he[2];
+		float* v = &verts[i*3];
+		v[0] = box->center[0] + lx*c + lz*s;
+		v[1] = box->center[1] + ((i & 4) ? he[1] : -he[1]);
+		v[2] = box->center[2] - lx*s + lz*c;
+	}
+	static const unsigned char faces[6*4] =
+	{
+		4, 6, 7, 5,
+		0, 1, 3, 2,
+		0, 4, 5, 1,
+		2, 3, 7, 6,
+		0, 2, 6, 4,
+		1, 5, 7, 3,
+	};
+	dd->begin(DU_DRAW_QUADS);
+	for (int i = 0; i < 6*4; ++i)
+		dd->vertex(&verts[faces[i]*3], col);
+	dd->end();
+	
+	const unsigned int wcol = duDarkenCol(col);
+	dd->begin(DU_DRAW_LINES, 2.0f);
+	for (int i = 0; i < 8; ++i)
+	{
+		// Edges along x, z and y.
+		for (int j = 1; j <= 4; j <<= 1)
+		{
+			if (i & j) continue;
+			dd->vertex(&verts[i*3], wcol);
+			dd->vertex(&verts[(i|j)*3], wcol);
+		}
+	}
+	dd->end();
+}
+
 void drawObstacles(duDebugDraw* dd, const dtTileCache* tc)
 {
 	// Draw obstacles
@@ -653,8 +759,22 @@ void drawObstacles(duDebugDraw* dd, const dtTileCache* tc)
 		else if (ob->state == DT_OBSTACLE_REMOVING)
 			col = duRGBA(220,0,0,128);
 
-		duDebugDrawCylinder(dd, bmin[0],bmin[1],bmin[2], bmax[0],bmax[1],bmax[2], col);
-		duDebugDrawCylinderWire(dd, bmin[0],bmin[1],bmin[2], bmax[0],bmax[1],bmax[2], duDarkenCol(col), 2);
+		if (ob->type == DT_OBSTACLE_CYLINDER)
+		{
+			duDebugDrawCylinder(dd, bmin[0],bmin[1],bmin[2], bmax[0],bmax[1],bmax[2], col);
+			duDebugDrawCylinderWire(dd, bmin[0],bmin[1],bmin[2], bmax[0],bmax[1],bmax[2], duDarkenCol(col), 2);
+		}
+		else if (ob->type == DT_OBSTACLE_BOX)
+		{
+			unsigned int fcol[6];
+			duCalcBoxColors(fcol, col, col);
+			duDebugDrawBox(dd, bmin[0],bmin[1],bmin[2], bmax[0],bmax[1],bmax[2], fcol);
+			duDebugDrawBoxWire(dd, bmin[0],bmin[1],bmin[2], bmax[0],bmax[1],bmax[2], duDarkenCol(col), 2);
+		}
+		else if (ob->type == DT_OBSTACLE_ORIENTED_BOX)
+		{
+			drawOrientedBox(dd, &ob->orientedBox, col);
+		}
 	}
 }
 
@@ -765,10 +885,15 @@ public:
 class TempObstacleCreateTool : public SampleTool
 {
 	Sample_TempObstacles* m_sample;
+	int m_obstacleType;
+	float m_angle;
 	
 public:
 	
-	TempObstacleCreateTool()
+	TempObstacleCreateTool() :
+		m_sample(0),
+		m_obstacleType(DT_OBSTACLE_CYLINDER),
+		m_angle(0)
 	{
 	}
 	
@@ -794,6 +919,17 @@ public:
 		
 		imguiSeparator();
 
+		if (imguiCheck("Cylinder", m_obstacleType == DT_OBSTACLE_CYLINDER))
+			m_obstacleType = DT_OBSTACLE_CYLINDER;
+		if (imguiCheck("Box", m_obstacleType == DT_OBSTACLE_BOX))
+			m_obstacleType = DT_OBSTACLE_BOX;
+		if (imguiCheck("Oriented Box", m_obstacleType == DT_OBSTACLE_ORIENTED_BOX))
+			m_obstacleType = DT_OBSTACLE_ORIENTED_BOX;
+		if (m_obstacleType == DT_OBSTACLE_ORIENTED_BOX)
+			imguiSlider("Angle", &m_angle, 0.0f, 180.0f, 5.0f);
+		
+		imguiSeparator();
+
 		imguiValue("Click LMB to create an obstacle.");
 		imguiValue("Shift+LMB to remove an obstacle.");
 	}
@@ -805,7 +941,7 @@ public:
 			if (shift)
 				m_sample->removeTempObstacle(s,p);
 			else
-				m_sample->addTempObstacle(p);
+				m_sample->addTempObstacle(p, m_obstacleType, m_angle/180.0f*DU_PI);
 		}
 	}
 	
@@ -828,16 +964,25 @@ Sample_TempObstacles::Sample_TempObstacles() :
 	m_cacheRawSize(0),
 	m_cacheLayerCount(0),
 	m_cacheBuildMemUsage(0),
+	m_cacheBuildPolyCount(0),
+	m_cacheDecompressTimeMs(0),
 	m_drawMode(DRAWMODE_NAVMESH),
 	m_maxTiles(0),
 	m_maxPolysPerTile(0),
-	m_tileSize(48)
+	m_tileSize(48),
+	m_updateThreads(1),
+	m_maxTilesPerUpdate(1),
+	m_layerCodec(false),
+	m_layerCacheSize(0),
+	m_archive(0)
 {
 	resetCommonSettings();
 	
-	m_talloc = new LinearAllocator(32000);
+	m_talloc = new LinearAllocator(64000);
 	m_tcomp = new FastLZCompressor;
+	m_layerComp = new dtTileCacheLayerCompressor;
 	m_tmproc = new MeshProcess;
+	m_tworkers = new ThreadedWorkers(64000);
 	
 	setTool(new TempObstacleCreateTool);
 }
@@ -847,6 +992,9 @@ Sample_TempObstacles::~Sample_TempObstacles()
 	dtFreeNavMesh(m_navMesh);
 	m_navMesh = 0;
 	dtFreeTileCache(m_tileCache);
+	dtFree(m_archive);
+	delete m_tworkers;
+	delete m_layerComp;
 }
 
 void Sample_TempObstacles::handleSettings()
@@ -895,6 +1043,11 @@ void Sample_TempObstacles::handleSettings()
 	imguiSeparator();
 	
 	imguiLabel("Tile Cache");
+	imguiSlider("Update Threads", &m_updateThreads, 1.0f, (float)ThreadedWorkers::MAX_WORKERS, 1.0f);
+	imguiSlider("Max Tiles Per Update", &m_maxTilesPerUpdate, 1.0f, 32.0f, 1.0f);
+	if (imguiCheck("Layer Codec", m_layerCodec))
+		m_layerCodec = !m_layerCodec;
+	imguiSlider("Layer Cache (kB)", &m_layerCacheSize, 0.0f, 4096.0f, 64.0f);
 	char msg[64];
 
 	const float compressionRatio = (float)m_cacheCompressedSize / (float)(m_cacheRawSize+1);
@@ -910,8 +1063,169 @@ void Sample_TempObstacles::handleSettings()
 	imguiValue(msg);
 	snprintf(msg, 64, "Build Peak Mem Usage  %.1f kB", m_cacheBuildMemUsage/1024.0f);
 	imguiValue(msg);
+	snprintf(msg, 64, "Navmesh Polys  %d", m_cacheBuildPolyCount);
+	imguiValue(msg);
+	snprintf(msg, 64, "Decompress Time  %.2f ms (%.0f MB/s)", m_cacheDecompressTimeMs,
+			 m_cacheDecompressTimeMs > 0 ? m_cacheRawSize/(m_cacheDecompressTimeMs*1000.0f) : 0.0f);
+	imguiValue(msg);
+	if (m_tileCache)
+	{
+		snprintf(msg, 64, "Pending Obstacle Requests  %u",
+				 m_tileCache->getLastObstacleTicket() - m_tileCache->getCompletedObstacleTicket());
+		imguiValue(msg);
+	}
+	if (m_tileCache && m_layerCacheSize > 0)
+	{
+		const dtTileCacheLayerCacheStats& stats = m_tileCache->getLayerCacheStats();
+		const int lookups = stats.hits + stats.misses;
+		snprintf(msg, 64, "Layer Cache  %.1f kB, %d layers", stats.memUsage/1024.0f, stats.layerCount);
+		imguiValue(msg);
+		snprintf(msg, 64, "Layer Cache Hits  %.1f%% (%d evicted)",
+				 lookups > 0 ? stats.hits*100.0f/lookups : 0.0f, stats.evictions);
+		imguiValue(msg);
+		snprintf(msg, 64, "Skipped Rebuilds  %d", stats.skipped);
+		imguiValue(msg);
+	}
 	
 	imguiSeparator();
+	
+	imguiIndent();
+	imguiIndent();
+	
+	if (imguiButton("Save"))
+		saveAll("all_tiles_tilecache.bin");
+	
+	if (imguiButton("Load"))
+		loadAll("all_tiles_tilecache.bin");
+	
+	imguiUnindent();
+	imguiUnindent();
+	
+	imguiSeparator();
+}
+
+void Sample_TempObstacles::saveAll(const char* path)
+{
+	if (!m_tileCache) return;
+	
+	unsigned char* data = 0;
+	int dataSize = 0;
+	if (dtStatusFailed(m_tileCache->saveArchive(&data, &dataSize)))
+	{
+		m_ctx->log(RC_LOG_ERROR, "saveAll: Could not write tile cache archive.");
+		return;
+	}
+	
+	FILE* fp = fopen(path, "wb");
+	if (fp)
+	{
+		fwrite(data, dataSize, 1, fp);
+		fclose(fp);
+	}
+	dtFree(data);
+}
+
+void Sample_TempObstacles::loadAll(const char* path)
+{
+	FILE* fp = fopen(path, "rb");
+	if (!fp) return;
+	fseek(fp, 0, SEEK_END);
+	const int dataSize = (int)ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (dataSize < (int)sizeof(dtTileCacheArchiveHeader))
+	{
+		fclose(fp);
+		return;
+	}
+	unsigned char* data = (unsigned char*)dtAlloc(dataSize, DT_ALLOC_PERM);
+	if (!data)
+	{
+		fclose(fp);
+		return;
+	}
+	const size_t readSize = fread(data, dataSize, 1, fp);
+	fclose(fp);
+	const dtTileCacheArchiveHeader* header = (const dtTileCacheArchiveHeader*)data;
+	if (readSize != 1 ||
+		header->magic != DT_TILECACHE_ARCHIVE_MAGIC ||
+		header->version != DT_TILECACHE_ARCHIVE_VERSION)
+	{
+		m_ctx->log(RC_LOG_ERROR, "loadAll: Not a tile cache archive.");
+		dtFree(data);
+		return;
+	}
+	
+	// The tiles of the old cache may point to the old archive.
+	dtFreeTileCache(m_tileCache);
+	dtFree(m_archive);
+	m_archive = data;
+	
+	m_tmproc->init(m_geom);
+	
+	m_tileCache = dtAllocTileCache();
+	if (!m_tileCache || dtStatusFailed(m_tileCache->init(&header->params, m_talloc, m_tcomp, m_tmproc)))
+	{
+		m_ctx->log(RC_LOG_ERROR, "loadAll: Could not init tile cache.");
+		return;
+	}
+	m_tileCache->addCompressor(m_layerComp);
+	if (dtStatusFailed(m_tileCache->setArchive(m_archive, dataSize)))
+	{
+		m_ctx->log(RC_LOG_ERROR, "loadAll: Could not read tile cache archive.");
+		return;
+	}
+	
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	rcVcopy(params.orig, header->params.orig);
+	params.tileWidth = header->params.width*header->params.cs;
+	params.tileHeight = header->params.height*header->params.cs;
+	const int tileBits = rcMin((int)dtIlog2(dtNextPow2(header->params.maxTiles)), 14);
+	params.maxTiles = 1 << tileBits;
+	params.maxPolys = 1 << (22 - tileBits);
+	
+	dtFreeNavMesh(m_navMesh);
+	m_navMesh = dtAllocNavMesh();
+	if (!m_navMesh || dtStatusFailed(m_navMesh->init(&params)))
+	{
+		m_ctx->log(RC_LOG_ERROR, "loadAll: Could not init navmesh.");
+		return;
+	}
+	m_navQuery->init(m_navMesh, 2048);
+	
+	// Load all tiles, a large world would only load the tiles around the viewer.
+	const dtTileCacheArchiveTile* tiles = (const dtTileCacheArchiveTile*)(m_archive + header->tilesOffset);
+	int tx0 = 0, ty0 = 0, tx1 = -1, ty1 = -1;
+	for (int i = 0; i < header->ntiles; ++i)
+	{
+		tx0 = i == 0 ? tiles[i].tx : dtMin(tx0, tiles[i].tx);
+		ty0 = i == 0 ? tiles[i].ty : dtMin(ty0, tiles[i].ty);
+		tx1 = i == 0 ? tiles[i].tx : dtMax(tx1, tiles[i].tx);
+		ty1 = i == 0 ? tiles[i].ty : dtMax(ty1, tiles[i].ty);
+	}
+	float bmin[3], bmax[3];
+	dtVcopy(bmin, header->params.orig);
+	dtVcopy(bmax, header->params.orig);
+	bmin[0] += (tx0+0.5f)*params.tileWidth;
+	bmin[2] += (ty0+0.5f)*params.tileHeight;
+	bmax[0] += (tx1+0.5f)*params.tileWidth;
+	bmax[2] += (ty1+0.5f)*params.tileHeight;
+	
+	static const int MAX_LOADED = 64;
+	dtCompressedTileRef loaded[MAX_LOADED];
+	int nloaded = 0;
+	dtStatus status;
+	do
+	{
+		status = m_tileCache->loadArchiveTiles(bmin, bmax, loaded, &nloaded, MAX_LOADED);
+		for (int i = 0; i < nloaded; ++i)
+			m_tileCache->buildNavMeshTile(loaded[i], m_navMesh);
+	}
+	while (dtStatusDetail(status, DT_BUFFER_TOO_SMALL));
+	
+	if (m_tool)
+		m_tool->init(this);
+	initToolStates(this);
 }
 
 void Sample_TempObstacles::handleTools()
@@ -1007,7 +1321,7 @@ void Sample_TempObstacles::handleDebugMode()
 
 void Sample_TempObstacles::handleRender()
 {
-	if (!m_geom || !m_geom->getMesh())
+	if (!m_geom || !m_geom->getChunkyMesh())
 		return;
 	
 	DebugDrawGL dd;
@@ -1017,10 +1331,13 @@ void Sample_TempObstacles::handleRender()
 	// Draw mesh
 	if (m_drawMode != DRAWMODE_NAVMESH_TRANS)
 	{
-		// Draw mesh
-		duDebugDrawTriMeshSlope(&dd, m_geom->getMesh()->getVerts(), m_geom->getMesh()->getVertCount(),
-								m_geom->getMesh()->getTris(), m_geom->getMesh()->getNormals(), m_geom->getMesh()->getTriCount(),
-								m_agentMaxSlope, texScale);
+		// Draw mesh, streamed meshes are not kept in memory.
+		if (m_geom->getMesh())
+		{
+			duDebugDrawTriMeshSlope(&dd, m_geom->getMesh()->getVerts(), m_geom->getMesh()->getVertCount(),
+									m_geom->getMesh()->getTris(), m_geom->getMesh()->getNormals(), m_geom->getMesh()->getTriCount(),
+									m_agentMaxSlope, texScale);
+		}
 		m_geom->drawOffMeshConnections(&dd);
 	}
 	
@@ -1140,14 +1457,29 @@ void Sample_TempObstacles::handleMeshChanged(class InputGeom* geom)
 	initToolStates(this);
 }
 
-void Sample_TempObstacles::addTempObstacle(const float* pos)
+void Sample_TempObstacles::addTempObstacle(const float* pos, const int type, const float yRadians)
 {
 	if (!m_tileCache)
 		return;
 	float p[3];
 	dtVcopy(p, pos);
 	p[1] -= 0.5f;
-	m_tileCache->addObstacle(p, 1.0f, 2.0f, 0);
+	if (type == DT_OBSTACLE_BOX)
+	{
+		const float bmin[3] = { p[0]-1.0f, p[1], p[2]-1.0f };
+		const float bmax[3] = { p[0]+1.0f, p[1]+2.0f, p[2]+1.0f };
+		m_tileCache->addBoxObstacle(bmin, bmax, 0);
+	}
+	else if (type == DT_OBSTACLE_ORIENTED_BOX)
+	{
+		const float center[3] = { p[0], p[1]+1.0f, p[2] };
+		const float halfExtents[3] = { 2.0f, 1.0f, 0.5f };
+		m_tileCache->addOrientedBoxObstacle(center, halfExtents, yRadians, 0);
+	}
+	else
+	{
+		m_tileCache->addObstacle(p, 1.0f, 2.0f, 0);
+	}
 }
 
 void Sample_TempObstacles::removeTempObstacle(const float* sp, const float* sq)
@@ -1174,7 +1506,7 @@ bool Sample_TempObstacles::handleBuild()
 {
 	dtStatus status;
 	
-	if (!m_geom || !m_geom->getMesh())
+	if (!m_geom || !m_geom->getChunkyMesh())
 	{
 		m_ctx->log(RC_LOG_ERROR, "buildTiledNavigation: No vertices and triangles.");
 		return false;
@@ -1228,8 +1560,11 @@ bool Sample_TempObstacles::handleBuild()
 	tcparams.maxSimplificationError = m_edgeMaxError;
 	tcparams.maxTiles = tw*th*EXPECTED_LAYERS_PER_TILE;
 	tcparams.maxObstacles = 128;
+	tcparams.partitionType = m_monotonePartitioning ? DT_TILECACHE_PARTITION_MONOTONE : DT_TILECACHE_PARTITION_WATERSHED;
 
 	dtFreeTileCache(m_tileCache);
+	dtFree(m_archive);
+	m_archive = 0;
 	
 	m_tileCache = dtAllocTileCache();
 	if (!m_tileCache)
@@ -1237,12 +1572,19 @@ bool Sample_TempObstacles::handleBuild()
 		m_ctx->log(RC_LOG_ERROR, "buildTiledNavigation: Could not allocate tile cache.");
 		return false;
 	}
-	status = m_tileCache->init(&tcparams, m_talloc, m_tcomp, m_tmproc);
+	// Layers are compressed with the selected codec, the other one is only used
+	// for reading layers built with it.
+	dtTileCacheCompressor* tcomp = m_tcomp;
+	dtTileCacheCompressor* tcompOther = m_layerComp;
+	if (m_layerCodec)
+		dtSwap(tcomp, tcompOther);
+	status = m_tileCache->init(&tcparams, m_talloc, tcomp, m_tmproc);
 	if (dtStatusFailed(status))
 	{
 		m_ctx->log(RC_LOG_ERROR, "buildTiledNavigation: Could not init tile cache.");
 		return false;
 	}
+	m_tileCache->addCompressor(tcompOther);
 	
 	dtFreeNavMesh(m_navMesh);
 	
@@ -1290,7 +1632,7 @@ bool Sample_TempObstacles::handleBuild()
 		{
 			TileCacheData tiles[MAX_LAYERS];
 			memset(tiles, 0, sizeof(tiles));
-			int ntiles = rasterizeTileLayers(m_ctx, m_geom, x, y, cfg, tiles, MAX_LAYERS);
+			int ntiles = rasterizeTileLayers(m_ctx, m_geom, tcomp, x, y, cfg, tiles, MAX_LAYERS);
 
 			for (int i = 0; i < ntiles; ++i)
 			{
@@ -1320,6 +1662,30 @@ bool Sample_TempObstacles::handleBuild()
 	m_cacheBuildTimeMs = m_ctx->getAccumulatedTime(RC_TIMER_TOTAL)/1000.0f;
 	m_cacheBuildMemUsage = m_talloc->high;
 	
+	m_cacheBuildPolyCount = 0;
+	const dtNavMesh* mesh = m_navMesh;
+	for (int i = 0; i < mesh->getMaxTiles(); ++i)
+	{
+		const dtMeshTile* tile = mesh->getTile(i);
+		if (tile->header)
+			m_cacheBuildPolyCount += tile->header->polyCount;
+	}
+	
+	// Measure layer decompression.
+	m_ctx->startTimer(RC_TIMER_TEMP);
+	for (int i = 0; i < m_tileCache->getTileCount(); ++i)
+	{
+		const dtCompressedTile* tile = m_tileCache->getTile(i);
+		if (!tile->header)
+			continue;
+		m_talloc->reset();
+		dtTileCacheLayer* layer = 0;
+		dtDecompressTileCacheLayer(m_talloc, m_tileCache->getCompressor(tile->header->codec),
+								   tile->data, tile->dataSize, &layer);
+	}
+	m_ctx->stopTimer(RC_TIMER_TEMP);
+	m_cacheDecompressTimeMs = m_ctx->getAccumulatedTime(RC_TIMER_TEMP)/1000.0f;
+	
 
 	const dtNavMesh* nav = m_navMesh;
 	int navmeshMemUsage = 0;
@@ -1348,6 +1714,9 @@ void Sample_TempObstacles::handleUpdate(const float dt)
 	if (!m_tileCache)
 		return;
 	
+	m_tworkers->setWorkerCount((int)m_updateThreads);
+	m_tileCache->setWorkers(m_updateThreads > 1 ? m_tworkers : 0, (int)m_maxTilesPerUpdate);
+	m_tileCache->setLayerCacheSize((int)m_layerCacheSize*1024);
 	m_tileCache->update(dt, m_navMesh);
 }
 
@@ -175,6 +175,7 @@ public:
 Sample_TileMesh::Sample_TileMesh() :
 	m_keepInterResults(false),
 	m_buildAll(true),
+	m_compactLinks(false),
 	m_totalBuildTimeMs(0),
 	m_triareas(0),
 	m_solid(0),
@@ -340,6 +341,9 @@ void Sample_TileMesh::handleSettings()
 
 	if (imguiCheck("Build All Tiles", m_buildAll))
 		m_buildAll = !m_buildAll;
+
+	if (imguiCheck("Compact Links", m_compactLinks))
+		m_compactLinks = !m_compactLinks;
 	
 	imguiLabel("Tiling");
 	imguiSlider("TileSize", &m_tileSize, 16.0f, 1024.0f, 16.0f);
@@ -528,7 +532,7 @@ void Sample_TileMesh::handleDebugMode()
 
 void Sample_TileMesh::handleRender()
 {
-	if (!m_geom || !m_geom->getMesh())
+	if (!m_geom || !m_geom->getChunkyMesh())
 		return;
 	
 	DebugDrawGL dd;
@@ -538,10 +542,13 @@ void Sample_TileMesh::handleRender()
 	// Draw mesh
 	if (m_drawMode != DRAWMODE_NAVMESH_TRANS)
 	{
-		// Draw mesh
-		duDebugDrawTriMeshSlope(&dd, m_geom->getMesh()->getVerts(), m_geom->getMesh()->getVertCount(),
-								m_geom->getMesh()->getTris(), m_geom->getMesh()->getNormals(), m_geom->getMesh()->getTriCount(),
-								m_agentMaxSlope, texScale);
+		// Draw mesh, streamed meshes are not kept in memory.
+		if (m_geom->getMesh())
+		{
+			duDebugDrawTriMeshSlope(&dd, m_geom->getMesh()->getVerts(), m_geom->getMesh()->getVertCount(),
+									m_geom->getMesh()->getTris(), m_geom->getMesh()->getNormals(), m_geom->getMesh()->getTriCount(),
+									m_agentMaxSlope, texScale);
+		}
 		m_geom->drawOffMeshConnections(&dd);
 	}
 		
@@ -694,7 +701,7 @@ void Sample_TileMesh::handleMeshChanged(class InputGeom* geom)
 
 bool Sample_TileMesh::handleBuild()
 {
-	if (!m_geom || !m_geom->getMesh())
+	if (!m_geom || !m_geom->getChunkyMesh())
 	{
 		m_ctx->log(RC_LOG_ERROR, "buildTiledNavigation: No vertices and triangles.");
 		return false;
@@ -776,7 +783,8 @@ void Sample_TileMesh::buildTile(const float* pos)
 	if (data)
 	{
 		// Let the navmesh own the data.
-		dtStatus status = m_navMesh->addTile(data,dataSize,DT_TILE_FREE_DATA,0,0);
+		const int flags = DT_TILE_FREE_DATA | (m_compactLinks ? DT_TILE_COMPACT_LINKS : 0);
+		dtStatus status = m_navMesh->addTile(data,dataSize,flags,0,0);
 		if (dtStatusFailed(status))
 			dtFree(data);
 	}
@@ -857,7 +865,8 @@ void Sample_TileMesh::buildAllTiles()
 				// Remove any previous data (navmesh owns and deletes the data).
 				m_navMesh->removeTile(m_navMesh->getTileRefAt(x,y,0),0,0);
 				// Let the navmesh own the data.
-				dtStatus status = m_navMesh->addTile(data,dataSize,DT_TILE_FREE_DATA,0,0);
+				const int flags = DT_TILE_FREE_DATA | (m_compactLinks ? DT_TILE_COMPACT_LINKS : 0);
+				dtStatus status = m_navMesh->addTile(data,dataSize,flags,0,0);
 				if (dtStatusFailed(status))
 					dtFree(data);
 			}
@@ -889,7 +898,7 @@ void Sample_TileMesh::removeAllTiles()
 
 unsigned char* Sample_TileMesh::buildTileMesh(const int tx, const int ty, const float* bmin, const float* bmax, int& dataSize)
 {
-	if (!m_geom || !m_geom->getMesh() || !m_geom->getChunkyMesh())
+	if (!m_geom || !m_geom->getChunkyMesh())
 	{
 		m_ctx->log(RC_LOG_ERROR, "buildNavigation: Input mesh is not specified.");
 		return 0;
@@ -900,10 +909,8 @@ unsigned char* Sample_TileMesh::buildTileMesh(const int tx, const int ty, const
 	
 	cleanup();
 	
-	const float* verts = m_geom->getMesh()->getVerts();
-	const int nverts = m_geom->getMesh()->getVertCount();
-	const int ntris = m_geom->getMesh()->getTriCount();
 	const rcChunkyTriMesh* chunkyMesh = m_geom->getChunkyMesh();
+	const int ntris = chunkyMesh->ntris;
 		
 	// Init build configuration from GUI
 	memset(&m_cfg, 0, sizeof(m_cfg));
@@ -940,7 +947,7 @@ unsigned char* Sample_TileMesh::buildTileMesh(const int tx, const int ty, const
 	
 	m_ctx->log(RC_LOG_PROGRESS, "Building navigation:");
 	m_ctx->log(RC_LOG_PROGRESS, " - %d x %d cells", m_cfg.width, m_cfg.height);
-	m_ctx->log(RC_LOG_PROGRESS, " - %.1fK verts, %.1fK tris", nverts/1000.0f, ntris/1000.0f);
+	m_ctx->log(RC_LOG_PROGRESS, " - %.1fK tris", ntris/1000.0f);
 	
 	// Allocate voxel heightfield where we rasterize our input data to.
 	m_solid = rcAllocHeightfield();
@@ -979,9 +986,16 @@ unsigned char* Sample_TileMesh::buildTileMesh(const int tx, const int ty, const
 	
 	for (int i = 0; i < ncid; ++i)
 	{
-		const rcChunkyTriMeshNode& node = chunkyMesh->nodes[cid[i]];
-		const int* ctris = &chunkyMesh->tris[node.i*3];
-		const int nctris = node.n;
+		// The triangles are pulled one chunk at a time, so that streamed
+		// meshes only need to keep the chunks of the tile in memory.
+		const float* verts = 0;
+		const int* ctris = 0;
+		int nverts = 0, nctris = 0;
+		if (!m_geom->getChunkTris(cid[i], verts, nverts, ctris, nctris))
+		{
+			m_ctx->log(RC_LOG_ERROR, "buildNavigation: Could not read chunk %d.", cid[i]);
+			return 0;
+		}
 		
 		m_tileTriCount += nctris;
 		
@@ -1001,9 +1015,12 @@ unsigned char* Sample_TileMesh::buildTileMesh(const int tx, const int ty, const
 	// Once all geometry is rasterized, we do initial pass of filtering to
 	// remove unwanted overhangs caused by the conservative rasterization
 	// as well as filter spans where the character cannot possibly stand.
-	rcFilterLowHangingWalkableObstacles(m_ctx, m_cfg.walkableClimb, *m_solid);
-	rcFilterLedgeSpans(m_ctx, m_cfg.walkableHeight, m_cfg.walkableClimb, *m_solid);
-	rcFilterWalkableLowHeightSpans(m_ctx, m_cfg.walkableHeight, *m_solid);
+	const int filterFlags = RC_FILTER_LOW_HANGING_OBSTACLES | RC_FILTER_LEDGE_SPANS | RC_FILTER_WALKABLE_LOW_HEIGHT_SPANS;
+	if (!rcFilterHeightfield(m_ctx, filterFlags, m_cfg.walkableHeight, m_cfg.walkableClimb, *m_solid))
+	{
+		m_ctx->log(RC_LOG_ERROR, "buildNavigation: Could not filter heightfield.");
+		return 0;
+	}
 	
 	// Compact the heightfield so that it is faster to handle from now on.
 	// This will result more cache coherent data as well as the neighbours
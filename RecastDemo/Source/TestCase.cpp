@@ -24,6 +24,7 @@
 #include "DetourNavMesh.h"
 #include "DetourNavMeshQuery.h"
 #include "DetourCommon.h"
+#include "DebugDraw.h"
 #include "SDL.h"
 #include "SDL_opengl.h"
 #include "imgui.h"
@@ -34,7 +35,8 @@
 #endif
 
 TestCase::TestCase() :
-	m_tests(0)
+	m_tests(0),
+	m_tileChurn(0)
 {
 }
 
@@ -131,9 +133,7 @@ bool TestCase::load(const char* filePath)
 		{
 			// Pathfind test.
 			Test* test = new Test;
-			memset(test, 0, sizeof(Test));
 			test->type = TEST_PATHFIND;
-			test->expand = false;
 			test->next = m_tests;
 			m_tests = test;
 			sscanf(row+2, "%f %f %f %f %f %f %x %x",
@@ -141,6 +141,25 @@ bool TestCase::load(const char* filePath)
 				   &test->epos[0], &test->epos[1], &test->epos[2],
 				   &test->includeFlags, &test->excludeFlags);
 		}
+		else if (row[0] == 'p' && row[1] == 'c')
+		{
+			// Polys around circle test.
+			Test* test = new Test;
+			test->type = TEST_POLYS_AROUND_CIRCLE;
+			test->next = m_tests;
+			m_tests = test;
+			sscanf(row+2, "%f %f %f %f %x %x",
+				   &test->spos[0], &test->spos[1], &test->spos[2], &test->radius,
+				   &test->includeFlags, &test->excludeFlags);
+			// The end position marks the edge of the circle.
+			dtVcopy(test->epos, test->spos);
+			test->epos[0] += test->radius;
+		}
+		else if (row[0] == 't' && row[1] == 'c')
+		{
+			// Tile churn, the number of tiles to remove and re-add before the tests.
+			sscanf(row+2, "%d", &m_tileChurn);
+		}
 	}
 	
 	delete [] buf;
@@ -155,6 +174,53 @@ void TestCase::resetTimes()
 		iter->findNearestPolyTime = 0;
 		iter->findPathTime = 0;
 		iter->findStraightPathTime = 0;
+		iter->findPolysAroundCircleTime = 0;
+	}
+}
+
+void TestCase::churnTiles(dtNavMesh* navmesh)
+{
+	// Remove and re-add the tiles one by one, like a streamed world would.
+	// Each re-add relinks the tile and its neighbours, this ages the link
+	// pools before the queries are timed.
+	const dtNavMesh* mesh = navmesh;
+	const int maxTiles = mesh->getMaxTiles();
+	int next = 0;
+	for (int i = 0; i < m_tileChurn; ++i)
+	{
+		const dtMeshTile* tile = 0;
+		for (int j = 0; j < maxTiles && !tile; ++j)
+		{
+			const dtMeshTile* t = mesh->getTile(next);
+			next = (next+1) % maxTiles;
+			if (t->header && t->dataSize)
+				tile = t;
+		}
+		if (!tile)
+			return;
+		
+		const int flags = tile->flags;
+		int dataSize = tile->dataSize;
+		unsigned char* data = 0;
+		if (flags & DT_TILE_FREE_DATA)
+		{
+			// The navmesh frees the data on remove, re-add a copy.
+			data = (unsigned char*)dtAlloc(dataSize, DT_ALLOC_PERM);
+			if (!data)
+				return;
+			memcpy(data, tile->data, dataSize);
+			navmesh->removeTile(mesh->getTileRef(tile), 0, 0);
+		}
+		else
+		{
+			navmesh->removeTile(mesh->getTileRef(tile), &data, &dataSize);
+		}
+		if (dtStatusFailed(navmesh->addTile(data, dataSize, flags, 0, 0)))
+		{
+			if (flags & DT_TILE_FREE_DATA)
+				dtFree(data);
+			return;
+		}
 	}
 }
 
@@ -163,6 +229,9 @@ void TestCase::doTests(dtNavMesh* navmesh, dtNavMeshQuery* navquery)
 	if (!navmesh || !navquery)
 		return;
 	
+	if (m_tileChurn > 0)
+		churnTiles(navmesh);
+	
 	resetTimes();
 	
 	static const int MAX_POLYS = 256;
@@ -186,13 +255,36 @@ void TestCase::doTests(dtNavMesh* navmesh, dtNavMeshQuery* navquery)
 		// Find start points
 		TimeVal findNearestPolyStart = getPerfTime();
 		
-		dtPolyRef startRef, endRef;
+		dtPolyRef startRef = 0, endRef = 0;
 		navquery->findNearestPoly(iter->spos, polyPickExt, &filter, &startRef, 0);
-		navquery->findNearestPoly(iter->epos, polyPickExt, &filter, &endRef, 0);
+		if (iter->type == TEST_PATHFIND)
+			navquery->findNearestPoly(iter->epos, polyPickExt, &filter, &endRef, 0);
 
 		TimeVal findNearestPolyEnd = getPerfTime();
 		iter->findNearestPolyTime += getPerfDeltaTimeUsec(findNearestPolyStart, findNearestPolyEnd);
 
+		if (iter->type == TEST_POLYS_AROUND_CIRCLE)
+		{
+			if (!startRef)
+				continue;
+			
+			// Find polys around circle
+			TimeVal findPolysAroundCircleStart = getPerfTime();
+			
+			navquery->findPolysAroundCircle(startRef, iter->spos, iter->radius, &filter,
+											polys, 0, 0, &iter->npolys, MAX_POLYS);
+			
+			TimeVal findPolysAroundCircleEnd = getPerfTime();
+			iter->findPolysAroundCircleTime += getPerfDeltaTimeUsec(findPolysAroundCircleStart, findPolysAroundCircleEnd);
+			
+			if (iter->npolys)
+			{
+				iter->polys = new dtPolyRef[iter->npolys];
+				memcpy(iter->polys, polys, sizeof(dtPolyRef)*iter->npolys);
+			}
+			continue;
+		}
+
 		if (!startRef || ! endRef)
 			continue;
 	
@@ -233,7 +325,15 @@ void TestCase::doTests(dtNavMesh* navmesh, dtNavMeshQuery* navquery)
 	int n = 0;
 	for (Test* iter = m_tests; iter; iter = iter->next)
 	{
-		const int total = iter->findNearestPolyTime + iter->findPathTime + iter->findStraightPathTime;
+		const int total = iter->findNearestPolyTime + iter->findPathTime + iter->findStraightPathTime + iter->findPolysAroundCircleTime;
+		if (iter->type == TEST_POLYS_AROUND_CIRCLE)
+		{
+			printf(" - Circle %02d:   %.4f ms\n", n, (float)total/1000.0f);
+			printf("    - poly:     %.4f ms\n", (float)iter->findNearestPolyTime/1000.0f);
+			printf("    - circle:   %.4f ms (%d polys)\n", (float)iter->findPolysAroundCircleTime/1000.0f, iter->npolys);
+			n++;
+			continue;
+		}
 		printf(" - Path %02d:     %.4f ms\n", n, (float)total/1000.0f);
 		printf("    - poly:     %.4f ms\n", (float)iter->findNearestPolyTime/1000.0f);
 		printf("    - path:     %.4f ms\n", (float)iter->findPathTime/1000.0f);
@@ -248,6 +348,26 @@ void TestCase::handleRender()
 	glBegin(GL_LINES);
 	for (Test* iter = m_tests; iter; iter = iter->next)
 	{
+		if (iter->type == TEST_POLYS_AROUND_CIRCLE)
+		{
+			static const int NSEG = 32;
+			glColor4ub(128,25,0,192);
+			glVertex3f(iter->spos[0],iter->spos[1]-0.3f,iter->spos[2]);
+			glVertex3f(iter->spos[0],iter->spos[1]+0.3f,iter->spos[2]);
+			if (iter->expand)
+				glColor4ub(255,192,0,255);
+			else
+				glColor4ub(0,0,0,64);
+			for (int i = 0, j = NSEG-1; i < NSEG; j = i++)
+			{
+				const float a0 = (float)j/(float)NSEG*DU_PI*2;
+				const float a1 = (float)i/(float)NSEG*DU_PI*2;
+				glVertex3f(iter->spos[0]+cosf(a0)*iter->radius, iter->spos[1]+0.3f, iter->spos[2]+sinf(a0)*iter->radius);
+				glVertex3f(iter->spos[0]+cosf(a1)*iter->radius, iter->spos[1]+0.3f, iter->spos[2]+sinf(a1)*iter->radius);
+			}
+			continue;
+		}
+		
 		float dir[3];
 		dtVsub(dir, iter->epos, iter->spos);
 		dtVnormalize(dir);
@@ -308,7 +428,10 @@ bool TestCase::handleRenderOverlay(double* proj, double* model, int* view)
 		if (gluProject((GLdouble)pt[0], (GLdouble)pt[1], (GLdouble)pt[2],
 					   model, proj, view, &x, &y, &z))
 		{
-			snprintf(text, 64, "Path %d\n", n);
+			if (iter->type == TEST_POLYS_AROUND_CIRCLE)
+				snprintf(text, 64, "Circle %d\n", n);
+			else
+				snprintf(text, 64, "Path %d\n", n);
 			unsigned int col = imguiRGBA(0,0,0,128);
 			if (iter->expand)
 				col = imguiRGBA(255,192,0,220);
@@ -324,13 +447,26 @@ bool TestCase::handleRenderOverlay(double* proj, double* model, int* view)
 	n = 0;
 	for (Test* iter = m_tests; iter; iter = iter->next)
 	{
-		const int total = iter->findNearestPolyTime + iter->findPathTime + iter->findStraightPathTime;
+		const int total = iter->findNearestPolyTime + iter->findPathTime + iter->findStraightPathTime + iter->findPolysAroundCircleTime;
 		snprintf(subtext, 64, "%.4f ms", (float)total/1000.0f);
-		snprintf(text, 64, "Path %d", n);
+		if (iter->type == TEST_POLYS_AROUND_CIRCLE)
+			snprintf(text, 64, "Circle %d", n);
+		else
+			snprintf(text, 64, "Path %d", n);
 		
 		if (imguiCollapse(text, subtext, iter->expand))
 			iter->expand = !iter->expand;
-		if (iter->expand)
+		if (iter->expand && iter->type == TEST_POLYS_AROUND_CIRCLE)
+		{
+			snprintf(text, 64, "Poly: %.4f ms", (float)iter->findNearestPolyTime/1000.0f);
+			imguiValue(text);
+
+			snprintf(text, 64, "Circle: %.4f ms", (float)iter->findPolysAroundCircleTime/1000.0f);
+			imguiValue(text);
+			
+			imguiSeparator();
+		}
+		else if (iter->expand)
 		{
 			snprintf(text, 64, "Poly: %.4f ms", (float)iter->findNearestPolyTime/1000.0f);
 			imguiValue(text);
@@ -569,15 +569,37 @@ int main(int /*argc*/, char** /*argv*/)
 					showTestCases = false;
 					showLevels = true;
 					scanDirectory("Meshes", ".obj", files);
+					scanDirectoryAppend("Meshes", ".ctm", files);
 				}
 			}
-			if (geom)
+			if (geom && geom->getMesh())
 			{
 				char text[64];
 				snprintf(text, 64, "Verts: %.1fk  Tris: %.1fk",
 						 geom->getMesh()->getVertCount()/1000.0f,
 						 geom->getMesh()->getTriCount()/1000.0f);
 				imguiValue(text);
+				
+				if (imguiButton("Save Chunky Mesh"))
+				{
+					// Write the mesh next to the source as .ctm, it shows up in the mesh list.
+					char path[256];
+					snprintf(path, sizeof(path), "Meshes/%s", meshName);
+					char* ext = strrchr(path, '.');
+					if (ext)
+						*ext = '\0';
+					strncat(path, ".ctm", sizeof(path)-strlen(path)-1);
+					ctx.resetLog();
+					geom->saveChunkyMesh(&ctx, path);
+					ctx.dumpLog("Save log %s:", meshName);
+				}
+			}
+			else if (geom)
+			{
+				char text[64];
+				snprintf(text, 64, "Tris: %.1fk (streamed)",
+						 geom->getChunkyMesh()->ntris/1000.0f);
+				imguiValue(text);
 			}
 			imguiSeparator();
 